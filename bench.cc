@@ -0,0 +1,663 @@
+/*
+ * bench.cc
+ *
+ * Throughput and latency of every QF operation, swept over q, r, load,
+ * table format and backend. Runs against whatever the pool file lives on:
+ * a DAX mount for persistent memory, /dev/shm for volatile memory, or any
+ * other file system; the dram backend keeps the table out of the pool
+ * altogether, to measure what pmem costs on the same workload. Results go
+ * to stdout as CSV or JSON, one record per operation.
+ */
+
+extern "C"
+{
+#include "pmem-qf.c"
+}
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+
+using namespace std;
+
+#define POOL_SIZE_MB	1024
+
+/* A backend of its own here: a struct qf_tier over a pmem QF. */
+#define BENCH_TIER	3
+
+/* Lookups and removes timed per configuration, at most. */
+#define BENCH_OPS_MAX	(1 << 20)
+
+struct bench_opts {
+	const char *path;
+	vector<uint32_t> qs;
+	vector<uint32_t> rs;
+	vector<uint32_t> loads;	/* percent */
+	vector<int> formats;
+	vector<int> backends;	/* QF_BACKEND_* or BENCH_TIER */
+	uint64_t log_cap;	/* staging log of the pmem backend, 0 for none */
+	size_t pool_mb;
+	bool json;
+	bool keep;
+};
+
+/*
+ * One line of output. Latencies are 0 for operations timed as a whole.
+ * Built with -DQF_INSTRUMENT, the line also carries the counters of the
+ * operation per call, and the transactions and log bytes in total.
+ */
+struct bench_result {
+	const char *br_op;
+	int br_format;
+	int br_backend;
+	uint32_t br_q;
+	uint32_t br_r;
+	uint32_t br_load;
+	uint64_t br_n;
+	double br_secs;
+	uint64_t br_p50;
+	uint64_t br_p99;
+	uint64_t br_p999;
+	struct qf_counters br_c;
+};
+
+static mt19937_64 rng(0);
+
+static uint64_t rand64()
+{
+	return rng();
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Percentile p (0..1) of sorted samples, nearest rank. */
+static uint64_t percentile(const vector<uint64_t> &sorted, double p)
+{
+	if (sorted.empty())
+	{
+		return 0;
+	}
+	size_t i = (size_t)(p * sorted.size());
+	return sorted[min(i, sorted.size() - 1)];
+}
+
+/*
+ * Time op on every element of items, one clock read per call, so the
+ * samples add up to the time of the whole loop.
+ */
+template <typename Op>
+static void timed(bench_result *res, const vector<uint64_t> &items, Op op)
+{
+	vector<uint64_t> lat(items.size());
+	qf_counters_reset();
+	uint64_t start = now_ns();
+	uint64_t prev = start;
+
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		op(items[i]);
+		uint64_t t = now_ns();
+		lat[i] = t - prev;
+		prev = t;
+	}
+	res->br_n = items.size();
+	res->br_secs = (prev - start) / 1e9;
+	qf_counters_thread(&res->br_c);
+	sort(lat.begin(), lat.end());
+	res->br_p50 = percentile(lat, 0.50);
+	res->br_p99 = percentile(lat, 0.99);
+	res->br_p999 = percentile(lat, 0.999);
+}
+
+static void print_result(const bench_opts &o, const bench_result &r, bool first)
+{
+	const char *format = (r.br_format == QF_FORMAT_BLOCKED) ? "blocked" : "classic";
+	const char *backends[] = {"pmem", "dram", "hybrid", "tier"};
+	const char *backend = backends[r.br_backend];
+	double ops = r.br_secs > 0 ? r.br_n / r.br_secs : 0;
+	struct qf_counters unused;
+	bool counted = qf_counters_thread(&unused);
+	const struct qf_counters &c = r.br_c;
+	double n = r.br_n ? r.br_n : 1;
+
+	if (o.json)
+	{
+		printf("%s\n  {\"op\": \"%s\", \"format\": \"%s\", \"backend\": \"%s\", "
+			   "\"q\": %u, \"r\": %u, "
+			   "\"load\": %u, \"n\": %lu, \"secs\": %.6f, \"ops_per_sec\": %.0f, "
+			   "\"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu",
+			   first ? "" : ",", r.br_op, format, backend, r.br_q, r.br_r, r.br_load,
+			   r.br_n, r.br_secs, ops, r.br_p50, r.br_p99, r.br_p999);
+		if (counted)
+		{
+			printf(", \"walk_slots\": %.2f, \"scan_slots\": %.2f, \"shift_slots\": %.2f, "
+				   "\"lines\": %.2f, \"tx\": %lu, \"tx_aborts\": %lu, \"tx_bytes\": %lu",
+				   c.qc_walk_slots / n, c.qc_scan_slots / n, c.qc_shift_slots / n,
+				   c.qc_lines / n, c.qc_tx, c.qc_tx_aborts, c.qc_tx_bytes);
+		}
+		printf("}");
+	}
+	else
+	{
+		printf("%s,%s,%s,%u,%u,%u,%lu,%.6f,%.0f,%lu,%lu,%lu", r.br_op, format,
+			   backend, r.br_q, r.br_r, r.br_load, r.br_n, r.br_secs, ops,
+			   r.br_p50, r.br_p99, r.br_p999);
+		if (counted)
+		{
+			printf(",%.2f,%.2f,%.2f,%.2f,%lu,%lu,%lu",
+				   c.qc_walk_slots / n, c.qc_scan_slots / n, c.qc_shift_slots / n,
+				   c.qc_lines / n, c.qc_tx, c.qc_tx_aborts, c.qc_tx_bytes);
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+/* Distinct random fingerprints of q+r bits, none of them in avoid. */
+static vector<uint64_t> fingerprints(uint32_t bits, size_t n, const vector<uint64_t> &avoid)
+{
+	vector<uint64_t> fps;
+	vector<uint64_t> sorted(avoid);
+	sort(sorted.begin(), sorted.end());
+
+	while (fps.size() < n)
+	{
+		size_t want = n - fps.size();
+		for (size_t i = 0; i < want; ++i)
+		{
+			fps.push_back(rand64() & LOW_MASK(bits));
+		}
+		sort(fps.begin(), fps.end());
+		fps.erase(unique(fps.begin(), fps.end()), fps.end());
+		vector<uint64_t> left;
+		set_difference(fps.begin(), fps.end(), sorted.begin(), sorted.end(),
+					   back_inserter(left));
+		fps.swap(left);
+	}
+	shuffle(fps.begin(), fps.end(), rng);
+	return fps;
+}
+
+static bool init_qf(PMEMobjpool *pop, TOID(struct quotient_filter) qf, int format,
+					uint32_t q, uint32_t r)
+{
+	return format == QF_FORMAT_BLOCKED ? qf_init_blocked(pop, qf, q, r) : qf_init(pop, qf, q, r);
+}
+
+/* Run every operation on one configuration. Returns the records printed. */
+static int bench_one(PMEMobjpool *pop, const bench_opts &o, TOID(struct quotient_filter) *qfs,
+					 int format, uint32_t q, uint32_t r, uint32_t load, int printed)
+{
+	TOID(struct quotient_filter) qf = qfs[0];
+	TOID(struct quotient_filter) qf2 = qfs[1];
+	TOID(struct quotient_filter) out = qfs[2];
+	uint32_t bits = q + r;
+	size_t n = (size_t)((1ULL << q) / 100 * load + (1ULL << q) % 100 * load / 100);
+	bench_result res;
+
+	if (!init_qf(pop, qf, format, q, r) || !init_qf(pop, qf2, format, q, r) ||
+		!qf_set_log(pop, qf, o.log_cap))
+	{
+		fprintf(stderr, "bench: no room for q=%u r=%u, see -s\n", q, r);
+		return printed;
+	}
+
+	vector<uint64_t> none;
+	vector<uint64_t> keys = fingerprints(bits, n, none);
+	vector<uint64_t> absent = fingerprints(bits, min(n, (size_t)BENCH_OPS_MAX), keys);
+	vector<uint64_t> probes(keys.begin(), keys.begin() + min(n, (size_t)BENCH_OPS_MAX));
+	shuffle(probes.begin(), probes.end(), rng);
+
+	res.br_format = format;
+	res.br_backend = QF_BACKEND_PMEM;
+	res.br_q = q;
+	res.br_r = r;
+	res.br_load = load;
+
+	res.br_op = "insert";
+	size_t failed = 0;
+	timed(&res, keys, [&](uint64_t h) { failed += !qf_insert(pop, qf, h); });
+	if (failed)
+	{
+		fprintf(stderr, "bench: %zu inserts failed at q=%u r=%u load=%u\n",
+				failed, q, r, load);
+	}
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_pos";
+	timed(&res, probes, [&](uint64_t h) { assert(qf_may_contain(qf, h)); });
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_neg";
+	timed(&res, absent, [&](uint64_t h) { qf_may_contain(qf, h); });
+	print_result(o, res, printed++ == 0);
+
+	/* Batched lookups are timed per batch, then reported per lookup. */
+	res.br_op = "lookup_batch";
+	vector<uint8_t> found(probes.size());
+	qf_counters_reset();
+	uint64_t t = now_ns();
+	qf_may_contain_batch(qf, probes.data(), probes.size(), found.data());
+	res.br_n = probes.size();
+	res.br_secs = (now_ns() - t) / 1e9;
+	qf_counters_thread(&res.br_c);
+	res.br_p50 = res.br_p99 = res.br_p999 = 0;
+	print_result(o, res, printed++ == 0);
+
+	/* What the inserts left staged; the iterator sees the table alone. */
+	if (o.log_cap > 0)
+	{
+		res.br_op = "drain";
+		qf_counters_reset();
+		t = now_ns();
+		res.br_n = D_RO(qf)->qf_log_len;
+		qf_log_drain(pop, qf);
+		res.br_secs = (now_ns() - t) / 1e9;
+		qf_counters_thread(&res.br_c);
+		print_result(o, res, printed++ == 0);
+	}
+
+	res.br_op = "iterate";
+	struct qf_iterator qfi;
+	qf_counters_reset();
+	t = now_ns();
+	qfi_start(qf, &qfi);
+	uint64_t visited = 0;
+	while (!qfi_done(qf, &qfi))
+	{
+		qfi_next(qf, &qfi);
+		++visited;
+	}
+	res.br_n = visited;
+	res.br_secs = (now_ns() - t) / 1e9;
+	qf_counters_thread(&res.br_c);
+	print_result(o, res, printed++ == 0);
+
+	/* A full consistency check on every CPU; the rate is in slots. */
+	res.br_op = "check";
+	qf_counters_reset();
+	t = now_ns();
+	int checked = qf_check(qf, QF_CHECK_PARALLEL, NULL);
+	res.br_secs = (now_ns() - t) / 1e9;
+	qf_counters_thread(&res.br_c);
+	res.br_n = D_RO(qf)->qf_max_size;
+	if (checked == 0)
+	{
+		print_result(o, res, printed++ == 0);
+	}
+	else
+	{
+		fprintf(stderr, "bench: check found damage at q=%u r=%u\n", q, r);
+	}
+
+	/* Merge two QFs at the same load; the rate is in input entries. */
+	res.br_op = "merge";
+	for (size_t i = 0; i < n; ++i)
+	{
+		qf_insert(pop, qf2, rand64() & LOW_MASK(bits));
+	}
+	qf_counters_reset();
+	t = now_ns();
+	bool merged = qf_merge(pop, qf, qf2, out);
+	res.br_secs = (now_ns() - t) / 1e9;
+	qf_counters_thread(&res.br_c);
+	res.br_n = D_RO(qf)->qf_entries + D_RO(qf2)->qf_entries;
+	if (merged)
+	{
+		print_result(o, res, printed++ == 0);
+		qf_destroy(pop, out);
+	}
+	else
+	{
+		fprintf(stderr, "bench: merge failed at q=%u r=%u, see -s\n", q, r);
+	}
+	qf_destroy(pop, qf2);
+
+	res.br_op = "remove";
+	timed(&res, probes, [&](uint64_t h) { qf_remove(pop, qf, h); });
+	print_result(o, res, printed++ == 0);
+
+	qf_destroy(pop, qf);
+	return printed;
+}
+
+/*
+ * Same as bench_one() for a QF behind a struct qf_mem: in DRAM alone, or
+ * a DRAM copy of a pmem QF that updates go through to. Iteration and
+ * merging need a pmem QF and are left out.
+ */
+static int bench_mem(PMEMobjpool *pop, const bench_opts &o, TOID(struct quotient_filter) qf,
+					 int backend, int format, uint32_t q, uint32_t r, uint32_t load,
+					 int printed)
+{
+	uint32_t bits = q + r;
+	size_t n = (size_t)((1ULL << q) / 100 * load + (1ULL << q) % 100 * load / 100);
+	struct qf_mem m;
+	bench_result res;
+	bool ok;
+
+	if (backend == QF_BACKEND_HYBRID)
+	{
+		ok = init_qf(pop, qf, format, q, r) && qf_mem_open(&m, pop, qf);
+	}
+	else
+	{
+		ok = format == QF_FORMAT_BLOCKED ? qf_mem_init_blocked(&m, q, r) : qf_mem_init(&m, q, r);
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "bench: no room for q=%u r=%u, see -s\n", q, r);
+		return printed;
+	}
+
+	vector<uint64_t> none;
+	vector<uint64_t> keys = fingerprints(bits, n, none);
+	vector<uint64_t> absent = fingerprints(bits, min(n, (size_t)BENCH_OPS_MAX), keys);
+	vector<uint64_t> probes(keys.begin(), keys.begin() + min(n, (size_t)BENCH_OPS_MAX));
+	shuffle(probes.begin(), probes.end(), rng);
+
+	res.br_format = format;
+	res.br_backend = backend;
+	res.br_q = q;
+	res.br_r = r;
+	res.br_load = load;
+
+	res.br_op = "insert";
+	size_t failed = 0;
+	timed(&res, keys, [&](uint64_t h) { failed += !qf_mem_insert(&m, h); });
+	if (failed)
+	{
+		fprintf(stderr, "bench: %zu inserts failed at q=%u r=%u load=%u\n",
+				failed, q, r, load);
+	}
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_pos";
+	timed(&res, probes, [&](uint64_t h) { assert(qf_mem_may_contain(&m, h)); });
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_neg";
+	timed(&res, absent, [&](uint64_t h) { qf_mem_may_contain(&m, h); });
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_batch";
+	vector<uint8_t> found(probes.size());
+	qf_counters_reset();
+	uint64_t t = now_ns();
+	qfv_may_contain_batch(&m.qm_view, probes.data(), probes.size(), found.data());
+	res.br_n = probes.size();
+	res.br_secs = (now_ns() - t) / 1e9;
+	qf_counters_thread(&res.br_c);
+	res.br_p50 = res.br_p99 = res.br_p999 = 0;
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "remove";
+	timed(&res, probes, [&](uint64_t h) { qf_mem_remove(&m, h); });
+	print_result(o, res, printed++ == 0);
+
+	qf_mem_fini(&m);
+	if (backend == QF_BACKEND_HYBRID)
+	{
+		qf_destroy(pop, qf);
+	}
+	return printed;
+}
+
+/*
+ * Same as bench_one() through a metadata tier, whose lookups read pmem
+ * only to compare remainders.
+ */
+static int bench_tier(PMEMobjpool *pop, const bench_opts &o, TOID(struct quotient_filter) qf,
+					  int format, uint32_t q, uint32_t r, uint32_t load, int printed)
+{
+	uint32_t bits = q + r;
+	size_t n = (size_t)((1ULL << q) / 100 * load + (1ULL << q) % 100 * load / 100);
+	struct qf_tier t;
+	bench_result res;
+
+	if (!init_qf(pop, qf, format, q, r) || !qf_tier_open(pop, qf, &t))
+	{
+		fprintf(stderr, "bench: no room for q=%u r=%u, see -s\n", q, r);
+		return printed;
+	}
+
+	vector<uint64_t> none;
+	vector<uint64_t> keys = fingerprints(bits, n, none);
+	vector<uint64_t> absent = fingerprints(bits, min(n, (size_t)BENCH_OPS_MAX), keys);
+	vector<uint64_t> probes(keys.begin(), keys.begin() + min(n, (size_t)BENCH_OPS_MAX));
+	shuffle(probes.begin(), probes.end(), rng);
+
+	res.br_format = format;
+	res.br_backend = BENCH_TIER;
+	res.br_q = q;
+	res.br_r = r;
+	res.br_load = load;
+
+	res.br_op = "insert";
+	size_t failed = 0;
+	timed(&res, keys, [&](uint64_t h) { failed += !qf_tier_insert(&t, h); });
+	if (failed)
+	{
+		fprintf(stderr, "bench: %zu inserts failed at q=%u r=%u load=%u\n",
+				failed, q, r, load);
+	}
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_pos";
+	timed(&res, probes, [&](uint64_t h) { assert(qf_tier_may_contain(&t, h)); });
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "lookup_neg";
+	timed(&res, absent, [&](uint64_t h) { qf_tier_may_contain(&t, h); });
+	print_result(o, res, printed++ == 0);
+
+	res.br_op = "remove";
+	timed(&res, probes, [&](uint64_t h) { qf_tier_remove(&t, h); });
+	print_result(o, res, printed++ == 0);
+
+	qf_tier_fini(&t);
+	qf_destroy(pop, qf);
+	return printed;
+}
+
+static vector<uint32_t> parse_list(const char *s)
+{
+	vector<uint32_t> v;
+	string str(s);
+	size_t pos = 0;
+	while (pos <= str.size())
+	{
+		size_t comma = str.find(',', pos);
+		if (comma == string::npos)
+		{
+			comma = str.size();
+		}
+		v.push_back(strtoul(str.substr(pos, comma - pos).c_str(), NULL, 10));
+		pos = comma + 1;
+	}
+	return v;
+}
+
+static void usage()
+{
+	printf("usage: ./bench [options] <pmemfile>\n"
+		   "  -q LIST   quotient bits (default 16,20)\n"
+		   "  -r LIST   remainder bits (default 8)\n"
+		   "  -l LIST   load percent (default 50,75,90)\n"
+		   "  -F LIST   formats: classic,blocked (default classic)\n"
+		   "  -B LIST   backends: pmem,dram,hybrid,tier (default pmem)\n"
+		   "  -L CAP    stage pmem inserts in a log of CAP fingerprints\n"
+		   "  -s MB     pool size when creating the pool (default %d)\n"
+		   "  -j        JSON instead of CSV\n"
+		   "  -k        keep a pool file the benchmark created\n"
+		   "The pool file decides the memory: a DAX mount for pmem,\n"
+		   "/dev/shm for DRAM.\n", POOL_SIZE_MB);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	bench_opts o;
+	int c;
+
+	o.qs = parse_list("16,20");
+	o.rs = parse_list("8");
+	o.loads = parse_list("50,75,90");
+	o.formats.push_back(QF_FORMAT_CLASSIC);
+	o.backends.push_back(QF_BACKEND_PMEM);
+	o.log_cap = 0;
+	o.pool_mb = POOL_SIZE_MB;
+	o.json = false;
+	o.keep = false;
+
+	while ((c = getopt(argc, argv, "q:r:l:F:B:L:s:jk")) != -1)
+	{
+		switch (c)
+		{
+		case 'q':
+			o.qs = parse_list(optarg);
+			break;
+		case 'r':
+			o.rs = parse_list(optarg);
+			break;
+		case 'l':
+			o.loads = parse_list(optarg);
+			break;
+		case 'F':
+			o.formats.clear();
+			if (strstr(optarg, "classic"))
+			{
+				o.formats.push_back(QF_FORMAT_CLASSIC);
+			}
+			if (strstr(optarg, "blocked"))
+			{
+				o.formats.push_back(QF_FORMAT_BLOCKED);
+			}
+			break;
+		case 'B':
+			o.backends.clear();
+			if (strstr(optarg, "pmem"))
+			{
+				o.backends.push_back(QF_BACKEND_PMEM);
+			}
+			if (strstr(optarg, "dram"))
+			{
+				o.backends.push_back(QF_BACKEND_DRAM);
+			}
+			if (strstr(optarg, "hybrid"))
+			{
+				o.backends.push_back(QF_BACKEND_HYBRID);
+			}
+			if (strstr(optarg, "tier"))
+			{
+				o.backends.push_back(BENCH_TIER);
+			}
+			break;
+		case 'L':
+			o.log_cap = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			o.pool_mb = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			o.json = true;
+			break;
+		case 'k':
+			o.keep = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind + 1 != argc || o.formats.empty() || o.backends.empty())
+	{
+		usage();
+	}
+	o.path = argv[optind];
+
+	PMEMobjpool *pop;
+	bool created = access(o.path, F_OK) != 0;
+	if (created)
+	{
+		pop = pmemobj_create(o.path, POBJ_LAYOUT_NAME(pmem_qf), o.pool_mb << 20, 0666);
+	}
+	else
+	{
+		pop = pmemobj_open(o.path, POBJ_LAYOUT_NAME(pmem_qf));
+	}
+	if (pop == NULL)
+	{
+		fprintf(stderr, "%s\n", pmemobj_errormsg());
+		exit(1);
+	}
+
+	TOID(struct quotient_filter) qfs[3];
+	TX_BEGIN(pop) {
+		for (int i = 0; i < 3; ++i)
+		{
+			qfs[i] = TX_ZNEW(struct quotient_filter);
+		}
+	} TX_END;
+
+	int printed = 0;
+	if (o.json)
+	{
+		printf("[");
+	}
+	else
+	{
+		struct qf_counters unused;
+		printf("op,format,backend,q,r,load,n,secs,ops_per_sec,p50_ns,p99_ns,p999_ns%s\n",
+			   qf_counters_thread(&unused) ? ",walk_slots,scan_slots,shift_slots,lines,"
+			   "tx,tx_aborts,tx_bytes" : "");
+	}
+	for (size_t b = 0; b < o.backends.size(); ++b)
+		for (size_t f = 0; f < o.formats.size(); ++f)
+			for (size_t qi = 0; qi < o.qs.size(); ++qi)
+				for (size_t ri = 0; ri < o.rs.size(); ++ri)
+					for (size_t li = 0; li < o.loads.size(); ++li)
+					{
+						if (o.backends[b] == QF_BACKEND_PMEM)
+						{
+							printed = bench_one(pop, o, qfs, o.formats[f], o.qs[qi],
+												o.rs[ri], o.loads[li], printed);
+						}
+						else if (o.backends[b] == BENCH_TIER)
+						{
+							printed = bench_tier(pop, o, qfs[0], o.formats[f], o.qs[qi],
+												 o.rs[ri], o.loads[li], printed);
+						}
+						else
+						{
+							printed = bench_mem(pop, o, qfs[0], o.backends[b], o.formats[f],
+												o.qs[qi], o.rs[ri], o.loads[li], printed);
+						}
+					}
+	if (o.json)
+	{
+		printf("\n]\n");
+	}
+
+	TX_BEGIN(pop) {
+		for (int i = 0; i < 3; ++i)
+		{
+			TX_FREE(qfs[i]);
+		}
+	} TX_END;
+	pmemobj_close(pop);
+	if (created && !o.keep)
+	{
+		unlink(o.path);
+	}
+	return 0;
+}
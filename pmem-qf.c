@@ -6,21 +6,139 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "pmem-qf.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define QF_HAVE_BMI2
+#endif
+
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
-#define LOW_MASK(n) ((1ULL << (n)) - 1ULL)
+#define LOW_MASK(n) ((n) >= 64 ? ~0ULL : (1ULL << (n)) - 1ULL)
 //ULL is used for Unsigned Long Long which is defined using 64 bits which can store large values.
 //用于取出一个long long的低n位的掩码
 
-TOID(uint64_t) qf_table_toid;
-PMEMoid qf_table_oid;
+/*
+ * Instrumentation. With QF_INSTRUMENT defined, every thread gets a block
+ * of counters on first use, linked into a list that qf_counters_total()
+ * walks and never freed. Only the owner writes a block, with relaxed
+ * stores that compile to plain adds, so other threads can read it
+ * without locks. Without QF_INSTRUMENT, QF_COUNT() is empty and its
+ * arguments are never evaluated.
+ */
+#ifdef QF_INSTRUMENT
+struct qf_counter_block {
+	struct qf_counters cb_c;
+	struct qf_counter_block *cb_next;
+};
 
-//需要写入，是根API
-bool qf_init(PMEMobjpool *pop,TOID(struct quotient_filter) qf, uint32_t q, uint32_t r)
+static struct qf_counter_block *qf_counter_list;
+static __thread struct qf_counter_block *qf_counter_mine;
+
+static struct qf_counters *counters_mine(void)
+{
+	if (qf_counter_mine == NULL) {
+		struct qf_counter_block *b =
+				(struct qf_counter_block *)calloc(1, sizeof(*b));
+		if (b == NULL) {
+			//没有内存时计数丢掉，不影响QF本身
+			static __thread struct qf_counters lost;
+			return &lost;
+		}
+		b->cb_next = __atomic_load_n(&qf_counter_list, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&qf_counter_list, &b->cb_next, b,
+				false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		}
+		qf_counter_mine = b;
+	}
+	return &qf_counter_mine->cb_c;
+}
+
+#define QF_COUNT(field, n) do { \
+	struct qf_counters *c_ = counters_mine(); \
+	__atomic_store_n(&c_->field, c_->field + (n), __ATOMIC_RELAXED); \
+} while (0)
+#else
+#define QF_COUNT(field, n) do { } while (0)
+#endif
+
+//商和余数长度是否合法：都不为0，指纹不超过64位，且r+3位的slot能放进一个uint64_t
+static bool qf_params_valid(uint32_t q, uint32_t r)
+{
+	return q != 0 && r != 0 && q + r <= 64 && r + 3 <= 64;
+}
+
+/* Word indices of the bookkeeping at the head of every block. */
+#define BLK_OFFSET	0
+#define BLK_OCCUPIEDS	1
+#define BLK_RUNENDS	2
+#define BLK_REMAINDERS	3
+
+/*
+ * Number of blocks in a blocked table with 2^q quotients. Runs cannot wrap,
+ * so the table gets one extra block plus room for about ten standard
+ * deviations of the longest cluster past the last quotient.
+ */
+static uint64_t blocked_nblocks(uint32_t q)
+{
+	uint64_t slots = (1ULL << q) + QF_BLOCK_SLOTS + 10 * (1ULL << ((q + 1) / 2));
+	return (slots + QF_BLOCK_SLOTS - 1) / QF_BLOCK_SLOTS;
+}
+
+//表的字节数，与格式有关
+static size_t table_bytes(uint8_t format, uint32_t q, uint32_t r)
+{
+	if (format == QF_FORMAT_BLOCKED) {
+		return blocked_nblocks(q) * (BLK_REMAINDERS + r) * sizeof(uint64_t);
+	}
+	return qf_table_size(q, r);
+}
+
+//填写空QF的头部，调用者已在事务中添加了qf，表由调用者分配
+static void set_header(TOID(struct quotient_filter) qf, uint32_t q, uint32_t r,
+		uint8_t format)
+{
+	D_RW(qf)->qf_magic = QF_MAGIC;
+	D_RW(qf)->qf_qbits = q;//商的长度
+	D_RW(qf)->qf_rbits = r;//余数长度
+	//一个slot中存储长度：经典格式为r+3，分块格式的标志位在块头部，只存余数
+	D_RW(qf)->qf_elem_bits = (format == QF_FORMAT_BLOCKED) ? r : r + 3;
+	D_RW(qf)->qf_format = format;
+	D_RW(qf)->qf_counting = 0;
+	D_RW(qf)->qf_index_mask = LOW_MASK(q);
+	D_RW(qf)->qf_rmask = LOW_MASK(r);
+	D_RW(qf)->qf_elem_mask = LOW_MASK(D_RO(qf)->qf_elem_bits);
+
+	D_RW(qf)->qf_entries = 0;
+	D_RW(qf)->qf_max_size = 1ULL << q;//当前已有0个元素，最多有2^q个元素
+	D_RW(qf)->qf_nblocks = (format == QF_FORMAT_BLOCKED) ? blocked_nblocks(q) : 0;
+}
+
+//设置最大负载和满时的策略，调用者已在事务中添加了qf
+static void set_policy(TOID(struct quotient_filter) qf, uint32_t load, int policy,
+		TOID(struct quotient_filter) spill)
+{
+	D_RW(qf)->qf_max_load = load;
+	D_RW(qf)->qf_full_policy = policy;
+	D_RW(qf)->qf_spill = spill;
+}
+
+//设置键的哈希函数和种子，调用者已在事务中添加了qf
+static void set_hash(TOID(struct quotient_filter) qf, int kind, uint64_t seed)
+{
+	D_RW(qf)->qf_hash = kind;
+	D_RW(qf)->qf_seed = seed;
+}
+
+//需要写入，不是根API
+static bool init_format(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint32_t q, uint32_t r, uint8_t format, bool counting)
 {
-	if (q == 0 || r == 0 || q + r > 64) {
+	if (!qf_params_valid(q, r)) {
 		//如果商或余数长度为0，或者指纹总长度超过64，则是无效初始化
 		return false;
 	}
@@ -33,20 +151,18 @@ bool qf_init(PMEMobjpool *pop,TOID(struct quotient_filter) qf, uint32_t q, uint3
 		//新分配的内存不需要添加
         TX_ADD(qf);
 
-        D_RW(qf)->qf_qbits = q;//商的长度
-        D_RW(qf)->qf_rbits = r;//余数长度
-        D_RW(qf)->qf_elem_bits = D_RO(qf)->qf_rbits + 3;//一个slot中存储长度，r+3
-        D_RW(qf)->qf_index_mask = LOW_MASK(q);
-        D_RW(qf)->qf_rmask = LOW_MASK(r);
-        D_RW(qf)->qf_elem_mask = LOW_MASK(D_RO(qf)->qf_elem_bits);
-
-        D_RW(qf)->qf_entries = 0; 
-        D_RW(qf)->qf_max_size = 1 << q;//当前已有0个元素，最多有2^q个元素
+        set_header(qf, q, r, format);
+        set_policy(qf, 100, QF_FULL_REJECT, TOID_NULL(struct quotient_filter));
+        D_RW(qf)->qf_counting = counting;
+        set_hash(qf, QF_HASH_WY, 0);
+		//和表一样不释放原有的日志
+		D_RW(qf)->qf_log = TOID_NULL(uint64_t);
+		D_RW(qf)->qf_log_cap = 0;
+		D_RW(qf)->qf_log_len = 0;
 
 		//如果分配失败，事务会自动abort
-		qf_table_toid=TX_ZALLOC(uint64_t,qf_table_size(q, r));
-		qf_table_oid=qf_table_toid.oid;
-        D_RW(qf)->qf_table=(uint64_t*)pmemobj_direct(qf_table_oid);
+		//表以TOID的形式保存在qf中，地址在每次使用时由qfv_init解析
+		D_RW(qf)->qf_table = TX_ZALLOC(uint64_t, table_bytes(format, q, r));
 
 	}TX_ONABORT{
 		ret=false;
@@ -57,61 +173,198 @@ bool qf_init(PMEMobjpool *pop,TOID(struct quotient_filter) qf, uint32_t q, uint3
     return ret;
 }
 
+//需要写入，是根API
+bool qf_init(PMEMobjpool *pop,TOID(struct quotient_filter) qf, uint32_t q, uint32_t r)
+{
+	return init_format(pop, qf, q, r, QF_FORMAT_CLASSIC, false);
+}
+
+//需要写入，是根API
+bool qf_init_blocked(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint32_t q, uint32_t r)
+{
+	return init_format(pop, qf, q, r, QF_FORMAT_BLOCKED, false);
+}
+
+//需要写入，是根API
+bool qf_init_counting(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint32_t q, uint32_t r)
+{
+	//计数器的每一位数字要避开0和余数本身，r为1时没有可用的值
+	if (r < 2) {
+		return false;
+	}
+	return init_format(pop, qf, q, r, QF_FORMAT_CLASSIC, true);
+}
+
+//只读，检查重新打开的池中的QF头部是否完整有效
+bool qf_open(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	if (TOID_IS_NULL(qf) || pmemobj_pool_by_oid(qf.oid) != pop) {
+		return false;
+	}
+
+	const struct quotient_filter *f = D_RO(qf);
+	uint32_t q = f->qf_qbits;
+	uint32_t r = f->qf_rbits;
+
+	if (f->qf_magic != QF_MAGIC) {
+		return false;
+	}
+	if (f->qf_format != QF_FORMAT_CLASSIC && f->qf_format != QF_FORMAT_BLOCKED) {
+		return false;
+	}
+	if (f->qf_max_load == 0 || f->qf_max_load > 100 || f->qf_full_policy > QF_FULL_SPILL) {
+		return false;
+	}
+	if (f->qf_full_policy == QF_FULL_SPILL && TOID_IS_NULL(f->qf_spill)) {
+		return false;
+	}
+	if (f->qf_hash > QF_HASH_NONE) {
+		return false;
+	}
+	if (f->qf_counting > 1 || (f->qf_counting &&
+			(f->qf_format != QF_FORMAT_CLASSIC || r < 2 ||
+			 f->qf_full_policy == QF_FULL_RESIZE))) {
+		return false;
+	}
+
+	bool blocked = (f->qf_format == QF_FORMAT_BLOCKED);
+	uint32_t elem_bits = blocked ? r : r + 3;
+	if (!qf_params_valid(q, r) || f->qf_elem_bits != elem_bits) {
+		return false;
+	}
+	if (f->qf_index_mask != LOW_MASK(q) || f->qf_rmask != LOW_MASK(r) ||
+			f->qf_elem_mask != LOW_MASK(elem_bits)) {
+		return false;
+	}
+	if (f->qf_max_size != (1ULL << q) || f->qf_entries > f->qf_max_size) {
+		return false;
+	}
+	if (f->qf_nblocks != (blocked ? blocked_nblocks(q) : 0)) {
+		return false;
+	}
+	if (TOID_IS_NULL(f->qf_table) ||
+			pmemobj_alloc_usable_size(f->qf_table.oid) <
+			table_bytes(f->qf_format, q, r)) {
+		return false;
+	}
+	if (TOID_IS_NULL(f->qf_log)) {
+		return f->qf_log_cap == 0 && f->qf_log_len == 0;
+	}
+	//日志只给非计数QF用，长度不超过容量
+	return !f->qf_counting && f->qf_log_cap > 0 && f->qf_log_len <= f->qf_log_cap &&
+			f->qf_log_cap <= SIZE_MAX / sizeof(uint64_t) &&
+			pmemobj_pool_by_oid(f->qf_log.oid) == pop &&
+			pmemobj_alloc_usable_size(f->qf_log.oid) >=
+			f->qf_log_cap * sizeof(uint64_t);
+}
+
+//最大负载允许的元素个数，即2^q*load/100向下取整，q很大时也不溢出
+static uint64_t load_limit(uint32_t q, uint32_t load)
+{
+	uint64_t slots = 1ULL << q;
+	return slots / 100 * load + slots % 100 * load / 100;
+}
+
+//填写q、r和格式决定的视图字段，不涉及表
+static void qfv_layout(struct qf_view *v, uint32_t q, uint32_t r, uint8_t format)
+{
+	v->qfv_table = NULL;
+	v->qfv_index_mask = LOW_MASK(q);
+	v->qfv_rmask = LOW_MASK(r);
+	v->qfv_elem_bits = (format == QF_FORMAT_BLOCKED) ? r : r + 3;
+	v->qfv_elem_mask = LOW_MASK(v->qfv_elem_bits);
+	v->qfv_max_size = 1ULL << q;
+	v->qfv_limit = v->qfv_max_size;
+	v->qfv_qbits = q;
+	v->qfv_rbits = r;
+	v->qfv_format = format;
+	v->qfv_counting = 0;
+	v->qfv_backend = QF_BACKEND_DRAM;
+	if (format == QF_FORMAT_BLOCKED) {
+		v->qfv_nslots = blocked_nblocks(q) * QF_BLOCK_SLOTS;
+		v->qfv_block_words = BLK_REMAINDERS + r;
+	} else {
+		v->qfv_nslots = v->qfv_max_size;
+		v->qfv_block_words = 0;
+	}
+
+	v->qfv_prefetch = QF_PREFETCH_DISTANCE;
+	v->qfv_lsbs = 0;
+	for (uint64_t bit = 0; bit + v->qfv_elem_bits <= 64; bit += v->qfv_elem_bits) {
+		v->qfv_lsbs |= 1ULL << bit;
+	}
+}
+
+//只读，解析一次表指针和掩码，之后的查询不再经过pmemobj_direct
+void qfv_init(TOID(struct quotient_filter) qf, struct qf_view *v)
+{
+	const struct quotient_filter *f = D_RO(qf);
+
+	//qf_open已经检查过头部与q、r一致
+	qfv_layout(v, f->qf_qbits, f->qf_rbits, f->qf_format);
+	v->qfv_table = D_RW(f->qf_table);
+	v->qfv_limit = load_limit(f->qf_qbits, f->qf_max_load);
+	v->qfv_counting = f->qf_counting;
+	v->qfv_backend = QF_BACKEND_PMEM;
+}
+
 /* Return QF[idx] in the lower bits. */
 //根据在QF中的id来索引到桶，不需要写入
-static uint64_t get_elem(TOID(struct quotient_filter) qf, uint64_t idx)
+static uint64_t get_elem(const struct qf_view *v, uint64_t idx)
 {
 	uint64_t elt = 0;
 	//bit position
-	size_t bitpos = D_RO(qf)->qf_elem_bits * idx;
+	uint64_t bitpos = v->qfv_elem_bits * idx;
 
 	//tab position，在第几个uint64里
-	size_t tabpos = bitpos / 64;
+	uint64_t tabpos = bitpos / 64;
 
 	//在所在的unint64里的偏移是多少
-	size_t slotpos = bitpos % 64;
-	int spillbits = (slotpos + D_RO(qf)->qf_elem_bits) - 64;
+	uint64_t slotpos = bitpos % 64;
+	int spillbits = (slotpos + v->qfv_elem_bits) - 64;
 
 	//结果是根据tab找到相应uint64，将其读出
-	elt = D_RO(qf)->qf_table [tabpos] >> slotpos & D_RO(qf)->qf_elem_mask;
+	elt = v->qfv_table [tabpos] >> slotpos & v->qfv_elem_mask;
 	if (spillbits > 0) {
 		//大于0说明是跨tab存储
 		++tabpos;
-		uint64_t x = D_RO(qf)->qf_table [tabpos] & LOW_MASK(spillbits);
-		elt |= x << (D_RO(qf)->qf_elem_bits - spillbits);
+		uint64_t x = v->qfv_table [tabpos] & LOW_MASK(spillbits);
+		elt |= x << (v->qfv_elem_bits - spillbits);
 	}
 	return elt;
 }
 
 /* Store the lower bits of elt into QF[idx]. */
 //根据在QF中的id来索引到桶，并设置r+3 bit的数据，需要写入，不是根API
-static void set_elem(TOID(struct quotient_filter) qf, uint64_t idx, uint64_t elt)
-{
-    size_t bitpos = D_RO(qf)->qf_elem_bits * idx;
-    size_t tabpos = bitpos / 64;
-    size_t slotpos = bitpos % 64;
-    int spillbits = (slotpos + D_RO(qf)->qf_elem_bits) - 64;
-    elt &= D_RO(qf)->qf_elem_mask;
-    D_RO(qf)->qf_table [tabpos] &= ~(D_RO(qf)->qf_elem_mask << slotpos);
-    D_RO(qf)->qf_table [tabpos] |= elt << slotpos;
+static void set_elem(const struct qf_view *v, uint64_t idx, uint64_t elt)
+{
+    uint64_t bitpos = v->qfv_elem_bits * idx;
+    uint64_t tabpos = bitpos / 64;
+    uint64_t slotpos = bitpos % 64;
+    int spillbits = (slotpos + v->qfv_elem_bits) - 64;
+    elt &= v->qfv_elem_mask;
+    v->qfv_table [tabpos] &= ~(v->qfv_elem_mask << slotpos);
+    v->qfv_table [tabpos] |= elt << slotpos;
     if (spillbits > 0) {
         ++tabpos;
-        D_RO(qf)->qf_table [tabpos] &= ~LOW_MASK(spillbits);
-        D_RO(qf)->qf_table [tabpos] |= elt >> (D_RO(qf)->qf_elem_bits - spillbits);
+        v->qfv_table [tabpos] &= ~LOW_MASK(spillbits);
+        v->qfv_table [tabpos] |= elt >> (v->qfv_elem_bits - spillbits);
     }
 
 }
 
 //针对特定QF的游标增减，实现了wrap
 //不需写入
-static inline uint64_t incr(TOID(struct quotient_filter) qf, uint64_t idx)
+static inline uint64_t incr(const struct qf_view *v, uint64_t idx)
 {
-	return (idx + 1) & D_RO(qf)->qf_index_mask;
+	return (idx + 1) & v->qfv_index_mask;
 }
 
-static inline uint64_t decr(TOID(struct quotient_filter) qf, uint64_t idx)
+static inline uint64_t decr(const struct qf_view *v, uint64_t idx)
 {
-	return (idx - 1) & D_RO(qf)->qf_index_mask;
+	return (idx - 1) & v->qfv_index_mask;
 }
 
 //以下为处理elt中的三个标志位的函数，对一个bit有is,set,clr操作
@@ -186,447 +439,5047 @@ static inline bool is_run_start(uint64_t elt)
 
 //根据hash生成对这个QF的商和余数
 //不需写入
-static inline uint64_t hash_to_quotient(TOID(struct quotient_filter) qf,
+static inline uint64_t hash_to_quotient(const struct qf_view *v,
 		uint64_t hash)
 {
 	//先把余数部分去了，再取商的掩码
-	return (hash >> D_RO(qf)->qf_rbits) & D_RO(qf)->qf_index_mask;
+	return (hash >> v->qfv_rbits) & v->qfv_index_mask;
 }
 
-static inline uint64_t hash_to_remainder(TOID(struct quotient_filter) qf,
+static inline uint64_t hash_to_remainder(const struct qf_view *v,
 		uint64_t hash)
 {
 	//余数在最低位，直接取掩码
-	return hash & D_RO(qf)->qf_rmask;
+	return hash & v->qfv_rmask;
 }
 
-//定位一个商所属的run的实际位置
-/* Find the start index of the run for fq (given that the run exists). */
-//不需写入
-static uint64_t find_run_index(TOID(struct quotient_filter) qf, uint64_t fq)
+/*
+ * Word-at-a-time kernels.
+ *
+ * A window is a run of consecutive slots read as one word, slot j in bits
+ * [j*bits, (j+1)*bits). qfv_lsbs has the lowest bit of every slot of a
+ * full window set, so a metadata bit of every slot in the window is
+ * (w >> bit) & qfv_lsbs, and finding the n-th run start, the cluster start
+ * or a matching remainder is a mask, a popcount and a select instead of
+ * one get_elem() per slot.
+ *
+ * Slots are not byte aligned, so there is nothing for byte or dword SIMD
+ * lanes to work on; select is the one operation that benefits from BMI2
+ * (pdep), and it is chosen at startup by CPU.
+ */
+
+static int qf_kernel_set = QF_KERNELS_SCALAR;
+
+/* Return the position of the k-th (from 0) set bit of w, or 64. */
+static inline unsigned bit_select_scalar(uint64_t w, unsigned k)
 {
-	/* Find the start of the cluster. */
-	//从本位开始向左扫描到cluster的开始
-	uint64_t b = fq;
-	while (is_shifted(get_elem(qf, b))) {
-		b = decr(qf, b);
+	if (k >= (unsigned)__builtin_popcountll(w)) {
+		return 64;
 	}
 
-	/* Find the start of the run for fq. */
-	//有几个occupied，就说明有几种不同的商q的指纹被插入，那就是有多少个run
-	uint64_t s = b;
-	while (b != fq) {
-		do {
-			s = incr(qf, s);
-		} while (is_continuation(get_elem(qf, s)));
-
-		do {
-			b = incr(qf, b);
-		} while (!is_occupied(get_elem(qf, b)));
-	}//向右扫描到商所属run的开始
-	return s;
+	/* Halve the word until one bit is left. */
+	unsigned pos = 0;
+	for (unsigned width = 32; width > 0; width >>= 1) {
+		unsigned c = __builtin_popcountll(w & LOW_MASK(width));
+		if (k >= c) {
+			k -= c;
+			w >>= width;
+			pos += width;
+		}
+	}
+	return pos;
 }
 
-/* Insert elt into QF[s], shifting over elements as necessary. */
-//需要写入，不是根API
-static void insert_into(TOID(struct quotient_filter) qf, uint64_t s, uint64_t elt)
+#ifdef QF_HAVE_BMI2
+__attribute__((target("bmi2")))
+static unsigned bit_select_bmi2(uint64_t w, unsigned k)
 {
-	uint64_t prev;
-	uint64_t curr = elt;
-	bool empty;
-
-	//在s处插入elt，然后把原有的数据挤到下一个桶中，直到挤到一个空桶里
-	//使用O(1)的空间来存储temp数据，
-	do {
-		prev = get_elem(qf, s);//prev是当前s处的元素
-		empty = is_empty_element(prev);//prev是否是000的空位
-		if (!empty) {
-			/* Fix up `is_shifted' and `is_occupied'. */
-			prev = set_shifted(prev);//要移位了
-			if (is_occupied(prev)) {//isO和桶对应，而不和桶中存储的余数对应
-				curr = set_occupied(curr);
-				prev = clr_occupied(prev);
-			}
-		}
-		set_elem(qf, s, curr);
-		curr = prev;
-		s = incr(qf, s);
-	} while (!empty);
+	uint64_t bit = (k < 64) ? _pdep_u64(1ULL << k, w) : 0;
+	return bit ? __builtin_ctzll(bit) : 64;
 }
+#endif
 
-//需要写入，是根API
-bool qf_insert(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash)
+static inline unsigned bit_select(uint64_t w, unsigned k)
 {
-	if (D_RO(qf)->qf_entries >= D_RO(qf)->qf_max_size) {
-		//QF已满
-		return false;
+#ifdef QF_HAVE_BMI2
+	if (qf_kernel_set == QF_KERNELS_BMI2) {
+		return bit_select_bmi2(w, k);
 	}
+#endif
+	return bit_select_scalar(w, k);
+}
 
-	//根据hash得到商和余数，根据商得到本位elt，并将余数和000结合准备插入
-	uint64_t fq = hash_to_quotient(qf, hash);
-	uint64_t fr = hash_to_remainder(qf, hash);
-	uint64_t T_fq = get_elem(qf, fq);
-	uint64_t entry = (fr << 3) & ~7;
-
-    bool ret;
-	uint64_t start;
-	uint64_t s;
-
-    TX_BEGIN(pop) {
-        //要修改qf_table中的内容
-		/*pmemobj_tx_add_range_direct(D_RO(qf)->qf_table,
-            qf_table_size(D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits));
-        //要修改qf的qf_entries字段
-        TX_ADD_FIELD(qf,qf_entries);*/
-		TX_ADD(qf);
-        
-
-        /* Special-case filling canonical slots to simplify insert_into(). */
-        if (is_empty_element(T_fq)) {
-            //如果本位是000，说明本位是空位，设置为100直接插入本位
-            set_elem(qf, fq, set_occupied(entry));
-            ++D_RW(qf)->qf_entries;
-            goto end;
-        }
-
-        if (!is_occupied(T_fq)) {
-            //如果本位是001或011，说明该run还不存在但是本位已经被其他run侵占。
-            //先设置本位的isO，使得该商有run。
-            set_elem(qf, fq, set_occupied(T_fq));
-        }
-        //之后遵从和查询类似的方式，先找到该商的run
-        start = find_run_index(qf, fq);
-        s = start;
-
-        if (is_occupied(T_fq)) {
-            //本位的isO为1，说明在执行本次插入操作之前，该商的run已经存在了。
-            /* Move the cursor to the insert position in the fq run. */
-            //从该run的起始处开始，查询每个桶中存储的余数
-            //应该是升序存储。如果等于，说明发生了硬冲突，可以中止插入，返回
-            //如果大于，说明找到了应插入的位置
-            do {
-                uint64_t rem = get_remainder(get_elem(qf, s));
-                if (rem == fr) {
-                    goto end;
-                } else if (rem > fr) {
-                    break;
-                }
-                s = incr(qf, s);
-            } while (is_continuation(get_elem(qf, s)));
-
-            //s此时是要插入的位置
-            if (s == start) {
-                //应该插到该run的起始处。之前的起始应该后移。
-                //找到起始的elt，将其isC设为1
-                /* The old start-of-run becomes a continuation. */
-                uint64_t old_head = get_elem(qf, start);
-                set_elem(qf, start, set_continuation(old_head));
-            } else {
-                /* The new element becomes a continuation. */
-                //不需要插入起始处，设置要插入的isC为1即可
-                entry = set_continuation(entry);
-            }
-        }
-
-        /* Set the shifted bit if we can't use the canonical slot. */
-        //设置isS,插入
-        if (s != fq) {
-            entry = set_shifted(entry);
-        }
-
-        insert_into(qf, s, entry);
-        ++D_RW(qf)->qf_entries;
-        //pmemobj_tx_process();
-		end:
-		uint8_t tee=1;
+//选择CPU支持的最快实现
+__attribute__((constructor))
+static void qf_detect_kernels(void)
+{
+#ifdef QF_HAVE_BMI2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("bmi2")) {
+		qf_kernel_set = QF_KERNELS_BMI2;
+	}
+#endif
+}
 
-    }TX_END;
+bool qf_set_kernels(int kernels)
+{
+	if (kernels == QF_KERNELS_SCALAR) {
+		qf_kernel_set = kernels;
+		return true;
+	}
+#ifdef QF_HAVE_BMI2
+	if (kernels == QF_KERNELS_BMI2 && __builtin_cpu_supports("bmi2")) {
+		qf_kernel_set = kernels;
+		return true;
+	}
+#endif
+	return false;
+}
 
-    return true;
+int qf_kernels(void)
+{
+	return qf_kernel_set;
 }
 
-//不需写入
-bool qf_may_contain(TOID(struct quotient_filter) qf, uint64_t hash)
+bool qf_counters_thread(struct qf_counters *c)
 {
-	//得到hash的商和余数
-	uint64_t fq = hash_to_quotient(qf, hash);
-	uint64_t fr = hash_to_remainder(qf, hash);
+#ifdef QF_INSTRUMENT
+	*c = *counters_mine();
+	return true;
+#else
+	memset(c, 0, sizeof(*c));
+	return false;
+#endif
+}
 
-	//根据商得到本位中存储的数据
-	uint64_t T_fq = get_elem(qf, fq);
+bool qf_counters_total(struct qf_counters *c)
+{
+	memset(c, 0, sizeof(*c));
+#ifdef QF_INSTRUMENT
+	//每个字段都是uint64_t，逐个字段相加
+	const size_t n = sizeof(*c) / sizeof(uint64_t);
+	uint64_t *sum = (uint64_t *)c;
+	struct qf_counter_block *b = __atomic_load_n(&qf_counter_list, __ATOMIC_ACQUIRE);
+	for (; b != NULL; b = b->cb_next) {
+		const uint64_t *f = (const uint64_t *)&b->cb_c;
+		for (size_t i = 0; i < n; ++i) {
+			sum[i] += __atomic_load_n(&f[i], __ATOMIC_RELAXED);
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
 
-	/* If this quotient has no run, give up. */
-	if (!is_occupied(T_fq)) {
-		//如果isO为0，说明该商的run不存在，元素也一定不存在
-		return false;
+void qf_counters_reset(void)
+{
+#ifdef QF_INSTRUMENT
+	struct qf_counters *c = counters_mine();
+	const size_t n = sizeof(*c) / sizeof(uint64_t);
+	for (size_t i = 0; i < n; ++i) {
+		__atomic_store_n(&((uint64_t *)c)[i], 0, __ATOMIC_RELAXED);
 	}
+#endif
+}
 
-	/* Scan the sorted run for the target remainder. */
-	//否则run存在，定位这个商的run的起始位置
-	uint64_t s = find_run_index(qf, fq);
-	do {
-		//根据位置，先得到elt，再得到余数
-		uint64_t rem = get_remainder(get_elem(qf, s));
-		if (rem == fr) {
-			return true;//存在这个余数，可能存在
-		} else if (rem > fr) {
-			return false;//按序查找已经直接超过了，说明一定不存在
-		}
-		s = incr(qf, s);
-	} while (is_continuation(get_elem(qf, s)));//直到该run结束也未找到
-	return false;//一定不存在
+/*
+ * Return a mask with the top bit of every field whose width bits at shift
+ * equal pat. Fields are stride bits apart, lsbs marks them and only the
+ * first n count. This is the classic has-zero-byte trick, generalized to
+ * fields of any width; it is exact, not just a filter.
+ */
+static inline uint64_t swar_match(uint64_t w, uint64_t pat, uint64_t lsbs,
+		unsigned stride, unsigned shift, unsigned width, uint64_t n)
+{
+	uint64_t live = LOW_MASK(n * stride);
+	uint64_t fields = ((LOW_MASK(width) << shift) * lsbs) & live;
+	uint64_t hi = (lsbs << (shift + width - 1)) & live;
+	uint64_t lo = fields & ~hi;
+	uint64_t y = (w ^ ((pat << shift) * lsbs)) & fields;
+	uint64_t nz = (((y & lo) + lo) | y) & hi;
+	return ~nz & hi;
 }
 
-/* Remove the entry in QF[s] and slide the rest of the cluster forward. */
-//需要写入，不是根API
-static void delete_entry(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t s, uint64_t quot)
+/* Back off while spinning; give up the CPU if the wait drags on. */
+static inline void spin_pause(unsigned *spins)
 {
-	uint64_t next;
-	uint64_t curr = get_elem(qf, s);
-	uint64_t sp = incr(qf, s);
-	uint64_t orig = s;
+	if (++*spins % 64 == 0) {
+		sched_yield();
+		return;
+	}
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
 
-	/*
-	 * FIXME(vsk): This loop looks ugly. Rewrite.
-	 */
-	while (true) {
-		next = get_elem(qf, sp);
-		bool curr_occupied = is_occupied(curr);
+/* Most regions a qf_sync lookup validates one by one, see seq_reader. */
+#define SEQ_READ_REGIONS 8
 
-		if (is_empty_element(next) || is_cluster_start(next) || sp == orig) {
-			set_elem(qf, s, 0);
-			return;
-		} else {
-			/* Fix entries which slide into canonical slots. */
-			uint64_t updated_next = next;
-			if (is_run_start(next)) {
-				do {
-					quot = incr(qf, quot);
-				} while (!is_occupied(get_elem(qf, quot)));
+/*
+ * Optimistic read state of one qf_sync lookup. The first time the lookup
+ * touches a region, the region's sequence number is recorded; the lookup
+ * stands if none of them moved by the end. A lookup that touches more
+ * than SEQ_READ_REGIONS regions is retried against qs_begun instead,
+ * which every update moves.
+ *
+ * A lookup racing with a writer may see a torn cluster and walk in
+ * circles, so it also gets a budget of windows. Once the read has failed
+ * every window reads as zero, which ends all the scanning loops.
+ */
+struct seq_reader {
+	const struct qf_sync *sr_sync;
+	uint64_t sr_region[SEQ_READ_REGIONS];
+	uint64_t sr_seq[SEQ_READ_REGIONS];
+	unsigned sr_nregions;
+	uint64_t sr_writes;	/* qs_begun at the start, in global mode */
+	uint64_t sr_budget;	/* windows left */
+	bool sr_global;
+	bool sr_overflow;
+	bool sr_failed;
+};
 
-				if (curr_occupied && quot == s) {
-					updated_next = clr_shifted(next);
-				}
-			}
+static void seq_reader_start(struct seq_reader *rd, const struct qf_sync *s,
+		bool global)
+{
+	const struct qf_view *v = &s->qs_view;
 
-			set_elem(qf, s, curr_occupied ?
-					set_occupied(updated_next) :
-					clr_occupied(updated_next));
-			s = sp;
-			sp = incr(qf, sp);
-			curr = next;
+	rd->sr_sync = s;
+	rd->sr_nregions = 0;
+	rd->sr_budget = 3 * (v->qfv_max_size / (64 / v->qfv_elem_bits) + 2);
+	rd->sr_global = global;
+	rd->sr_overflow = false;
+	rd->sr_failed = false;
+	if (global) {
+		/* Wait for a moment when no update is in flight. */
+		unsigned spins = 0;
+		for (;;) {
+			uint64_t done = __atomic_load_n(&s->qs_done, __ATOMIC_ACQUIRE);
+			rd->sr_writes = __atomic_load_n(&s->qs_begun, __ATOMIC_ACQUIRE);
+			if (rd->sr_writes == done) {
+				break;
+			}
+			spin_pause(&spins);
 		}
 	}
 }
 
-//需要写入，是根API
-bool qf_remove(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash)
+/* Account for a window at slot idx. Returns false once the read has failed. */
+static bool seq_reader_enter(struct seq_reader *rd, uint64_t idx)
 {
-	uint64_t highbits = hash >> (D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits);
-	if (highbits) {
+	if (rd->sr_failed) {
 		return false;
 	}
-
-	uint64_t fq = hash_to_quotient(qf, hash);
-	uint64_t fr = hash_to_remainder(qf, hash);
-	uint64_t T_fq = get_elem(qf, fq);
-
-	if (!is_occupied(T_fq) || !D_RO(qf)->qf_entries) {
+	if (rd->sr_budget-- == 0) {
+		rd->sr_failed = true;
+		return false;
+	}
+	if (rd->sr_global) {
 		return true;
 	}
 
-	uint64_t start = find_run_index(qf, fq);
-	uint64_t s = start;
-	uint64_t rem;
-
-	/* Find the offending table index (or give up). */
-	do {
-		rem = get_remainder(get_elem(qf, s));
-		if (rem == fr) {
-			break;
-		} else if (rem > fr) {
+	uint64_t region = idx >> QF_SYNC_REGION_SHIFT;
+	for (unsigned i = 0; i < rd->sr_nregions; ++i) {
+		if (rd->sr_region[i] == region) {
 			return true;
 		}
-		s = incr(qf, s);
-	} while (is_continuation(get_elem(qf, s)));
-	if (rem != fr) {
-		return true;
+	}
+	if (rd->sr_nregions == SEQ_READ_REGIONS) {
+		rd->sr_overflow = true;
+		rd->sr_failed = true;
+		return false;
 	}
 
-	uint64_t kill = (s == fq) ? T_fq : get_elem(qf, s);
-	bool replace_run_start = is_run_start(kill);
-
-    bool ret;
-
-    TX_BEGIN(pop) {
-        //要修改qf_table中的内容
-		/*pmemobj_tx_add_range_direct(D_RO(qf)->qf_table,
-            qf_table_size(D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits));
-        //要修改qf的qf_entries字段
-        TX_ADD_FIELD(qf,qf_entries);*/
-		TX_ADD(qf);
-        
-
-        /* If we're deleting the last entry in a run, clear `is_occupied'. */
-        if (is_run_start(kill)) {
-            uint64_t next = get_elem(qf, incr(qf, s));
-            if (!is_continuation(next)) {
-                T_fq = clr_occupied(T_fq);
-                set_elem(qf, fq, T_fq);
-            }
-        }
-
-        delete_entry(pop,qf, s, fq);
-
-        if (replace_run_start) {
-            uint64_t next = get_elem(qf, s);
-            uint64_t updated_next = next;
-            if (is_continuation(next)) {
-                /* The new start-of-run is no longer a continuation. */
-                updated_next = clr_continuation(next);
-            }
-            if (s == fq && is_run_start(updated_next)) {
-                /* The new start-of-run is in the canonical slot. */
-                updated_next = clr_shifted(updated_next);
-            }
-            if (updated_next != next) {
-                set_elem(qf, s, updated_next);
-            }
-        }
-
-        --D_RW(qf)->qf_entries;
-
-    }TX_END;
-
-    return true;
+	uint64_t seq = __atomic_load_n(&rd->sr_sync->qs_seqs[region], __ATOMIC_ACQUIRE);
+	if (seq & 1) {
+		/* A writer is in this region. */
+		rd->sr_failed = true;
+		return false;
+	}
+	rd->sr_region[rd->sr_nregions] = region;
+	rd->sr_seq[rd->sr_nregions] = seq;
+	++rd->sr_nregions;
+	return true;
+}
+
+/* Returns true if nothing the lookup read was written to meanwhile. */
+static bool seq_reader_valid(const struct seq_reader *rd)
+{
+	if (rd->sr_failed) {
+		return false;
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (rd->sr_global) {
+		return __atomic_load_n(&rd->sr_sync->qs_begun, __ATOMIC_RELAXED) ==
+				rd->sr_writes;
+	}
+	for (unsigned i = 0; i < rd->sr_nregions; ++i) {
+		uint64_t *seq = &rd->sr_sync->qs_seqs[rd->sr_region[i]];
+		if (__atomic_load_n(seq, __ATOMIC_RELAXED) != rd->sr_seq[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Read up to n slots starting at idx as one window. The window stops at a
+ * word's worth of slots and at the end of the table; *k receives the
+ * number of slots in it.
+ *
+ * If rd is not NULL the read is part of a qf_sync lookup: the window also
+ * stops at the end of a region, and it is all zero if the read failed.
+ */
+//不需写入
+static inline uint64_t load_window(const struct qf_view *v,
+		struct seq_reader *rd, uint64_t idx, uint64_t n, uint64_t *k)
+{
+	uint64_t bits = v->qfv_elem_bits;
+	uint64_t max = 64 / bits;
+	max = (max < v->qfv_max_size - idx) ? max : v->qfv_max_size - idx;
+
+	uint64_t bitpos = idx * bits;
+	uint64_t tabpos = bitpos / 64;
+	uint64_t slotpos = bitpos % 64;
+	uint64_t w;
+
+	if (rd) {
+		uint64_t left = QF_SYNC_REGION_SLOTS - (idx & (QF_SYNC_REGION_SLOTS - 1));
+		max = (max < left) ? max : left;
+		*k = (n < max) ? n : max;
+		if (!seq_reader_enter(rd, idx)) {
+			return 0;
+		}
+		w = __atomic_load_n(&v->qfv_table[tabpos], __ATOMIC_RELAXED) >> slotpos;
+		if (slotpos && slotpos + *k * bits > 64) {
+			w |= __atomic_load_n(&v->qfv_table[tabpos + 1], __ATOMIC_RELAXED) <<
+					(64 - slotpos);
+		}
+		QF_COUNT(qc_lines, 1 + (slotpos + *k * bits > 64 && tabpos % 8 == 7));
+		return w & LOW_MASK(*k * bits);
+	}
+
+	*k = (n < max) ? n : max;
+	w = v->qfv_table[tabpos] >> slotpos;
+	if (slotpos && slotpos + *k * bits > 64) {
+		w |= v->qfv_table[tabpos + 1] << (64 - slotpos);
+	}
+	QF_COUNT(qc_lines, 1 + (slotpos + *k * bits > 64 && tabpos % 8 == 7));
+	return w & LOW_MASK(*k * bits);
+}
+
+/* Return the first non-empty slot at or after idx. The QF must not be empty. */
+//不需写入
+static uint64_t next_nonempty(const struct qf_view *v, uint64_t idx)
+{
+	for (;;) {
+		uint64_t k;
+		uint64_t w = load_window(v, NULL, idx, v->qfv_max_size, &k);
+		uint64_t used = (w | (w >> 1) | (w >> 2)) & v->qfv_lsbs & LOW_MASK(k * v->qfv_elem_bits);
+		if (used) {
+			return idx + __builtin_ctzll(used) / v->qfv_elem_bits;
+		}
+		idx = (idx + k) & v->qfv_index_mask;
+	}
+}
+
+//定位一个商所属的run的实际位置
+/* Find the start index of the run for fq (given that the run exists). */
+//不需写入
+static uint64_t find_run_index(const struct qf_view *v,
+		struct seq_reader *rd, uint64_t fq)
+{
+	uint64_t bits = v->qfv_elem_bits;
+	uint64_t per = 64 / bits;
+	uint64_t k, w;
+
+	/* Find the start of the cluster. */
+	//从本位开始向左扫描到cluster的开始，即最后一个isS为0的槽
+	uint64_t b = fq;
+	for (;;) {
+		//窗口不跨越64槽的边界，因此也不跨越qf_sync的区域
+		uint64_t lo = (b + 1 >= per) ? b + 1 - per : 0;
+		lo = MAX(lo, b & ~(uint64_t)(QF_BLOCK_SLOTS - 1));
+		w = load_window(v, rd, lo, b - lo + 1, &k);
+		uint64_t unshifted = ~w & (v->qfv_lsbs << 2) & LOW_MASK(k * bits);
+		if (unshifted) {
+			b = lo + (63 - __builtin_clzll(unshifted)) / bits;
+			break;
+		}
+		b = decr(v, lo);
+	}
+
+	/* Find the start of the run for fq. */
+	//有几个occupied，就说明有几种不同的商q的指纹被插入，那就是有多少个run
+	//(b, fq]中每个isO为1的槽对应一个run，fq的run是其后第runs个isC为0的槽
+	uint64_t runs = 0;
+	uint64_t n = (fq - b) & v->qfv_index_mask;
+	uint64_t idx = incr(v, b);
+	while (n) {
+		w = load_window(v, rd, idx, n, &k);
+		runs += __builtin_popcountll(w & v->qfv_lsbs);
+		n -= k;
+		idx = (idx + k) & v->qfv_index_mask;
+	}
+
+	idx = b;
+	while (runs) {
+		idx = incr(v, idx);
+		w = load_window(v, rd, idx, per, &k);
+		uint64_t starts = ~w & (v->qfv_lsbs << 1) & LOW_MASK(k * bits);
+		uint64_t c = __builtin_popcountll(starts);
+		if (runs <= c) {
+			idx += bit_select(starts, runs - 1) / bits;
+			break;
+		}
+		runs -= c;
+		idx += k - 1;
+	}//向右扫描到商所属run的开始
+	QF_COUNT(qc_walk_slots, ((fq - b) & v->qfv_index_mask) +
+			((idx - b) & v->qfv_index_mask));
+	return idx;
+}
+
+/* Insert elt into QF[s], shifting over elements as necessary. */
+//需要写入，不是根API
+static void insert_into(const struct qf_view *v, uint64_t s, uint64_t elt)
+{
+	uint64_t prev;
+	uint64_t curr = elt;
+	bool empty;
+	uint64_t moved = 0;
+
+	//在s处插入elt，然后把原有的数据挤到下一个桶中，直到挤到一个空桶里
+	//使用O(1)的空间来存储temp数据，
+	do {
+		prev = get_elem(v, s);//prev是当前s处的元素
+		empty = is_empty_element(prev);//prev是否是000的空位
+		if (!empty) {
+			/* Fix up `is_shifted' and `is_occupied'. */
+			prev = set_shifted(prev);//要移位了
+			if (is_occupied(prev)) {//isO和桶对应，而不和桶中存储的余数对应
+				curr = set_occupied(curr);
+				prev = clr_occupied(prev);
+			}
+		}
+		set_elem(v, s, curr);
+		curr = prev;
+		s = incr(v, s);
+		moved += !empty;
+	} while (!empty);
+	QF_COUNT(qc_shift_slots, moved);
+}
+
+/* Remove the entry in QF[s] and slide the rest of the cluster forward. */
+//需要写入，不是根API
+static void delete_entry(const struct qf_view *v, uint64_t s, uint64_t quot)
+{
+	uint64_t next;
+	uint64_t curr = get_elem(v, s);
+	uint64_t sp = incr(v, s);
+	uint64_t orig = s;
+
+	/*
+	 * FIXME(vsk): This loop looks ugly. Rewrite.
+	 */
+	while (true) {
+		next = get_elem(v, sp);
+		bool curr_occupied = is_occupied(curr);
+
+		if (is_empty_element(next) || is_cluster_start(next) || sp == orig) {
+			set_elem(v, s, 0);
+			return;
+		} else {
+			/* Fix entries which slide into canonical slots. */
+			uint64_t updated_next = next;
+			if (is_run_start(next)) {
+				do {
+					quot = incr(v, quot);
+				} while (!is_occupied(get_elem(v, quot)));
+
+				if (curr_occupied && quot == s) {
+					updated_next = clr_shifted(next);
+				}
+			}
+
+			set_elem(v, s, curr_occupied ?
+					set_occupied(updated_next) :
+					clr_occupied(updated_next));
+			s = sp;
+			sp = incr(v, sp);
+			curr = next;
+		}
+	}
+}
+
+/*
+ * Return the first empty slot at or after idx. If the QF is full, return
+ * the slot before idx so that [idx, result] covers the whole table.
+ */
+//不需写入
+static uint64_t find_empty_slot(const struct qf_view *v, uint64_t idx)
+{
+	uint64_t s = idx;
+	while (!is_empty_element(get_elem(v, s))) {
+		s = incr(v, s);
+		if (s == idx) {
+			return decr(v, idx);
+		}
+	}
+	return s;
+}
+
+/*
+ * The storage policy of a view: n table words starting at w are about to
+ * be rewritten. A pmem table adds them to the undo log of the open
+ * transaction; a DRAM table is written in place with nothing to undo.
+ */
+//需要写入，不是根API
+static void log_words(const struct qf_view *v, uint64_t *w, uint64_t n)
+{
+	if (v->qfv_backend != QF_BACKEND_PMEM) {
+		return;
+	}
+	pmemobj_tx_add_range_direct(w, n * sizeof(uint64_t));
+	QF_COUNT(qc_tx_bytes, n * sizeof(uint64_t));
+	QF_COUNT(qc_lines, (uintptr_t)(w + n - 1) / 64 - (uintptr_t)w / 64 + 1);
+}
+
+/*
+ * Add the table words holding slots [lo, hi] to the undo log of the open
+ * transaction (see log_words()). The range wraps around the end of the table if hi < lo.
+ *
+ * Inserts and deletes only ever rewrite the slots between the canonical
+ * slot and the end of its cluster, so this costs a few words per update
+ * instead of a snapshot of the whole table.
+ */
+//需要写入，不是根API
+static void snapshot_slots(const struct qf_view *v, uint64_t lo, uint64_t hi)
+{
+	if (hi < lo) {
+		snapshot_slots(v, lo, v->qfv_max_size - 1);
+		lo = 0;
+	}
+
+	uint64_t bits = v->qfv_elem_bits;
+	uint64_t first = (lo * bits) / 64;
+	uint64_t last = (hi * bits + bits - 1) / 64;
+	log_words(v, &v->qfv_table[first], last - first + 1);
+}
+
+/*
+ * Remove slot s from the run of quotient fq, clearing the occupied bit of
+ * fq if the run is left empty. Snapshots what it rewrites.
+ */
+//需要写入，不是根API
+static void delete_slot(const struct qf_view *v, uint64_t fq, uint64_t s)
+{
+	uint64_t T_fq = get_elem(v, fq);
+	uint64_t kill = get_elem(v, s);
+	bool replace_run_start = is_run_start(kill);
+
+	//本位（可能清除isO）到cluster结束之间的槽都可能被改写
+	snapshot_slots(v, fq, find_empty_slot(v, s));
+
+	/* If we're deleting the last entry in a run, clear `is_occupied'. */
+	if (is_run_start(kill)) {
+		uint64_t next = get_elem(v, incr(v, s));
+		if (!is_continuation(next)) {
+			T_fq = clr_occupied(T_fq);
+			set_elem(v, fq, T_fq);
+		}
+	}
+
+	delete_entry(v, s, fq);
+
+	if (replace_run_start) {
+		uint64_t next = get_elem(v, s);
+		uint64_t updated_next = next;
+		if (is_continuation(next)) {
+			/* The new start-of-run is no longer a continuation. */
+			updated_next = clr_continuation(next);
+		}
+		if (s == fq && is_run_start(updated_next)) {
+			/* The new start-of-run is in the canonical slot. */
+			updated_next = clr_shifted(updated_next);
+		}
+		if (updated_next != next) {
+			set_elem(v, s, updated_next);
+		}
+	}
+}
+
+/*
+ * Blocked table format (rank/select quotient filter).
+ *
+ * Slots are grouped into blocks of QF_BLOCK_SLOTS. Every block is laid out
+ * as BLK_REMAINDERS + r words: the offset word, the occupieds and runends
+ * bitvectors, then 64 packed r-bit remainders. Bit i of occupieds says
+ * quotient i has a run, bit i of runends says slot i ends a run. Runs are
+ * stored in quotient order, each run sorted, exactly as in the classic
+ * format, but instead of walking is_shifted/is_continuation bits slot by
+ * slot, the end of a run is found with a popcount over occupieds and a
+ * select over runends, which touches one or two blocks.
+ *
+ * The offset word of block b is the number of slots at the start of the
+ * block used by runs of quotients below 64*b, so a lookup never has to look
+ * at earlier blocks. Runs do not wrap: they spill into the extra blocks
+ * past the last quotient (see blocked_nblocks()).
+ */
+
+static inline uint64_t *blk_block(const struct qf_view *v, uint64_t b)
+{
+	return v->qfv_table + b * v->qfv_block_words;
+}
+
+static inline uint64_t blk_word(const struct qf_view *v, int word, uint64_t idx)
+{
+	return blk_block(v, idx / QF_BLOCK_SLOTS)[word];
+}
+
+static inline bool blk_bit(const struct qf_view *v, int word, uint64_t idx)
+{
+	return (blk_word(v, word, idx) >> (idx % QF_BLOCK_SLOTS)) & 1;
+}
+
+static inline void blk_put_bit(const struct qf_view *v, int word, uint64_t idx,
+		bool bit)
+{
+	uint64_t *w = &blk_block(v, idx / QF_BLOCK_SLOTS)[word];
+	uint64_t m = 1ULL << (idx % QF_BLOCK_SLOTS);
+	*w = bit ? (*w | m) : (*w & ~m);
+}
+
+/* Return the remainder stored in slot idx. */
+static uint64_t blk_get_rem(const struct qf_view *v, uint64_t idx)
+{
+	const uint64_t *rems = blk_block(v, idx / QF_BLOCK_SLOTS) + BLK_REMAINDERS;
+	uint64_t bitpos = (idx % QF_BLOCK_SLOTS) * v->qfv_rbits;
+	uint64_t tabpos = bitpos / 64;
+	uint64_t slotpos = bitpos % 64;
+
+	uint64_t rem = rems[tabpos] >> slotpos;
+	if (slotpos + v->qfv_rbits > 64) {
+		rem |= rems[tabpos + 1] << (64 - slotpos);
+	}
+	return rem & v->qfv_rmask;
+}
+
+/* Store rem into slot idx. */
+static void blk_set_rem(const struct qf_view *v, uint64_t idx, uint64_t rem)
+{
+	uint64_t *rems = blk_block(v, idx / QF_BLOCK_SLOTS) + BLK_REMAINDERS;
+	uint64_t bitpos = (idx % QF_BLOCK_SLOTS) * v->qfv_rbits;
+	uint64_t tabpos = bitpos / 64;
+	uint64_t slotpos = bitpos % 64;
+
+	rem &= v->qfv_rmask;
+	rems[tabpos] &= ~(v->qfv_rmask << slotpos);
+	rems[tabpos] |= rem << slotpos;
+	if (slotpos + v->qfv_rbits > 64) {
+		uint64_t spill = 64 - slotpos;
+		rems[tabpos + 1] &= ~(v->qfv_rmask >> spill);
+		rems[tabpos + 1] |= rem >> spill;
+	}
+}
+
+/* Return the first slot >= idx whose bit is set in word, or qfv_nslots. */
+static uint64_t blk_next_bit(const struct qf_view *v, int word, uint64_t idx)
+{
+	while (idx < v->qfv_nslots) {
+		uint64_t w = blk_word(v, word, idx) & ~LOW_MASK(idx % QF_BLOCK_SLOTS);
+		if (w) {
+			return (idx & ~(uint64_t)(QF_BLOCK_SLOTS - 1)) + __builtin_ctzll(w);
+		}
+		idx = (idx | (QF_BLOCK_SLOTS - 1)) + 1;
+	}
+	return v->qfv_nslots;
+}
+
+/*
+ * Return the first slot at or after idx that is not used by the runs of
+ * quotients <= idx. For an occupied quotient that is one past the end of
+ * its run; for an unoccupied one it is where its run would start. Slot
+ * idx is empty iff the result is idx itself.
+ */
+//不需写入
+static uint64_t blk_run_limit(const struct qf_view *v, uint64_t idx)
+{
+	const uint64_t *blk = blk_block(v, idx / QF_BLOCK_SLOTS);
+	uint64_t start = idx - idx % QF_BLOCK_SLOTS + blk[BLK_OFFSET];
+	unsigned rank = __builtin_popcountll(blk[BLK_OCCUPIEDS] &
+			LOW_MASK(idx % QF_BLOCK_SLOTS + 1));
+
+	if (rank == 0) {
+		return MAX(idx, start);
+	}
+
+	/* The rank-th runend from start closes the run of idx (or of the last
+	 * occupied quotient before it within this block). */
+	unsigned k = rank - 1;
+	uint64_t pos = start;
+	while (pos < v->qfv_nslots) {
+		uint64_t w = blk_word(v, BLK_RUNENDS, pos) &
+				~LOW_MASK(pos % QF_BLOCK_SLOTS);
+		unsigned c = __builtin_popcountll(w);
+		if (k < c) {
+			pos = pos - pos % QF_BLOCK_SLOTS + bit_select(w, k);
+			return MAX(idx, pos + 1);
+		}
+		k -= c;
+		pos = pos - pos % QF_BLOCK_SLOTS + QF_BLOCK_SLOTS;
+	}
+	return v->qfv_nslots;
+}
+
+/* Return the first empty slot at or after idx, or qfv_nslots if none. */
+//不需写入
+static uint64_t blk_find_empty(const struct qf_view *v, uint64_t idx)
+{
+	while (idx < v->qfv_nslots) {
+		uint64_t limit = blk_run_limit(v, idx);
+		if (limit == idx) {
+			return idx;
+		}
+		idx = limit;
+	}
+	return v->qfv_nslots;
+}
+
+/* Return the first slot of the run that ends at end and belongs to fq. */
+//不需写入
+static uint64_t blk_run_start(const struct qf_view *v, uint64_t fq, uint64_t end)
+{
+	/* The run starts after the previous runend, but never before fq. */
+	uint64_t pos = end;
+	while (pos > fq) {
+		uint64_t last = pos - 1;
+		uint64_t w = blk_word(v, BLK_RUNENDS, last) &
+				LOW_MASK(last % QF_BLOCK_SLOTS + 1);
+		if (w) {
+			uint64_t s = last - last % QF_BLOCK_SLOTS + 64 - __builtin_clzll(w);
+			return MAX(fq, s);
+		}
+		pos = last - last % QF_BLOCK_SLOTS;
+	}
+	return fq;
+}
+
+/*
+ * Read up to n remainders starting at slot idx as one window (see
+ * load_window()). The window never crosses a block.
+ */
+//不需写入
+static inline uint64_t blk_rem_window(const struct qf_view *v, uint64_t idx,
+		uint64_t n, uint64_t *k)
+{
+	uint64_t bits = v->qfv_rbits;
+	uint64_t max = 64 / bits;
+	uint64_t left = QF_BLOCK_SLOTS - idx % QF_BLOCK_SLOTS;
+	max = (max < left) ? max : left;
+	*k = (n < max) ? n : max;
+
+	const uint64_t *rems = blk_block(v, idx / QF_BLOCK_SLOTS) + BLK_REMAINDERS;
+	uint64_t bitpos = (idx % QF_BLOCK_SLOTS) * bits;
+	uint64_t tabpos = bitpos / 64;
+	uint64_t slotpos = bitpos % 64;
+	uint64_t w = rems[tabpos] >> slotpos;
+	if (slotpos && slotpos + *k * bits > 64) {
+		w |= rems[tabpos + 1] << (64 - slotpos);
+	}
+	return w & LOW_MASK(*k * bits);
+}
+
+/*
+ * Recompute the offset words of blocks lo..hi, in order, after the runs
+ * crossing their boundaries changed.
+ */
+//需要写入，不是根API
+static void blk_fix_offsets(const struct qf_view *v, uint64_t lo, uint64_t hi)
+{
+	for (uint64_t b = MAX(lo, 1); b <= hi && b < v->qfv_nslots / QF_BLOCK_SLOTS; ++b) {
+		uint64_t first = b * QF_BLOCK_SLOTS;
+		uint64_t limit = blk_run_limit(v, first - 1);
+		blk_block(v, b)[BLK_OFFSET] = (limit > first) ? limit - first : 0;
+	}
+}
+
+/* Add blocks lo..hi to the undo log of the open transaction. */
+//需要写入，不是根API
+static void blk_snapshot(const struct qf_view *v, uint64_t lo, uint64_t hi)
+{
+	uint64_t nblocks = v->qfv_nslots / QF_BLOCK_SLOTS;
+	hi = (hi < nblocks) ? hi : nblocks - 1;
+	log_words(v, blk_block(v, lo), (hi - lo + 1) * v->qfv_block_words);
+}
+
+/*
+ * Look up hash in a blocked QF, finding its run through the metadata of
+ * mv and comparing remainders in v. The two are the same view except
+ * behind a struct qf_tier.
+ */
+//不需写入
+static bool blk_lookup(const struct qf_view *mv, const struct qf_view *v,
+		uint64_t hash)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+
+	QF_COUNT(qc_lookups, 1);
+	QF_COUNT(qc_lines, 1);
+	if (!blk_bit(mv, BLK_OCCUPIEDS, fq)) {
+		return false;
+	}
+
+	/* Compare the run a window at a time. */
+	uint64_t end = blk_run_limit(mv, fq) - 1;
+	uint64_t s = blk_run_start(mv, fq, end);
+	while (s <= end) {
+		uint64_t k;
+		uint64_t w = blk_rem_window(v, s, end - s + 1, &k);
+		QF_COUNT(qc_scan_slots, k);
+		QF_COUNT(qc_lines, 1);
+		if (swar_match(w, fr, v->qfv_lsbs, v->qfv_rbits, 0, v->qfv_rbits, k)) {
+			return true;
+		}
+		if (blk_get_rem(v, s + k - 1) > fr) {
+			/* The run is sorted. */
+			return false;
+		}
+		s += k;
+	}
+	return false;
+}
+
+//不需写入
+static bool blk_may_contain(const struct qf_view *v, uint64_t hash)
+{
+	return blk_lookup(v, v, hash);
+}
+
+/*
+ * Insert the fingerprint of hash into a blocked QF. Must be called inside
+ * an open transaction.
+ *
+ * Returns 1 if it was added, 0 if it was already there and -1 if the run
+ * would have to spill past the last block.
+ */
+//需要写入，不是根API
+static int blk_insert(const struct qf_view *v, uint64_t hash)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	bool new_run = !blk_bit(v, BLK_OCCUPIEDS, fq);
+	uint64_t limit = blk_run_limit(v, fq);
+	uint64_t p = limit;
+
+	if (!new_run) {
+		/* Find the insert position in the sorted run. */
+		for (p = blk_run_start(v, fq, limit - 1); p < limit; ++p) {
+			uint64_t rem = blk_get_rem(v, p);
+			if (rem == fr) {
+				return 0;
+			} else if (rem > fr) {
+				break;
+			}
+		}
+	}
+
+	uint64_t e = blk_find_empty(v, p);
+	if (e >= v->qfv_nslots) {
+		return -1;
+	}
+
+	blk_snapshot(v, fq / QF_BLOCK_SLOTS, e / QF_BLOCK_SLOTS);
+	QF_COUNT(qc_shift_slots, e - p);
+
+	/* Shift [p, e) one slot to the right, runend bits included. */
+	for (uint64_t s = e; s > p; --s) {
+		blk_set_rem(v, s, blk_get_rem(v, s - 1));
+		blk_put_bit(v, BLK_RUNENDS, s, blk_bit(v, BLK_RUNENDS, s - 1));
+	}
+	blk_set_rem(v, p, fr);
+
+	if (new_run) {
+		blk_put_bit(v, BLK_OCCUPIEDS, fq, true);
+		blk_put_bit(v, BLK_RUNENDS, p, true);
+	} else if (p == limit) {
+		/* Appended to the run: the end moves over by one. */
+		blk_put_bit(v, BLK_RUNENDS, p - 1, false);
+		blk_put_bit(v, BLK_RUNENDS, p, true);
+	} else {
+		blk_put_bit(v, BLK_RUNENDS, p, false);
+	}
+
+	blk_fix_offsets(v, fq / QF_BLOCK_SLOTS + 1, e / QF_BLOCK_SLOTS);
+	return 1;
+}
+
+/*
+ * Remove the fingerprint of hash from a blocked QF. Must be called inside
+ * an open transaction.
+ *
+ * Returns true if it was found and removed.
+ */
+//需要写入，不是根API
+static bool blk_remove(const struct qf_view *v, uint64_t hash)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+
+	if (!blk_bit(v, BLK_OCCUPIEDS, fq)) {
+		return false;
+	}
+
+	uint64_t end = blk_run_limit(v, fq) - 1;
+	uint64_t start = blk_run_start(v, fq, end);
+	uint64_t p;
+	for (p = start; p <= end; ++p) {
+		uint64_t rem = blk_get_rem(v, p);
+		if (rem == fr) {
+			break;
+		} else if (rem > fr) {
+			return false;
+		}
+	}
+	if (p > end) {
+		return false;
+	}
+
+	/*
+	 * Later runs slide back by one slot until one already starts at its
+	 * own quotient or an empty slot is reached; t is where that happens.
+	 */
+	uint64_t quot = fq;
+	uint64_t t = end + 1;
+	while (t < v->qfv_nslots) {
+		uint64_t next = blk_next_bit(v, BLK_OCCUPIEDS, quot + 1);
+		if (next >= t) {
+			break;
+		}
+		quot = next;
+		t = blk_next_bit(v, BLK_RUNENDS, t) + 1;
+	}
+
+	blk_snapshot(v, fq / QF_BLOCK_SLOTS, (t - 1) / QF_BLOCK_SLOTS);
+
+	if (start == end) {
+		/* The run is gone. */
+		blk_put_bit(v, BLK_OCCUPIEDS, fq, false);
+	} else if (p == end) {
+		blk_put_bit(v, BLK_RUNENDS, p - 1, true);
+	}
+
+	/* Shift (p, t) one slot to the left and clear the slot freed at t-1. */
+	for (uint64_t s = p; s + 1 < t; ++s) {
+		blk_set_rem(v, s, blk_get_rem(v, s + 1));
+		blk_put_bit(v, BLK_RUNENDS, s, blk_bit(v, BLK_RUNENDS, s + 1));
+	}
+	blk_set_rem(v, t - 1, 0);
+	blk_put_bit(v, BLK_RUNENDS, t - 1, false);
+
+	blk_fix_offsets(v, fq / QF_BLOCK_SLOTS + 1, (t - 1) / QF_BLOCK_SLOTS);
+	return true;
+}
+
+/*
+ * Insert the fingerprint of hash into the table of a QF that is not full.
+ * Must be called inside an open transaction; qf_entries is left to the
+ * caller.
+ *
+ * Returns 1 if it was added, 0 if it was already there and -1 if there
+ * was no room for it.
+ */
+//需要写入，不是根API
+static int insert_fp(const struct qf_view *v, uint64_t hash)
+{
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		return blk_insert(v, hash);
+	}
+
+	//根据hash得到商和余数，根据商得到本位elt，并将余数和000结合准备插入
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	uint64_t T_fq = get_elem(v, fq);
+	uint64_t entry = (fr << 3) & ~7;
+
+	/* Special-case filling canonical slots to simplify insert_into(). */
+	if (is_empty_element(T_fq)) {
+		//如果本位是000，说明本位是空位，设置为100直接插入本位
+		snapshot_slots(v, fq, fq);
+		set_elem(v, fq, set_occupied(entry));
+		return 1;
+	}
+
+	if (!is_occupied(T_fq)) {
+		//如果本位是001或011，说明该run还不存在但是本位已经被其他run侵占。
+		//先设置本位的isO，使得该商有run。
+		//从本位到cluster之后的第一个空位都可能被改写
+		snapshot_slots(v, fq, find_empty_slot(v, fq));
+		set_elem(v, fq, set_occupied(T_fq));
+	}
+	//之后遵从和查询类似的方式，先找到该商的run
+	uint64_t start = find_run_index(v, NULL, fq);
+	uint64_t s = start;
+
+	if (is_occupied(T_fq)) {
+		//本位的isO为1，说明在执行本次插入操作之前，该商的run已经存在了。
+		/* Move the cursor to the insert position in the fq run. */
+		//从该run的起始处开始，查询每个桶中存储的余数
+		//应该是升序存储。如果等于，说明发生了硬冲突，可以中止插入，返回
+		//如果大于，说明找到了应插入的位置
+		do {
+			uint64_t rem = get_remainder(get_elem(v, s));
+			if (rem == fr) {
+				return 0;
+			} else if (rem > fr) {
+				break;
+			}
+			s = incr(v, s);
+		} while (is_continuation(get_elem(v, s)));
+
+		//run的起始处到第一个空位都可能被改写
+		snapshot_slots(v, start, find_empty_slot(v, s));
+
+		//s此时是要插入的位置
+		if (s == start) {
+			//应该插到该run的起始处。之前的起始应该后移。
+			//找到起始的elt，将其isC设为1
+			/* The old start-of-run becomes a continuation. */
+			uint64_t old_head = get_elem(v, start);
+			set_elem(v, start, set_continuation(old_head));
+		} else {
+			/* The new element becomes a continuation. */
+			//不需要插入起始处，设置要插入的isC为1即可
+			entry = set_continuation(entry);
+		}
+	}
+
+	/* Set the shifted bit if we can't use the canonical slot. */
+	//设置isS,插入
+	if (s != fq) {
+		entry = set_shifted(entry);
+	}
+
+	insert_into(v, s, entry);
+	return 1;
+}
+
+/*
+ * Counting mode (see qf_init_counting()). A fingerprint that occurs more
+ * than once keeps its remainder x once and a counter right after it, in
+ * slots of its own run, so a run reads as one group of slots per distinct
+ * remainder in ascending order of x:
+ *
+ *	count 1:	x
+ *	count c > 1:	x [0] d ... d x		(x > 0)
+ *			0 0 d ... d 0		(x == 0)
+ *
+ * The digits d spell c - 2 most significant first, without leading zero
+ * digits, so a count of 2 has none. A digit never takes the value 0 or x,
+ * which leaves 2^r - 2 values (2^r - 1 when x is 0, where only 0 is
+ * taken). The slot after a lone x holds a larger remainder, so a counter
+ * is told apart by a slot that is not larger: x itself, or a first digit
+ * below x. When the first digit would be above x, a 0 goes in front of
+ * it. For x == 0 the second 0 marks the counter and the first 0 after the
+ * digits ends it. Every group is found by reading forward from the start
+ * of its run, and an increment rewrites the counter in place, shifting the
+ * cluster only when the counter gains a digit.
+ *
+ * qf_entries counts slots rather than fingerprints here, so the capacity
+ * and load checks keep working as counters grow.
+ */
+
+/* Slots the largest counter takes: x, 0, 64 digits and x. */
+#define CNT_MAX_SLOTS 67
+
+static inline uint64_t cnt_base(const struct qf_view *v, uint64_t x)
+{
+	return (1ULL << v->qfv_rbits) - (x ? 2 : 1);
+}
+
+static inline uint64_t cnt_slot(const struct qf_view *v, uint64_t s, uint64_t i)
+{
+	return (s + i) & v->qfv_index_mask;
+}
+
+/* Spell count c of remainder x into out; returns the number of slots. */
+static uint64_t cnt_encode(const struct qf_view *v, uint64_t x, uint64_t c,
+		uint64_t *out)
+{
+	uint64_t digits[64];
+	uint64_t base = cnt_base(v, x);
+	uint64_t val = c - 2;
+	uint64_t k = 0;
+	uint64_t n = 0;
+
+	out[n++] = x;
+	if (c == 1) {
+		return n;
+	}
+	for (; val; val /= base) {
+		digits[k++] = val % base;
+	}
+
+	if (x == 0) {
+		out[n++] = 0;
+		while (k) {
+			out[n++] = digits[--k] + 1;
+		}
+		out[n++] = 0;
+		return n;
+	}
+
+	//数字跳过0和x；首个数字大于x时在前面加一个0
+	for (uint64_t i = 0; i < k; ++i) {
+		digits[i] += (digits[i] + 1 >= x) ? 2 : 1;
+	}
+	if (k && digits[k - 1] > x) {
+		out[n++] = 0;
+	}
+	while (k) {
+		out[n++] = digits[--k];
+	}
+	out[n++] = x;
+	return n;
+}
+
+/* Read the group starting at slot s; returns its count, its slots in *len. */
+static uint64_t cnt_decode(const struct qf_view *v, uint64_t s, uint64_t *len)
+{
+	uint64_t x = get_remainder(get_elem(v, s));
+	uint64_t p = incr(v, s);
+	uint64_t elt = get_elem(v, p);
+	uint64_t y = get_remainder(elt);
+
+	*len = 1;
+	if (!is_continuation(elt) || (x == 0 && y != 0) || (x != 0 && y > x)) {
+		return 1;
+	}
+	if (x != 0 && y == x) {
+		*len = 2;
+		return 2;
+	}
+	if (y == 0) {
+		p = incr(v, p);
+	}
+
+	uint64_t base = cnt_base(v, x);
+	uint64_t val = 0;
+	for (;;) {
+		uint64_t d = get_remainder(get_elem(v, p));
+		if (d == x) {
+			break;
+		}
+		val = val * base + d - ((x && d > x) ? 2 : 1);
+		p = incr(v, p);
+	}
+	*len = ((p - s) & v->qfv_index_mask) + 1;
+	return val + 2;
+}
+
+/*
+ * Find the group of remainder fr in the run of fq. Returns its count, or 0
+ * if it is not there; *s is then where a group for fr would go. *first
+ * says whether *s starts the run.
+ */
+static uint64_t cnt_find(const struct qf_view *v, uint64_t fq, uint64_t fr,
+		uint64_t *s, uint64_t *len, bool *first)
+{
+	*len = 0;
+	*first = true;
+	if (!is_occupied(get_elem(v, fq))) {
+		return 0;
+	}
+
+	uint64_t start = find_run_index(v, NULL, fq);
+	uint64_t p = start;
+	do {
+		uint64_t x = get_remainder(get_elem(v, p));
+		QF_COUNT(qc_scan_slots, 1);
+		if (x > fr) {
+			break;
+		}
+		uint64_t n;
+		uint64_t c = cnt_decode(v, p, &n);
+		if (x == fr) {
+			*s = p;
+			*len = n;
+			*first = (p == start);
+			return c;
+		}
+		p = cnt_slot(v, p, n);
+	} while (is_continuation(get_elem(v, p)));
+
+	*s = p;
+	*first = (p == start);
+	return 0;
+}
+
+/*
+ * Put the slots of a new group for fq at s; first says s starts the run.
+ * Slots after the first one go in right behind it as continuations.
+ */
+static void cnt_put(const struct qf_view *v, uint64_t fq, uint64_t s, bool first,
+		const uint64_t *slots, uint64_t n)
+{
+	uint64_t T_fq = get_elem(v, fq);
+
+	if (is_empty_element(T_fq)) {
+		snapshot_slots(v, fq, fq);
+		set_elem(v, fq, set_occupied(slots[0] << 3));
+		s = fq;
+	} else {
+		snapshot_slots(v, fq, find_empty_slot(v, fq));
+		uint64_t entry = slots[0] << 3;
+		if (!is_occupied(T_fq)) {
+			//和insert_fp一样，先设置isO，该商的run从这里开始
+			set_elem(v, fq, set_occupied(T_fq));
+			s = find_run_index(v, NULL, fq);
+		} else if (first) {
+			set_elem(v, s, set_continuation(get_elem(v, s)));
+		} else {
+			entry = set_continuation(entry);
+		}
+		if (s != fq) {
+			entry = set_shifted(entry);
+		}
+		insert_into(v, s, entry);
+	}
+
+	for (uint64_t i = 1; i < n; ++i) {
+		uint64_t p = cnt_slot(v, s, i);
+		snapshot_slots(v, p, find_empty_slot(v, p));
+		insert_into(v, p, set_shifted(set_continuation(slots[i] << 3)));
+	}
+}
+
+/*
+ * Give remainder fr of quotient fq the count c, where its group of len
+ * slots (none if it was missing) is at s. Returns the change in slots.
+ */
+static int64_t cnt_set(const struct qf_view *v, uint64_t fq, uint64_t fr,
+		uint64_t s, uint64_t len, bool first, uint64_t c)
+{
+	uint64_t slots[CNT_MAX_SLOTS];
+	uint64_t n = c ? cnt_encode(v, fr, c, slots) : 0;
+	uint64_t i;
+
+	if (len == 0) {
+		cnt_put(v, fq, s, first, slots, n);
+		return n;
+	}
+
+	//先原地改写两者共有的槽，多出的槽在组的末尾插入或删除
+	uint64_t keep = (n < len) ? n : len;
+	if (keep) {
+		snapshot_slots(v, s, cnt_slot(v, s, keep - 1));
+	}
+	for (i = 0; i < keep; ++i) {
+		uint64_t p = cnt_slot(v, s, i);
+		set_elem(v, p, (get_elem(v, p) & 7) | (slots[i] << 3));
+	}
+	for (i = keep; i < n; ++i) {
+		uint64_t p = cnt_slot(v, s, i);
+		snapshot_slots(v, p, find_empty_slot(v, p));
+		insert_into(v, p, set_shifted(set_continuation(slots[i] << 3)));
+	}
+	for (i = keep; i < len; ++i) {
+		delete_slot(v, fq, cnt_slot(v, s, keep));
+	}
+	return (int64_t)n - (int64_t)len;
+}
+
+/*
+ * Add c to the count of the fingerprint of hash, using at most room more
+ * slots. Returns the change in slots, or -1 if it would need more room or
+ * the count would overflow.
+ */
+//需要写入，不是根API
+static int64_t cnt_insert(const struct qf_view *v, uint64_t hash, uint64_t c,
+		uint64_t room)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	uint64_t slots[CNT_MAX_SLOTS];
+	uint64_t s = 0;
+	uint64_t len;
+	bool first;
+
+	uint64_t old = cnt_find(v, fq, fr, &s, &len, &first);
+	if (c > UINT64_MAX - old) {
+		return -1;
+	}
+	if (cnt_encode(v, fr, old + c, slots) > len + room) {
+		return -1;
+	}
+	return cnt_set(v, fq, fr, s, len, first, old + c);
+}
+
+/*
+ * Take up to c off the count of the fingerprint of hash. Returns the
+ * slots freed; *found says whether the fingerprint was there.
+ */
+//需要写入，不是根API
+static uint64_t cnt_remove(const struct qf_view *v, uint64_t hash, uint64_t c,
+		bool *found)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	uint64_t s = 0;
+	uint64_t len;
+	bool first;
+
+	uint64_t old = cnt_find(v, fq, fr, &s, &len, &first);
+	*found = (old != 0);
+	if (old == 0) {
+		return 0;
+	}
+	return -cnt_set(v, fq, fr, s, len, first, (c < old) ? old - c : 0);
+}
+
+/* Return the count of the fingerprint of hash. */
+//不需写入
+static uint64_t cnt_count(const struct qf_view *v, uint64_t hash)
+{
+	uint64_t s;
+	uint64_t len;
+	bool first;
+	QF_COUNT(qc_lookups, 1);
+	return cnt_find(v, hash_to_quotient(v, hash), hash_to_remainder(v, hash),
+			&s, &len, &first);
+}
+
+/*
+ * Insert count occurrences of the fingerprint of hash into QF; only a
+ * counting QF keeps more than one. *n is the entry count of the QF: for a
+ * pmem view, the caller has an open transaction and has snapshotted it.
+ *
+ * Returns false only if the QF is full (or the count would overflow).
+ */
+//需要写入，不是根API
+static bool insert_hash_count(uint64_t *n, const struct qf_view *v,
+		uint64_t hash, uint64_t count)
+{
+	uint64_t entries = *n;
+
+	if (v->qfv_counting) {
+		//计数器变长时才多占槽，能否放下由cnt_insert判断
+		uint64_t room = (entries < v->qfv_limit) ? v->qfv_limit - entries : 0;
+		int64_t added = cnt_insert(v, hash, count, room);
+		if (added < 0) {
+			return false;
+		}
+		*n = entries + added;
+		QF_COUNT(qc_inserts, 1);
+		return true;
+	}
+
+	if (entries >= v->qfv_limit) {
+		//QF已达到最大负载
+		return false;
+	}
+
+	int added = insert_fp(v, hash);
+	if (added > 0) {
+		*n = entries + 1;
+		QF_COUNT(qc_inserts, 1);
+	}
+	return added >= 0;
+}
+
+/* Same as insert_hash_count() for one occurrence, into a pmem QF. */
+//需要写入，不是根API
+static bool insert_hash(TOID(struct quotient_filter) qf,
+		const struct qf_view *v, uint64_t hash)
+{
+	return insert_hash_count(&D_RW(qf)->qf_entries, v, hash, 1);
+}
+
+/*
+ * Grow qf, if its policy says so, until n more entries stay within its
+ * maximum load. A failed resize leaves qf as it was; the inserts then go
+ * into the old table for as long as it admits them.
+ */
+//需要写入，不是根API
+static void autogrow(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t n)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	uint32_t q = f->qf_qbits;
+	uint32_t bits = q + f->qf_rbits;
+
+	if (f->qf_full_policy != QF_FULL_RESIZE) {
+		return;
+	}
+	while (q + 1 < bits && f->qf_entries + n > load_limit(q, f->qf_max_load)) {
+		++q;
+	}
+	if (q != f->qf_qbits) {
+		qf_resize(pop, qf, q);
+	}
+}
+
+//需要写入，是根API
+bool qf_set_max_load(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint32_t load, int policy, TOID(struct quotient_filter) spill)
+{
+	if (load == 0 || load > 100 || policy < QF_FULL_REJECT || policy > QF_FULL_SPILL) {
+		return false;
+	}
+	if (!TOID_IS_NULL(spill) && (TOID_EQUALS(spill, qf) || !qf_open(pop, spill))) {
+		return false;
+	}
+	if (policy == QF_FULL_SPILL && TOID_IS_NULL(spill)) {
+		return false;
+	}
+	if (policy == QF_FULL_RESIZE && D_RO(qf)->qf_counting) {
+		//计数QF不能重新调整大小
+		return false;
+	}
+
+	bool ret;
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(qf, qf_max_load);
+		TX_ADD_FIELD(qf, qf_full_policy);
+		TX_ADD_FIELD(qf, qf_spill);
+		set_policy(qf, load, policy, spill);
+	} TX_ONABORT {
+		ret = false;
+	} TX_ONCOMMIT {
+		ret = true;
+	} TX_END;
+	return ret;
+}
+
+//只读
+void qf_load(TOID(struct quotient_filter) qf, struct qf_load_info *info)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	double load = (double)f->qf_entries / f->qf_max_size;
+
+	info->ql_entries = f->qf_entries;
+	info->ql_limit = load_limit(f->qf_qbits, f->qf_max_load);
+	info->ql_load = load;
+	if (f->qf_entries >= f->qf_max_size) {
+		//满了以后整张表就是一个簇
+		info->ql_cluster = f->qf_max_size;
+	} else {
+		double e = 0.5 * (1.0 + 1.0 / ((1.0 - load) * (1.0 - load)));
+		info->ql_cluster = (e < f->qf_max_size) ? e : f->qf_max_size;
+	}
+}
+
+/*
+ * Staging log. The log is a plain array of masked fingerprints whose
+ * length lives in the QF header. An append stores the fingerprint past
+ * the end and persists it before it persists the new length, so a torn
+ * append is never seen; only a drain, which changes the table, needs a
+ * transaction.
+ */
+
+static int fp_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+//只读，日志中是否有hash的指纹
+static bool log_find(const struct quotient_filter *f, uint64_t hash)
+{
+	if (f->qf_log_len == 0) {
+		return false;
+	}
+	const uint64_t *log = D_RO(f->qf_log);
+	uint64_t fp = hash & LOW_MASK(f->qf_qbits + f->qf_rbits);
+	for (uint64_t i = 0; i < f->qf_log_len; ++i) {
+		if (log[i] == fp) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//需要写入，不用事务，调用者已确认日志没满
+static void log_append(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint64_t hash)
+{
+	struct quotient_filter *f = D_RW(qf);
+	uint64_t *slot = D_RW(f->qf_log) + f->qf_log_len;
+
+	*slot = hash & LOW_MASK(f->qf_qbits + f->qf_rbits);
+	pmemobj_persist(pop, slot, sizeof(*slot));
+	//长度最后写，崩溃时日志里不会有写了一半的指纹
+	f->qf_log_len = f->qf_log_len + 1;
+	pmemobj_persist(pop, &f->qf_log_len, sizeof(f->qf_log_len));
+}
+
+//需要写入，是根API
+bool qf_log_drain(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	uint64_t n = f->qf_log_len;
+
+	if (n == 0) {
+		return true;
+	}
+	uint64_t *keys = (uint64_t *)malloc(n * sizeof(uint64_t));
+	if (keys == NULL) {
+		return false;
+	}
+	memcpy(keys, D_RO(f->qf_log), n * sizeof(uint64_t));
+	qsort(keys, n, sizeof(uint64_t), fp_cmp);
+
+	struct qf_view v;
+	qfv_init(qf, &v);
+	uint64_t kept = 0;
+	bool committed = false;
+
+	QF_COUNT(qc_tx, 1);
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(qf, qf_entries);
+		TX_ADD_FIELD(qf, qf_log_len);
+		for (uint64_t i = 0; i < n; ++i) {
+			if (!insert_hash(qf, &v, keys[i])) {
+				keys[kept++] = keys[i];
+			}
+		}
+		if (kept > 0) {
+			//放不下的指纹留在日志开头，查询仍然能找到
+			uint64_t *log = D_RW(D_RO(qf)->qf_log);
+			pmemobj_tx_add_range_direct(log, kept * sizeof(uint64_t));
+			memcpy(log, keys, kept * sizeof(uint64_t));
+		}
+		D_RW(qf)->qf_log_len = kept;
+	} TX_ONCOMMIT {
+		committed = true;
+	} TX_END;
+
+	if (!committed) {
+		QF_COUNT(qc_tx_aborts, 1);
+	}
+	free(keys);
+	return committed && kept == 0;
+}
+
+//需要写入，分配内存，是根API
+bool qf_set_log(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t cap)
+{
+	if (D_RO(qf)->qf_counting || cap > SIZE_MAX / sizeof(uint64_t)) {
+		//计数QF的插入要改计数器，不能只记下指纹
+		return false;
+	}
+	if (cap == D_RO(qf)->qf_log_cap) {
+		return true;
+	}
+	if (!qf_log_drain(pop, qf)) {
+		return false;
+	}
+
+	bool ret;
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(qf, qf_log);
+		TX_ADD_FIELD(qf, qf_log_cap);
+		TX_FREE(D_RO(qf)->qf_log);
+		D_RW(qf)->qf_log = (cap > 0) ?
+				TX_ALLOC(uint64_t, cap * sizeof(uint64_t)) : TOID_NULL(uint64_t);
+		D_RW(qf)->qf_log_cap = cap;
+	} TX_ONABORT {
+		ret = false;
+	} TX_ONCOMMIT {
+		ret = true;
+	} TX_END;
+	return ret;
+}
+
+//需要写入，不是根API，spill为真时按策略溢出到另一个QF
+static bool insert_one(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint64_t hash, uint64_t count, bool spill)
+{
+	autogrow(pop, qf, 1 + D_RO(qf)->qf_log_len);
+	const struct quotient_filter *f = D_RO(qf);
+	bool ret = false;
+
+	if (f->qf_log_cap > 0) {
+		//暂存的指纹也要算进负载，这样排空时它们都放得下
+		uint64_t limit = load_limit(f->qf_qbits, f->qf_max_load);
+		if (f->qf_log_len == f->qf_log_cap || f->qf_entries + f->qf_log_len >= limit) {
+			qf_log_drain(pop, qf);
+		}
+		if (f->qf_log_len < f->qf_log_cap && f->qf_entries + f->qf_log_len < limit) {
+			log_append(pop, qf, hash);
+			return true;
+		}
+	}
+
+	//计数QF的加一不一定要新的槽，是否放得下由insert_hash_count判断
+	if (f->qf_counting || f->qf_entries < load_limit(f->qf_qbits, f->qf_max_load)) {
+		struct qf_view v;
+		qfv_init(qf, &v);
+
+		QF_COUNT(qc_tx, 1);
+	    TX_BEGIN(pop) {
+	        //qf_table中被修改的部分由insert_hash/remove_hash自己添加
+	        //要修改qf的qf_entries字段
+	        TX_ADD_FIELD(qf,qf_entries);
+			ret = insert_hash_count(&D_RW(qf)->qf_entries, &v, hash, count);
+	    } TX_ONABORT {
+			QF_COUNT(qc_tx_aborts, 1);
+			ret = false;
+	    } TX_END;
+	}
+
+	if (!ret && spill && f->qf_full_policy == QF_FULL_SPILL) {
+		//QF已达到最大负载
+		return insert_one(pop, f->qf_spill, hash, count, false);
+	}
+	return ret;
+}
+
+//需要写入，是根API
+bool qf_insert(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash)
+{
+	return insert_one(pop, qf, hash, 1, true);
+}
+
+//需要写入，是根API
+bool qf_insert_count(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint64_t hash, uint64_t count)
+{
+	if (count == 0) {
+		return false;
+	}
+	return insert_one(pop, qf, hash, count, true);
+}
+
+/*
+ * Look up hash in a classic QF. rd is NULL, or the read state of a qf_sync
+ * lookup whose result only counts if seq_reader_valid() agrees.
+ */
+//不需写入
+static bool classic_may_contain(const struct qf_view *v,
+		struct seq_reader *rd, uint64_t hash)
+{
+	//得到hash的商和余数
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	uint64_t k;
+
+	QF_COUNT(qc_lookups, 1);
+	/* If this quotient has no run, give up. */
+	if (!is_occupied(load_window(v, rd, fq, 1, &k))) {
+		//如果isO为0，说明该商的run不存在，元素也一定不存在
+		return false;
+	}
+
+	/* Scan the sorted run for the target remainder. */
+	//否则run存在，定位这个商的run的起始位置
+	//一次比较一个窗口内run的所有余数
+	uint64_t s = find_run_index(v, rd, fq);
+	uint64_t bits = v->qfv_elem_bits;
+	bool first = true;
+	for (;;) {
+		uint64_t w = load_window(v, rd, s, v->qfv_max_size, &k);
+
+		/* The run ends before the first slot that is not a continuation. */
+		uint64_t ends = ~w & (v->qfv_lsbs << 1) & LOW_MASK(k * bits);
+		if (first) {
+			ends &= ~LOW_MASK(bits);
+		}
+		uint64_t len = ends ? __builtin_ctzll(ends) / bits : k;
+		QF_COUNT(qc_scan_slots, len);
+
+		if (swar_match(w, fr, v->qfv_lsbs, bits, 3, v->qfv_rbits, len)) {
+			return true;//存在这个余数，可能存在
+		}
+		if (len < k) {
+			return false;//直到该run结束也未找到，一定不存在
+		}
+		s = (s + k) & v->qfv_index_mask;
+		first = false;
+	}
+}
+
+//不需写入
+bool qfv_may_contain(const struct qf_view *v, uint64_t hash)
+{
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		return blk_may_contain(v, hash);
+	}
+	if (v->qfv_counting) {
+		//计数器的数字也是余数，只按组比较才不会多出误判
+		return cnt_count(v, hash) != 0;
+	}
+	return classic_may_contain(v, NULL, hash);
+}
+
+/*
+ * Stage one of a batched lookup: fetch the lines holding the home slot of
+ * hash (and, in the blocked format, the block's offset and bitvectors).
+ */
+//不需写入
+static inline void prefetch_home(const struct qf_view *v, uint64_t hash)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		const uint64_t *blk = blk_block(v, fq / QF_BLOCK_SLOTS);
+		__builtin_prefetch(blk);
+		__builtin_prefetch(blk + BLK_REMAINDERS +
+				(fq % QF_BLOCK_SLOTS) * v->qfv_rbits / 64);
+	} else {
+		__builtin_prefetch(&v->qfv_table[fq * v->qfv_elem_bits / 64]);
+	}
+}
+
+/*
+ * Stage two: the home lines should have arrived by now, so use them to
+ * fetch where the run most likely is. In the blocked format that is the
+ * block offset past the home block's start; in the classic format runs
+ * are shifted forward, so it is the line after the home slot.
+ */
+//不需写入
+static inline void prefetch_run(const struct qf_view *v, uint64_t hash)
+{
+	uint64_t fq = hash_to_quotient(v, hash);
+
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		uint64_t start = fq + blk_block(v, fq / QF_BLOCK_SLOTS)[BLK_OFFSET];
+		if (start < v->qfv_nslots) {
+			__builtin_prefetch(blk_block(v, start / QF_BLOCK_SLOTS));
+			__builtin_prefetch(blk_block(v, start / QF_BLOCK_SLOTS) +
+					BLK_REMAINDERS + (start % QF_BLOCK_SLOTS) * v->qfv_rbits / 64);
+		}
+	} else {
+		uint64_t next = fq + 512 / v->qfv_elem_bits;
+		if (next < v->qfv_max_size) {
+			__builtin_prefetch(&v->qfv_table[next * v->qfv_elem_bits / 64]);
+		}
+	}
+}
+
+/*
+ * The lookups are software pipelined: lookup i+d has its home lines
+ * prefetched, lookup i+d/2 its likely run lines, and lookup i is resolved,
+ * so up to d cache misses are in flight while each run is scanned.
+ */
+//不需写入
+void qfv_may_contain_batch(const struct qf_view *v, const uint64_t *hashes,
+		size_t n, uint8_t *out)
+{
+	size_t d = v->qfv_prefetch;
+	size_t h = d / 2;
+	size_t i;
+
+	for (i = 0; i < n && i < d; ++i) {
+		prefetch_home(v, hashes[i]);
+	}
+	for (i = 0; i < n && i < h; ++i) {
+		prefetch_run(v, hashes[i]);
+	}
+	for (i = 0; i < n; ++i) {
+		if (d && i + d < n) {
+			prefetch_home(v, hashes[i + d]);
+		}
+		if (h && i + h < n) {
+			prefetch_run(v, hashes[i + h]);
+		}
+		out[i] = qfv_may_contain(v, hashes[i]);
+	}
+}
+
+//不需写入
+void qf_may_contain_batch(TOID(struct quotient_filter) qf, const uint64_t *hashes,
+		size_t n, uint8_t *out)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+	qfv_may_contain_batch(&v, hashes, n, out);
+
+	const struct quotient_filter *f = D_RO(qf);
+	if (f->qf_log_len > 0) {
+		//表没有命中的到日志的有序副本里二分查找，分配失败就逐个扫描
+		uint64_t fmask = LOW_MASK(f->qf_qbits + f->qf_rbits);
+		uint64_t *log = (uint64_t *)malloc(f->qf_log_len * sizeof(uint64_t));
+		if (log != NULL) {
+			memcpy(log, D_RO(f->qf_log), f->qf_log_len * sizeof(uint64_t));
+			qsort(log, f->qf_log_len, sizeof(uint64_t), fp_cmp);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			uint64_t fp = hashes[i] & fmask;
+			if (!out[i]) {
+				out[i] = (log != NULL) ? bsearch(&fp, log, f->qf_log_len,
+						sizeof(uint64_t), fp_cmp) != NULL : log_find(f, fp);
+			}
+		}
+		free(log);
+	}
+
+	if (!TOID_IS_NULL(D_RO(qf)->qf_spill)) {
+		//溢出的元素很少，逐个查
+		qfv_init(D_RO(qf)->qf_spill, &v);
+		for (size_t i = 0; i < n; ++i) {
+			if (!out[i]) {
+				out[i] = qfv_may_contain(&v, hashes[i]);
+			}
+		}
+	}
+}
+
+//不需写入
+bool qf_may_contain(TOID(struct quotient_filter) qf, uint64_t hash)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+	if (qfv_may_contain(&v, hash) || log_find(D_RO(qf), hash)) {
+		return true;
+	}
+	if (TOID_IS_NULL(D_RO(qf)->qf_spill)) {
+		return false;
+	}
+	qfv_init(D_RO(qf)->qf_spill, &v);
+	return qfv_may_contain(&v, hash);
+}
+
+//不需写入，不是根API
+static uint64_t view_count(const struct qf_view *v, uint64_t hash)
+{
+	if (v->qfv_counting) {
+		return cnt_count(v, hash);
+	}
+	return qfv_may_contain(v, hash);
+}
+
+//不需写入
+uint64_t qf_count(TOID(struct quotient_filter) qf, uint64_t hash)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+	uint64_t c = view_count(&v, hash);
+	if (c == 0) {
+		//有日志的QF不计数，日志里有就是1
+		c = log_find(D_RO(qf), hash);
+	}
+	if (TOID_IS_NULL(D_RO(qf)->qf_spill)) {
+		return c;
+	}
+	qfv_init(D_RO(qf)->qf_spill, &v);
+	uint64_t more = view_count(&v, hash);
+	return (more > UINT64_MAX - c) ? UINT64_MAX : c + more;
+}
+
+/*
+ * Statistics. One pass over the slot metadata, classic or blocked,
+ * splitting the used slots into clusters and runs the way a lookup sees
+ * them.
+ */
+
+//把长度记入直方图，第i个桶是[2^i, 2^(i+1))，长度为0时不记
+static void stats_add(uint64_t *hist, uint64_t *count, uint64_t *longest,
+		uint64_t len)
+{
+	if (len == 0) {
+		return;
+	}
+	unsigned b = 63 - __builtin_clzll(len);
+	++hist[(b < QF_STATS_BUCKETS) ? b : QF_STATS_BUCKETS - 1];
+	++*count;
+	*longest = MAX(*longest, len);
+}
+
+static void stats_run(struct qf_stats *st, uint64_t len)
+{
+	stats_add(st->qs_run_hist, &st->qs_runs, &st->qs_longest_run, len);
+}
+
+static void stats_cluster(struct qf_stats *st, uint64_t len)
+{
+	stats_add(st->qs_cluster_hist, &st->qs_clusters, &st->qs_longest_cluster, len);
+}
+
+//不需写入
+static void classic_stats(const struct qf_view *v, struct qf_stats *st)
+{
+	uint64_t start;
+	for (start = 0; start < v->qfv_max_size; ++start) {
+		if (is_cluster_start(get_elem(v, start))) {
+			break;
+		}
+	}
+	if (start == v->qfv_max_size) {
+		return;
+	}
+
+	//从一个cluster的开始绕表一圈，cluster和run都不会被切断
+	uint64_t cluster = 0;
+	uint64_t run = 0;
+	uint64_t group = 0;	//计数模式下当前指纹的组还剩几个槽
+	uint64_t idx = start;
+	do {
+		uint64_t elt = get_elem(v, idx);
+		if (is_empty_element(elt)) {
+			stats_run(st, run);
+			stats_cluster(st, cluster);
+			run = 0;
+			cluster = 0;
+		} else {
+			if (is_cluster_start(elt)) {
+				stats_run(st, run);
+				stats_cluster(st, cluster);
+				run = 0;
+				cluster = 0;
+			} else if (!is_continuation(elt)) {
+				stats_run(st, run);
+				run = 0;
+			}
+			if (group == 0) {
+				group = 1;
+				if (v->qfv_counting) {
+					cnt_decode(v, idx, &group);
+				}
+				++st->qs_fingerprints;
+			}
+			--group;
+			++run;
+			++cluster;
+			++st->qs_used;
+			if (is_shifted(elt)) {
+				++st->qs_shifted;
+			}
+		}
+		idx = incr(v, idx);
+	} while (idx != start);
+	stats_run(st, run);
+	stats_cluster(st, cluster);
+}
+
+//不需写入
+static void blocked_stats(const struct qf_view *v, struct qf_stats *st)
+{
+	uint64_t quot = blk_next_bit(v, BLK_OCCUPIEDS, 0);
+	uint64_t used = 0;	//上一个run之后的第一个槽
+	uint64_t cluster = 0;
+
+	while (quot < v->qfv_nslots) {
+		uint64_t start = MAX(quot, used);
+		uint64_t len = blk_next_bit(v, BLK_RUNENDS, start) - start + 1;
+
+		//和经典格式一样，从自己的商开始的run开始一个新的cluster
+		if (start == quot) {
+			stats_cluster(st, cluster);
+			cluster = 0;
+		}
+		stats_run(st, len);
+		cluster += len;
+		st->qs_used += len;
+		st->qs_shifted += len - (start == quot);
+		used = start + len;
+		quot = blk_next_bit(v, BLK_OCCUPIEDS, quot + 1);
+	}
+	stats_cluster(st, cluster);
+	st->qs_fingerprints = st->qs_used;
+}
+
+//只读
+void qf_stats(TOID(struct quotient_filter) qf, struct qf_stats *st)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	memset(st, 0, sizeof(*st));
+	if (D_RO(qf)->qf_entries == 0) {
+		return;
+	}
+	if (v.qfv_format == QF_FORMAT_BLOCKED) {
+		blocked_stats(&v, st);
+	} else {
+		classic_stats(&v, st);
+	}
+	st->qs_shifted_frac = (double)st->qs_shifted / st->qs_used;
+	st->qs_mean_cluster = (double)st->qs_used / st->qs_clusters;
+}
+
+//只读
+void qf_measure_fpr(TOID(struct quotient_filter) qf, const uint64_t *hashes,
+		size_t n, struct qf_fpr *fpr)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+	uint32_t bits = v.qfv_qbits + v.qfv_rbits;
+	uint64_t fingerprints = D_RO(qf)->qf_entries;
+	uint64_t probes[QF_BATCH_CHUNK];
+	uint8_t out[QF_BATCH_CHUNK];
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+	if (v.qfv_counting) {
+		//计数模式下qf_entries是槽数，不是指纹数
+		struct qf_stats st;
+		qf_stats(qf, &st);
+		fingerprints = st.qs_fingerprints;
+	}
+
+	fpr->qp_probes = n;
+	fpr->qp_hits = 0;
+	for (size_t lo = 0; lo < n; lo += QF_BATCH_CHUNK) {
+		size_t m = (n - lo < QF_BATCH_CHUNK) ? n - lo : QF_BATCH_CHUNK;
+		const uint64_t *batch = hashes ? hashes + lo : probes;
+		if (hashes == NULL) {
+			//splitmix64，固定的种子让结果可以重复
+			for (size_t i = 0; i < m; ++i) {
+				uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+				probes[i] = (z ^ (z >> 31)) & LOW_MASK(bits);
+			}
+		}
+		qfv_may_contain_batch(&v, batch, m, out);
+		for (size_t i = 0; i < m; ++i) {
+			fpr->qp_hits += out[i];
+		}
+	}
+
+	double space = (bits >= 64) ? 18446744073709551616.0 : (double)(1ULL << bits);
+	fpr->qp_rate = n ? (double)fpr->qp_hits / n : 0.0;
+	fpr->qp_expected = fingerprints / space;
+}
+
+/*
+ * Remove the fingerprint of hash from the table. Must be called inside an
+ * open transaction; qf_entries is left to the caller.
+ *
+ * Returns true if the fingerprint was there.
+ */
+//需要写入，不是根API
+static bool remove_fp(const struct qf_view *v, uint64_t hash)
+{
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		return blk_remove(v, hash);
+	}
+
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	uint64_t T_fq = get_elem(v, fq);
+
+	if (!is_occupied(T_fq)) {
+		return false;
+	}
+
+	uint64_t start = find_run_index(v, NULL, fq);
+	uint64_t s = start;
+	uint64_t rem;
+
+	/* Find the offending table index (or give up). */
+	do {
+		rem = get_remainder(get_elem(v, s));
+		if (rem == fr) {
+			break;
+		} else if (rem > fr) {
+			return false;
+		}
+		s = incr(v, s);
+	} while (is_continuation(get_elem(v, s)));
+	if (rem != fr) {
+		return false;
+	}
+
+	delete_slot(v, fq, s);
+	return true;
+}
+
+/*
+ * Remove up to count occurrences of the fingerprint of hash from QF. *n
+ * is the entry count, as for insert_hash_count().
+ *
+ * Returns -1 if the hash uses more than q+r bits, 0 if the fingerprint was
+ * not there and 1 if it was.
+ */
+//需要写入，不是根API
+static int remove_hash_count(uint64_t *n, const struct qf_view *v,
+		uint64_t hash, uint64_t count)
+{
+	uint64_t highbits = hash & ~LOW_MASK(v->qfv_qbits + v->qfv_rbits);
+	if (highbits) {
+		return -1;
+	}
+	if (!*n) {
+		return 0;
+	}
+
+	if (v->qfv_counting) {
+		bool found;
+		*n -= cnt_remove(v, hash, count, &found);
+		return found;
+	}
+	if (!remove_fp(v, hash)) {
+		return 0;
+	}
+	--*n;
+	return 1;
+}
+
+/*
+ * Same as remove_hash_count() for one occurrence, from a pmem QF.
+ *
+ * Returns false if the hash uses more than q+r bits.
+ */
+//需要写入，不是根API
+static bool remove_hash(TOID(struct quotient_filter) qf,
+		const struct qf_view *v, uint64_t hash)
+{
+	return remove_hash_count(&D_RW(qf)->qf_entries, v, hash, 1) >= 0;
+}
+
+//需要写入，是根API
+bool qf_remove_count(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint64_t hash, uint64_t count)
+{
+	uint64_t highbits = hash & ~LOW_MASK(D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits);
+	if (highbits || count == 0 || !qf_log_drain(pop, qf)) {
+		return false;
+	}
+
+	TOID(struct quotient_filter) spill = D_RO(qf)->qf_spill;
+	if (!D_RO(qf)->qf_entries) {
+		return TOID_IS_NULL(spill) || qf_remove_count(pop, spill, hash, count);
+	}
+
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	QF_COUNT(qc_tx, 1);
+    TX_BEGIN(pop) {
+        //qf_table中被修改的部分由insert_hash/remove_hash自己添加
+        //要修改qf的qf_entries字段
+        TX_ADD_FIELD(qf,qf_entries);
+		if (remove_hash_count(&D_RW(qf)->qf_entries, &v, hash, count) == 0 &&
+				!TOID_IS_NULL(spill)) {
+			//不在本QF中，可能在溢出的QF中
+			qf_remove_count(pop, spill, hash, count);
+		}
+    }TX_ONABORT{
+		QF_COUNT(qc_tx_aborts, 1);
+    }TX_END;
+
+    return true;
+}
+
+//需要写入，是根API
+bool qf_remove(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash)
+{
+	return qf_remove_count(pop, qf, hash, 1);
+}
+
+/*
+ * Key hashing.
+ *
+ * QF_HASH_WY follows the structure of wyhash: every 16 bytes of key are
+ * folded into the state with one 64x64->128-bit multiply, and short keys
+ * are read with a few overlapping loads instead of a byte loop. Bytes are
+ * read little-endian, so the hash of a key is the same on every machine
+ * that can map the pool.
+ *
+ * QF_HASH_INVERTIBLE works on the q+r fingerprint bits alone: add the
+ * seed, multiply by an odd constant and xor in the high half, twice. Each
+ * step is a bijection mod 2^(q+r), so the whole is one, and undoing the
+ * steps in reverse order gives the key back.
+ */
+
+#define WY_P0 0xa0761d6478bd642fULL
+#define WY_P1 0xe7037ed1a0b428dbULL
+#define WY_P2 0x8ebc6af09c88c6e3ULL
+
+#define MIX_M1 0xff51afd7ed558ccdULL
+#define MIX_M2 0xc4ceb9fe1a85ec53ULL
+
+static inline uint64_t wy_mum(uint64_t a, uint64_t b)
+{
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+//读n个字节，按小端解释，n不超过8
+static inline uint64_t wy_read(const uint8_t *p, size_t n)
+{
+	uint64_t v = 0;
+	for (size_t i = 0; i < n; ++i) {
+		v |= (uint64_t)p[i] << (8 * i);
+	}
+	return v;
+}
+
+static uint64_t wy_hash(const void *key, size_t len, uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint64_t a;
+	uint64_t b;
+
+	seed ^= wy_mum(seed ^ WY_P0, WY_P1);
+	if (len <= 16) {
+		if (len >= 4) {
+			//两次4字节读，长度超过8时第二次从中间读，读的范围可以重叠
+			size_t mid = (len >> 3) << 2;
+			a = (wy_read(p, 4) << 32) | wy_read(p + mid, 4);
+			b = (wy_read(p + len - 4, 4) << 32) | wy_read(p + len - 4 - mid, 4);
+		} else if (len > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+			b = 0;
+		} else {
+			a = 0;
+			b = 0;
+		}
+	} else {
+		size_t i = len;
+		while (i > 16) {
+			seed = wy_mum(wy_read(p, 8) ^ WY_P1, wy_read(p + 8, 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		a = wy_read(p + i - 16, 8);
+		b = wy_read(p + i - 8, 8);
+	}
+
+	__uint128_t r = (__uint128_t)(a ^ WY_P1) * (b ^ seed);
+	return wy_mum((uint64_t)r ^ WY_P0 ^ len, (uint64_t)(r >> 64) ^ WY_P2);
+}
+
+//q+r位上的可逆混合，bits位以上必须为0
+static inline uint64_t mix_bits(uint64_t x, uint64_t seed, uint32_t bits)
+{
+	uint64_t mask = LOW_MASK(bits);
+	uint32_t shift = (bits + 1) / 2;
+
+	x = ((x + seed) * MIX_M1) & mask;
+	x ^= x >> shift;
+	x = (x * MIX_M2) & mask;
+	x ^= x >> shift;
+	return x;
+}
+
+//奇数m模2^64的逆，牛顿迭代每次把正确的位数翻倍
+static inline uint64_t odd_inverse(uint64_t m)
+{
+	uint64_t inv = m;
+	for (int i = 0; i < 5; ++i) {
+		inv *= 2 - m * inv;
+	}
+	return inv;
+}
+
+static inline uint64_t unxorshift(uint64_t y, uint32_t shift)
+{
+	uint64_t x = y;
+	for (uint64_t t = y >> shift; t; t >>= shift) {
+		x ^= t;
+	}
+	return x;
+}
+
+static uint64_t unmix_bits(uint64_t x, uint64_t seed, uint32_t bits)
+{
+	uint64_t mask = LOW_MASK(bits);
+	uint32_t shift = (bits + 1) / 2;
+
+	x = unxorshift(x, shift);
+	x = (x * odd_inverse(MIX_M2)) & mask;
+	x = unxorshift(x, shift);
+	x = (x * odd_inverse(MIX_M1)) & mask;
+	return (x - seed) & mask;
+}
+
+//只读，不是根API，算出qf用的哈希，只保留q+r位
+static bool key_hash(const struct quotient_filter *f, const void *key, size_t len,
+		uint64_t *hash)
+{
+	uint32_t bits = f->qf_qbits + f->qf_rbits;
+
+	if (f->qf_hash == QF_HASH_NONE) {
+		//合并时加宽过，指纹已经对不上任何键的哈希
+		return false;
+	}
+	if (f->qf_hash == QF_HASH_INVERTIBLE) {
+		if (len > sizeof(uint64_t)) {
+			return false;
+		}
+		uint64_t x = wy_read((const uint8_t *)key, len);
+		if (x & ~LOW_MASK(bits)) {
+			return false;
+		}
+		*hash = mix_bits(x, f->qf_seed, bits);
+		return true;
+	}
+	*hash = wy_hash(key, len, f->qf_seed) & LOW_MASK(bits);
+	return true;
+}
+
+//需要写入，是根API
+bool qf_set_hash(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		int kind, uint64_t seed)
+{
+	if (kind < QF_HASH_WY || kind > QF_HASH_INVERTIBLE || D_RO(qf)->qf_entries ||
+			D_RO(qf)->qf_log_len) {
+		//已有的指纹是用原来的函数算的
+		return false;
+	}
+
+	bool ret;
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(qf, qf_hash);
+		TX_ADD_FIELD(qf, qf_seed);
+		set_hash(qf, kind, seed);
+	} TX_ONABORT {
+		ret = false;
+	} TX_ONCOMMIT {
+		ret = true;
+	} TX_END;
+	return ret;
+}
+
+//只读
+bool qf_hash_key(TOID(struct quotient_filter) qf, const void *key, size_t len,
+		uint64_t *hash)
+{
+	return key_hash(D_RO(qf), key, len, hash);
+}
+
+//只读
+bool qf_hash_keys(TOID(struct quotient_filter) qf, const uint64_t *keys,
+		size_t n, uint64_t *hashes)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	uint32_t bits = f->qf_qbits + f->qf_rbits;
+	uint64_t mask = LOW_MASK(bits);
+	uint64_t seed = f->qf_seed;
+	size_t i;
+
+	if (f->qf_hash == QF_HASH_NONE) {
+		return false;
+	}
+	//循环内没有分支，编译器可以把乘法和移位展开、向量化
+	if (f->qf_hash == QF_HASH_INVERTIBLE) {
+		uint64_t high = 0;
+		for (i = 0; i < n; ++i) {
+			high |= keys[i] & ~mask;
+			hashes[i] = mix_bits(keys[i] & mask, seed, bits);
+		}
+		return high == 0;
+	}
+	for (i = 0; i < n; ++i) {
+		uint8_t buf[sizeof(uint64_t)];
+		for (size_t j = 0; j < sizeof(buf); ++j) {
+			buf[j] = keys[i] >> (8 * j);
+		}
+		hashes[i] = wy_hash(buf, sizeof(buf), seed) & mask;
+	}
+	return true;
+}
+
+//只读
+bool qf_unhash(TOID(struct quotient_filter) qf, uint64_t hash, uint64_t *key)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	uint32_t bits = f->qf_qbits + f->qf_rbits;
+
+	if (f->qf_hash != QF_HASH_INVERTIBLE) {
+		return false;
+	}
+	*key = unmix_bits(hash & LOW_MASK(bits), f->qf_seed, bits);
+	return true;
+}
+
+//需要写入，是根API
+bool qf_insert_key(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const void *key, size_t len)
+{
+	uint64_t hash;
+	return key_hash(D_RO(qf), key, len, &hash) && qf_insert(pop, qf, hash);
+}
+
+//只读
+bool qf_may_contain_key(TOID(struct quotient_filter) qf, const void *key,
+		size_t len)
+{
+	uint64_t hash;
+	return key_hash(D_RO(qf), key, len, &hash) && qf_may_contain(qf, hash);
+}
+
+//需要写入，是根API
+bool qf_remove_key(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const void *key, size_t len)
+{
+	uint64_t hash;
+	return key_hash(D_RO(qf), key, len, &hash) && qf_remove(pop, qf, hash);
+}
+
+/* One hash of a batch, tagged with its position in the caller's array. */
+struct batch_ent {
+	uint64_t be_key;	/* fingerprint: orders by quotient, then remainder */
+	uint64_t be_hash;
+	size_t be_idx;
+	bool be_ok;
+};
+
+static int batch_ent_cmp(const void *a, const void *b)
+{
+	uint64_t ka = ((const struct batch_ent *)a)->be_key;
+	uint64_t kb = ((const struct batch_ent *)b)->be_key;
+	return (ka > kb) - (ka < kb);
+}
+
+/*
+ * Apply op to every hash in quotient order, one transaction per
+ * QF_BATCH_CHUNK hashes. Sorting keeps neighbouring updates in the same
+ * cluster together, so each chunk touches a handful of table ranges and
+ * the header is snapshotted once per chunk instead of once per hash.
+ */
+static size_t apply_batch(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const uint64_t *hashes, size_t n, bool *results,
+		bool (*op)(TOID(struct quotient_filter), const struct qf_view *,
+			uint64_t), bool grow)
+{
+	size_t i;
+	size_t ok = 0;
+
+	if (results) {
+		memset(results, 0, n * sizeof(*results));
+	}
+	if (n == 0 || !qf_log_drain(pop, qf)) {
+		//批量操作直接改表，先把暂存的插入排空
+		return 0;
+	}
+
+	struct batch_ent *ents = (struct batch_ent *)malloc(n * sizeof(*ents));
+	if (ents == NULL) {
+		return 0;
+	}
+
+	uint32_t p = D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits;
+	uint64_t fmask = LOW_MASK(p);
+	for (i = 0; i < n; ++i) {
+		ents[i].be_key = hashes[i] & fmask;
+		ents[i].be_hash = hashes[i];
+		ents[i].be_idx = i;
+		ents[i].be_ok = false;
+	}
+	qsort(ents, n, sizeof(*ents), batch_ent_cmp);
+
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	for (size_t lo = 0; lo < n; lo += QF_BATCH_CHUNK) {
+		size_t hi = (n - lo > QF_BATCH_CHUNK) ? lo + QF_BATCH_CHUNK : n;
+		bool committed = false;
+
+		if (grow) {
+			//扩容不改变指纹，已排好的顺序仍然有效，但表换了
+			autogrow(pop, qf, hi - lo);
+			qfv_init(qf, &v);
+		}
+
+		QF_COUNT(qc_tx, 1);
+		TX_BEGIN(pop) {
+			TX_ADD_FIELD(qf, qf_entries);
+			for (i = lo; i < hi; ++i) {
+				ents[i].be_ok = op(qf, &v, ents[i].be_hash);
+			}
+		} TX_ONCOMMIT {
+			committed = true;
+		} TX_END;
+
+		if (!committed) {
+			QF_COUNT(qc_tx_aborts, 1);
+			/* Nothing in this chunk survived the abort. */
+			for (i = lo; i < hi; ++i) {
+				ents[i].be_ok = false;
+			}
+			break;
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (ents[i].be_ok) {
+			++ok;
+		}
+		if (results) {
+			results[ents[i].be_idx] = ents[i].be_ok;
+		}
+	}
+	free(ents);
+	return ok;
+}
+
+//需要写入，是根API
+size_t qf_insert_batch(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const uint64_t *hashes, size_t n, bool *results)
+{
+	if (D_RO(qf)->qf_full_policy != QF_FULL_SPILL) {
+		return apply_batch(pop, qf, hashes, n, results, insert_hash, true);
+	}
+
+	//先插入本QF，没有插入的再整批插入溢出的QF
+	bool *res = results ? results : (bool *)malloc(n * sizeof(bool));
+	uint64_t *left = (uint64_t *)malloc(n * sizeof(uint64_t));
+	size_t *idx = (size_t *)malloc(n * sizeof(size_t));
+	size_t ok = 0;
+	size_t m = 0;
+	size_t i;
+
+	if (res != NULL && left != NULL && idx != NULL) {
+		ok = apply_batch(pop, qf, hashes, n, res, insert_hash, false);
+		for (i = 0; i < n; ++i) {
+			if (!res[i]) {
+				left[m] = hashes[i];
+				idx[m++] = i;
+			}
+		}
+	}
+	if (m > 0) {
+		TOID(struct quotient_filter) spill = D_RO(qf)->qf_spill;
+		bool *sres = (bool *)malloc(m * sizeof(bool));
+		if (sres != NULL) {
+			ok += apply_batch(pop, spill, left, m, sres, insert_hash,
+					D_RO(spill)->qf_full_policy == QF_FULL_RESIZE);
+			for (i = 0; i < m; ++i) {
+				res[idx[i]] = sres[i];
+			}
+			free(sres);
+		}
+	}
+
+	if (res != results) {
+		free(res);
+	}
+	free(left);
+	free(idx);
+	return ok;
+}
+
+//需要写入，是根API
+size_t qf_remove_batch(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const uint64_t *hashes, size_t n, bool *results)
+{
+	return apply_batch(pop, qf, hashes, n, results, remove_hash, false);
+}
+
+/*
+ * Bulk build.
+ *
+ * A QF's layout is fully determined by its set of fingerprints, so a
+ * sorted stream of them can be laid out left to right: each run starts at
+ * its quotient or right after the previous run, whichever is later. The
+ * builder fills a zeroed DRAM window of the new table and streams it out
+ * to pmem with non-temporal stores, 64 slots at a time, as soon as no
+ * later fingerprint can touch it (the slot of the current quotient gets
+ * its occupied bit last). The new table is allocated and swapped in by
+ * one transaction, so a crash leaves the old contents in place.
+ *
+ * Classic runs that would wrap past the last slot are kept aside and
+ * inserted the ordinary way once the table is in place; there are only a
+ * handful of them. Blocked tables never wrap, so there a build that runs
+ * past the spill blocks fails like an insert would.
+ */
+
+/* Yields the next fingerprint in ascending order; returns false when done. */
+typedef bool (*fp_source)(void *arg, uint64_t *fp);
+
+struct qf_builder {
+	PMEMobjpool *qb_pop;
+	uint64_t *qb_dst;		/* the new table */
+	struct qf_view qb_buf;		/* the table's layout, over the window */
+	uint64_t qb_base;		/* first slot in the window, multiple of 64 */
+	uint64_t qb_cap;		/* slots in the window, multiple of 64 */
+	uint64_t qb_unit;		/* words per 64 slots */
+	uint64_t qb_nslots;
+	uint64_t *qb_tail;		/* classic fingerprints that wrap, see build_classic() */
+	size_t qb_ntail;
+};
+
+/* Write the window's slots below keep (rounded down to 64) to the table. */
+static void builder_flush(struct qf_builder *b, uint64_t keep)
+{
+	uint64_t n = (keep - b->qb_base) / 64;
+	if (n == 0) {
+		return;
+	}
+	if (n > b->qb_cap / 64) {
+		/* Gaps are written out too; the new table is not zeroed. */
+		n = b->qb_cap / 64;
+	}
+
+	uint64_t *buf = b->qb_buf.qfv_table;
+	pmemobj_memcpy(b->qb_pop, b->qb_dst + b->qb_base / 64 * b->qb_unit, buf,
+			n * b->qb_unit * sizeof(uint64_t),
+			PMEMOBJ_F_MEM_NONTEMPORAL | PMEMOBJ_F_MEM_NODRAIN);
+
+	uint64_t left = b->qb_cap / 64 - n;
+	memmove(buf, buf + n * b->qb_unit, left * b->qb_unit * sizeof(uint64_t));
+	memset(buf + left * b->qb_unit, 0, n * b->qb_unit * sizeof(uint64_t));
+	b->qb_base += n * 64;
+}
+
+/*
+ * Make slot s addressable in the window, keeping every slot from keep on.
+ * Returns the index of s in the window, or -1 on ENOMEM.
+ */
+static int64_t builder_slot(struct qf_builder *b, uint64_t s, uint64_t keep)
+{
+	while (s >= b->qb_base + b->qb_cap) {
+		uint64_t floor = keep & ~(uint64_t)63;
+		if (floor > b->qb_base) {
+			builder_flush(b, floor);
+			continue;
+		}
+
+		/* A cluster longer than the window: grow it. */
+		size_t words = b->qb_cap / 64 * b->qb_unit;
+		uint64_t *buf = (uint64_t *)realloc(b->qb_buf.qfv_table,
+				2 * words * sizeof(uint64_t));
+		if (buf == NULL) {
+			return -1;
+		}
+		memset(buf + words, 0, words * sizeof(uint64_t));
+		b->qb_buf.qfv_table = buf;
+		b->qb_cap *= 2;
+	}
+	return (int64_t)(s - b->qb_base);
+}
+
+/* Lay a classic table out; returns the slots used, or -1 on failure. */
+static int64_t build_classic(struct qf_builder *b, fp_source next, void *arg)
+{
+	const struct qf_view *v = &b->qb_buf;
+	uint64_t pos = 0;		/* first slot after the runs laid out */
+	uint64_t prev = 0;
+	uint64_t count = 0;
+	size_t tcap = 0;
+	bool first = true;
+	uint64_t fp;
+
+	while (next(arg, &fp)) {
+		if (!first && fp <= prev) {
+			if (fp < prev) {
+				return -1;	/* not sorted */
+			}
+			continue;
+		}
+
+		uint64_t fq = hash_to_quotient(v, fp);
+		uint64_t fr = hash_to_remainder(v, fp);
+		bool new_run = first || fq != hash_to_quotient(v, prev);
+		uint64_t s = new_run ? MAX(pos, fq) : pos;
+		first = false;
+		prev = fp;
+
+		if (s >= v->qfv_max_size) {
+			/* The rest would wrap; insert it afterwards. */
+			if (b->qb_ntail == tcap) {
+				tcap = tcap ? 2 * tcap : 64;
+				uint64_t *t = (uint64_t *)realloc(b->qb_tail, tcap * sizeof(uint64_t));
+				if (t == NULL) {
+					return -1;
+				}
+				b->qb_tail = t;
+			}
+			b->qb_tail[b->qb_ntail++] = fp;
+			continue;
+		}
+
+		int64_t ws = builder_slot(b, s, fq);
+		if (ws < 0) {
+			return -1;
+		}
+		uint64_t elt = fr << 3;
+		if (!new_run) {
+			elt = set_shifted(set_continuation(elt));
+		} else if (s != fq) {
+			elt = set_shifted(elt);
+		}
+		set_elem(v, ws, elt);
+
+		if (new_run) {
+			uint64_t wq = fq - b->qb_base;
+			set_elem(v, wq, set_occupied(get_elem(v, wq)));
+		}
+		pos = s + 1;
+		++count;
+	}
+	return (int64_t)count;
+}
+
+/* Lay a blocked table out; returns the entries, or -1 on failure. */
+static int64_t build_blocked(struct qf_builder *b, fp_source next, void *arg)
+{
+	const struct qf_view *v = &b->qb_buf;
+	uint64_t pos = 0;
+	uint64_t prev = 0;
+	uint64_t count = 0;
+	uint64_t done_blocks = 1;	/* blocks whose offset is final; 0 is always 0 */
+	bool first = true;
+	uint64_t fp;
+
+	while (next(arg, &fp)) {
+		if (!first && fp <= prev) {
+			if (fp < prev) {
+				return -1;
+			}
+			continue;
+		}
+
+		uint64_t fq = hash_to_quotient(v, fp);
+		uint64_t fr = hash_to_remainder(v, fp);
+		bool new_run = first || fq != hash_to_quotient(v, prev);
+		uint64_t s = new_run ? MAX(pos, fq) : pos;
+		uint64_t keep = first ? 0 : hash_to_quotient(v, prev);
+		first = false;
+		prev = fp;
+
+		if (s >= v->qfv_nslots) {
+			return -1;
+		}
+
+		/* Every quotient below this block's start has been laid out. */
+		for (; done_blocks <= fq / QF_BLOCK_SLOTS; ++done_blocks) {
+			uint64_t start = done_blocks * QF_BLOCK_SLOTS;
+			int64_t ws = builder_slot(b, start, keep);
+			if (ws < 0) {
+				return -1;
+			}
+			blk_block(v, ws / QF_BLOCK_SLOTS)[BLK_OFFSET] =
+					(pos > start) ? pos - start : 0;
+		}
+
+		int64_t ws = builder_slot(b, s, fq);
+		if (ws < 0) {
+			return -1;
+		}
+		blk_set_rem(v, ws, fr);
+		if (!new_run) {
+			blk_put_bit(v, BLK_RUNENDS, ws - 1, false);
+		}
+		blk_put_bit(v, BLK_RUNENDS, ws, true);
+		blk_put_bit(v, BLK_OCCUPIEDS, fq - b->qb_base, true);
+		pos = s + 1;
+		++count;
+	}
+
+	/* Runs spilling into the blocks after the last quotient. */
+	for (; done_blocks < v->qfv_nslots / QF_BLOCK_SLOTS; ++done_blocks) {
+		uint64_t start = done_blocks * QF_BLOCK_SLOTS;
+		if (pos <= start) {
+			break;
+		}
+		int64_t ws = builder_slot(b, start, start);
+		if (ws < 0) {
+			return -1;
+		}
+		blk_block(v, ws / QF_BLOCK_SLOTS)[BLK_OFFSET] = pos - start;
+	}
+	return (int64_t)count;
+}
+
+/*
+ * Replace the contents of qf with the fingerprints next yields, which must
+ * come in ascending order (repeats are dropped). The parameters and format
+ * of qf are kept.
+ */
+//需要写入，分配内存，不是根API
+static bool build_table(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		uint32_t q, uint32_t r, uint8_t format, fp_source next, void *arg)
+{
+	size_t bytes = table_bytes(format, q, r);
+	struct qf_builder b;
+	volatile bool ret = false;
+
+	qfv_layout(&b.qb_buf, q, r, format);
+	b.qb_pop = pop;
+	b.qb_base = 0;
+	b.qb_nslots = b.qb_buf.qfv_nslots;
+	b.qb_unit = (format == QF_FORMAT_BLOCKED) ?
+			b.qb_buf.qfv_block_words : b.qb_buf.qfv_elem_bits;
+	b.qb_cap = QF_BUILD_CHUNK;
+	b.qb_tail = NULL;
+	b.qb_ntail = 0;
+	b.qb_buf.qfv_table = (uint64_t *)calloc(b.qb_cap / 64 * b.qb_unit,
+			sizeof(uint64_t));
+	if (b.qb_buf.qfv_table == NULL) {
+		return false;
+	}
+
+	TX_BEGIN(pop) {
+		//新表不需要添加到undo log，失败时事务会释放它
+		TOID(uint64_t) table = TX_ALLOC(uint64_t, bytes);
+		b.qb_dst = D_RW(table);
+
+		int64_t count;
+		if (format == QF_FORMAT_BLOCKED) {
+			count = build_blocked(&b, next, arg);
+		} else {
+			count = build_classic(&b, next, arg);
+		}
+		if (count < 0 || (uint64_t)count + b.qb_ntail > b.qb_buf.qfv_max_size) {
+			pmemobj_tx_abort(-1);
+		}
+
+		/* Write out the window, then the zeroes up to the end. */
+		uint64_t nslots = (b.qb_buf.qfv_format == QF_FORMAT_BLOCKED) ?
+				b.qb_nslots : (bytes / sizeof(uint64_t)) / b.qb_unit * 64;
+		while (b.qb_base + b.qb_cap <= nslots) {
+			builder_flush(&b, b.qb_base + b.qb_cap);
+		}
+		size_t done = b.qb_base / 64 * b.qb_unit;
+		pmemobj_memcpy(pop, b.qb_dst + done, b.qb_buf.qfv_table,
+				bytes - done * sizeof(uint64_t),
+				PMEMOBJ_F_MEM_NONTEMPORAL | PMEMOBJ_F_MEM_NODRAIN);
+		pmemobj_drain(pop);
+
+		//源可能还在读旧表，所以直到这里才改写头部
+		TX_ADD(qf);
+		TX_FREE(D_RO(qf)->qf_table);
+		set_header(qf, q, r, format);
+		D_RW(qf)->qf_table = table;
+		D_RW(qf)->qf_entries = count;
+
+		/* The tail wrapped around the end of the table. */
+		struct qf_view v;
+		qfv_init(qf, &v);
+		v.qfv_limit = v.qfv_max_size;
+		for (size_t i = 0; i < b.qb_ntail; ++i) {
+			insert_hash(qf, &v, b.qb_tail[i]);
+		}
+	} TX_ONCOMMIT {
+		ret = true;
+	} TX_FINALLY {
+		//在调用者的事务里中止时，TX_END之后的代码不会执行
+		free(b.qb_buf.qfv_table);
+		free(b.qb_tail);
+	} TX_END;
+
+	return ret;
+}
+
+/* A sorted array of hashes as a fingerprint source. */
+struct array_source {
+	const uint64_t *as_hashes;
+	size_t as_n;
+	size_t as_i;
+	uint64_t as_mask;
+};
+
+static bool array_next(void *arg, uint64_t *fp)
+{
+	struct array_source *a = (struct array_source *)arg;
+	if (a->as_i == a->as_n) {
+		return false;
+	}
+	*fp = a->as_hashes[a->as_i++] & a->as_mask;
+	return true;
+}
+
+//需要写入，分配内存，是根API
+bool qf_build_from_sorted(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const uint64_t *hashes, size_t n)
+{
+	struct array_source a;
+
+	if (D_RO(qf)->qf_counting) {
+		//builder按指纹排布，不会写计数器
+		return false;
+	}
+	a.as_hashes = hashes;
+	a.as_n = n;
+	a.as_i = 0;
+	a.as_mask = LOW_MASK(D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits);
+
+	volatile bool ret = true;
+	TX_BEGIN(pop) {
+		//暂存的插入属于被替换掉的内容，和新表一起提交
+		TX_ADD_FIELD(qf, qf_log_len);
+		D_RW(qf)->qf_log_len = 0;
+		if (!build_table(pop, qf, D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits,
+				D_RO(qf)->qf_format, array_next, &a)) {
+			pmemobj_tx_abort(-1);
+		}
+	} TX_ONABORT {
+		ret = false;
+	} TX_END;
+	return ret;
+}
+
+/*
+ * Sort the low bits of n keys with an LSD radix sort, 11 bits per pass.
+ * tmp must hold n keys. The higher bits of the keys are cleared.
+ */
+static void radix_sort(uint64_t *keys, uint64_t *tmp, size_t n, uint32_t bits)
+{
+	uint64_t mask = LOW_MASK(bits);
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		keys[i] &= mask;
+	}
+	for (uint32_t shift = 0; shift < bits; shift += 11) {
+		size_t counts[1 << 11] = {0};
+		for (i = 0; i < n; ++i) {
+			++counts[(keys[i] >> shift) & 0x7ff];
+		}
+		size_t sum = 0;
+		for (i = 0; i < (1 << 11); ++i) {
+			size_t c = counts[i];
+			counts[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; ++i) {
+			tmp[counts[(keys[i] >> shift) & 0x7ff]++] = keys[i];
+		}
+		uint64_t *t = keys;
+		keys = tmp;
+		tmp = t;
+	}
+	if (((bits + 10) / 11) % 2) {
+		/* An odd number of passes left the result in tmp. */
+		memcpy(tmp, keys, n * sizeof(uint64_t));
+	}
+}
+
+//需要写入，分配内存，是根API
+bool qf_build(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		const uint64_t *hashes, size_t n)
+{
+	uint64_t *keys = (uint64_t *)malloc(2 * (n ? n : 1) * sizeof(uint64_t));
+	if (keys == NULL) {
+		return false;
+	}
+
+	memcpy(keys, hashes, n * sizeof(uint64_t));
+	radix_sort(keys, keys + n, n, D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits);
+	bool ret = qf_build_from_sorted(pop, qf, keys, n);
+	free(keys);
+	return ret;
+}
+
+//并发部分：多个写者按区域加锁，读者按区域做乐观的seqlock校验
+//需要写入，是根API
+bool qf_sync_init(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		struct qf_sync *s)
+{
+	if (!qf_open(pop, qf) || D_RO(qf)->qf_format != QF_FORMAT_CLASSIC ||
+			D_RO(qf)->qf_counting || D_RO(qf)->qf_log_len) {
+		return false;
+	}
+
+	s->qs_pop = pop;
+	s->qs_qf = qf;
+	qfv_init(qf, &s->qs_view);
+	s->qs_nregions = (s->qs_view.qfv_max_size + QF_SYNC_REGION_SLOTS - 1) /
+			QF_SYNC_REGION_SLOTS;
+	s->qs_seqs = (uint64_t *)calloc(s->qs_nregions, sizeof(uint64_t));
+	s->qs_begun = 0;
+	s->qs_done = 0;
+	s->qs_reserved = D_RO(qf)->qf_entries;
+	s->qs_hdr_lock = 0;
+	return s->qs_seqs != NULL;
+}
+
+void qf_sync_fini(struct qf_sync *s)
+{
+	free(s->qs_seqs);
+	s->qs_seqs = NULL;
+	s->qs_nregions = 0;
+}
+
+/*
+ * Lock regions first..last. A region's sequence number doubles as its
+ * lock: odd means a writer holds it, which is also what tells lookups to
+ * retry.
+ */
+static void lock_regions(struct qf_sync *s, uint64_t first, uint64_t last)
+{
+	unsigned spins = 0;
+
+	for (uint64_t r = first; r <= last; ++r) {
+		uint64_t *seq = &s->qs_seqs[r];
+		for (;;) {
+			uint64_t cur = __atomic_load_n(seq, __ATOMIC_RELAXED);
+			if (!(cur & 1) && __atomic_compare_exchange_n(seq, &cur, cur + 1,
+					false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				break;
+			}
+			spin_pause(&spins);
+		}
+	}
+}
+
+static void unlock_regions(struct qf_sync *s, uint64_t first, uint64_t last)
+{
+	for (uint64_t r = first; r <= last; ++r) {
+		__atomic_store_n(&s->qs_seqs[r], s->qs_seqs[r] + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * Lock (or unlock) the regions holding slots [lo, hi], wrapping if
+ * hi < lo. Locks are always taken in ascending region order, so writers
+ * with overlapping spans cannot deadlock.
+ */
+static void sync_lock(struct qf_sync *s, uint64_t lo, uint64_t hi, bool lock)
+{
+	void (*fn)(struct qf_sync *, uint64_t, uint64_t) =
+			lock ? lock_regions : unlock_regions;
+	uint64_t first = lo >> QF_SYNC_REGION_SHIFT;
+	uint64_t last = hi >> QF_SYNC_REGION_SHIFT;
+
+	if (hi >= lo) {
+		fn(s, first, last);
+	} else if (last >= first) {
+		/* The span wraps all the way around. */
+		fn(s, 0, s->qs_nregions - 1);
+	} else {
+		fn(s, 0, last);
+		fn(s, first, s->qs_nregions - 1);
+	}
+}
+
+/* Returns true if the locked span [fq, hi] covers slots [fq, e]. */
+static bool sync_covers(const struct qf_sync *s, uint64_t fq, uint64_t hi,
+		uint64_t e)
+{
+	const struct qf_view *v = &s->qs_view;
+	uint64_t end = hi | (QF_SYNC_REGION_SLOTS - 1);
+
+	if (hi < fq && (hi >> QF_SYNC_REGION_SHIFT) >= (fq >> QF_SYNC_REGION_SHIFT)) {
+		return true;
+	}
+	if (end >= v->qfv_max_size) {
+		end = v->qfv_max_size - 1;
+	}
+	return ((e - fq) & v->qfv_index_mask) <= ((end - fq) & v->qfv_index_mask);
+}
+
+static void hdr_lock(struct qf_sync *s)
+{
+	unsigned spins = 0;
+	while (__atomic_exchange_n(&s->qs_hdr_lock, 1, __ATOMIC_ACQUIRE)) {
+		spin_pause(&spins);
+	}
+}
+
+static void hdr_unlock(struct qf_sync *s)
+{
+	__atomic_store_n(&s->qs_hdr_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Insert (insert is true) or remove hash with the regions it can rewrite
+ * locked, in a transaction of the calling thread.
+ *
+ * Inserts and removes only rewrite the slots from the canonical slot to
+ * the end of its cluster, [fq, first empty slot], and only read the
+ * cluster before fq, which nobody can rewrite without also locking fq's
+ * region. The span is found before locking, so it is checked again under
+ * the locks and the locking is redone if the cluster grew meanwhile.
+ *
+ * qf_entries is shared by every writer, so it is only snapshotted and
+ * updated under qs_hdr_lock, which is then held until the transaction is
+ * over; otherwise one thread's undo log could hold another's update.
+ */
+static bool sync_update(struct qf_sync *s, uint64_t hash, bool insert)
+{
+	const struct qf_view *v = &s->qs_view;
+	TOID(struct quotient_filter) qf = s->qs_qf;
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t hi = find_empty_slot(v, fq);
+
+	__atomic_fetch_add(&s->qs_begun, 1, __ATOMIC_SEQ_CST);
+	for (;;) {
+		sync_lock(s, fq, hi, true);
+		uint64_t e = find_empty_slot(v, fq);
+		if (sync_covers(s, fq, hi, e)) {
+			break;
+		}
+		sync_lock(s, fq, hi, false);
+		hi = e;
+	}
+
+	volatile bool hdr = false;
+	volatile int delta = 0;
+	bool ret = false;
+
+	QF_COUNT(qc_tx, 1);
+	TX_BEGIN(s->qs_pop) {
+		if (insert) {
+			int added = insert_fp(v, hash);
+			delta = (added > 0) ? 1 : 0;
+			ret = added >= 0;
+		} else {
+			delta = remove_fp(v, hash) ? -1 : 0;
+			ret = true;
+		}
+		if (delta) {
+			hdr_lock(s);
+			hdr = true;
+			TX_ADD_FIELD(qf, qf_entries);
+			D_RW(qf)->qf_entries += delta;
+		}
+	} TX_ONABORT {
+		QF_COUNT(qc_tx_aborts, 1);
+		ret = false;
+		delta = 0;
+	} TX_END;
+
+	if (insert && delta) {
+		QF_COUNT(qc_inserts, 1);
+	}
+	if (hdr) {
+		hdr_unlock(s);
+	}
+	sync_lock(s, fq, hi, false);
+	__atomic_fetch_add(&s->qs_done, 1, __ATOMIC_RELEASE);
+
+	/* Give back the room qf_sync_insert() reserved if nothing was added. */
+	if ((insert && delta <= 0) || delta < 0) {
+		__atomic_fetch_sub(&s->qs_reserved, 1, __ATOMIC_RELAXED);
+	}
+	return ret;
+}
+
+//需要写入，是根API，可并发
+bool qf_sync_insert(struct qf_sync *s, uint64_t hash)
+{
+	/* Reserve room first so that concurrent inserts cannot overfill. */
+	uint64_t n = __atomic_load_n(&s->qs_reserved, __ATOMIC_RELAXED);
+	do {
+		if (n >= s->qs_view.qfv_limit) {
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&s->qs_reserved, &n, n + 1, false,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return sync_update(s, hash, true);
+}
+
+//需要写入，是根API，可并发
+bool qf_sync_remove(struct qf_sync *s, uint64_t hash)
+{
+	const struct qf_view *v = &s->qs_view;
+	if (hash & ~LOW_MASK(v->qfv_qbits + v->qfv_rbits)) {
+		return false;
+	}
+	return sync_update(s, hash, false);
+}
+
+//只读，冲突时重试
+bool qf_sync_may_contain(const struct qf_sync *s, uint64_t hash)
+{
+	struct seq_reader rd;
+	bool global = false;
+	unsigned spins = 0;
+
+	for (;;) {
+		seq_reader_start(&rd, s, global);
+		bool ret = classic_may_contain(&s->qs_view, &rd, hash);
+		if (seq_reader_valid(&rd)) {
+			return ret;
+		}
+		global = global || rd.sr_overflow;
+		spin_pause(&spins);
+	}
+}
+
+/*
+ * Volatile backends. A qf_mem runs the engine above over a DRAM table
+ * whose view is marked QF_BACKEND_DRAM or QF_BACKEND_HYBRID, so
+ * log_words() skips it and updates need no transaction. The entry count
+ * lives in the handle instead of a pmem header.
+ */
+
+/* Allocate a zeroed, cache-line aligned table for m. */
+//分配易失内存
+static bool mem_alloc(struct qf_mem *m, size_t bytes)
+{
+	void *table;
+	if (posix_memalign(&table, 64, bytes) != 0) {
+		return false;
+	}
+	memset(table, 0, bytes);
+	m->qm_view.qfv_table = (uint64_t *)table;
+	m->qm_entries = 0;
+	m->qm_pop = NULL;
+	m->qm_qf = TOID_NULL(struct quotient_filter);
+	return true;
+}
+
+//分配易失内存
+static bool mem_init_format(struct qf_mem *m, uint32_t q, uint32_t r,
+		uint8_t format, bool counting)
+{
+	if (!qf_params_valid(q, r)) {
+		return false;
+	}
+	qfv_layout(&m->qm_view, q, r, format);
+	m->qm_view.qfv_counting = counting;
+	return mem_alloc(m, table_bytes(format, q, r));
+}
+
+bool qf_mem_init(struct qf_mem *m, uint32_t q, uint32_t r)
+{
+	return mem_init_format(m, q, r, QF_FORMAT_CLASSIC, false);
+}
+
+bool qf_mem_init_blocked(struct qf_mem *m, uint32_t q, uint32_t r)
+{
+	return mem_init_format(m, q, r, QF_FORMAT_BLOCKED, false);
+}
+
+bool qf_mem_init_counting(struct qf_mem *m, uint32_t q, uint32_t r)
+{
+	if (r < 2) {
+		return false;
+	}
+	return mem_init_format(m, q, r, QF_FORMAT_CLASSIC, true);
+}
+
+//只读，把pmem中的表复制到DRAM
+bool qf_mem_open(struct qf_mem *m, PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	if (!qf_open(pop, qf) || D_RO(qf)->qf_log_len) {
+		return false;
+	}
+
+	const struct quotient_filter *f = D_RO(qf);
+	size_t bytes = table_bytes(f->qf_format, f->qf_qbits, f->qf_rbits);
+	qfv_init(qf, &m->qm_pview);
+	m->qm_view = m->qm_pview;
+	if (!mem_alloc(m, bytes)) {
+		return false;
+	}
+	memcpy(m->qm_view.qfv_table, m->qm_pview.qfv_table, bytes);
+	m->qm_view.qfv_backend = QF_BACKEND_HYBRID;
+	m->qm_entries = f->qf_entries;
+	m->qm_pop = pop;
+	m->qm_qf = qf;
+	return true;
+}
+
+void qf_mem_fini(struct qf_mem *m)
+{
+	free(m->qm_view.qfv_table);
+	m->qm_view.qfv_table = NULL;
+	m->qm_entries = 0;
+}
+
+/*
+ * Insert (or remove) count occurrences of hash through m. A hybrid handle
+ * updates the pmem QF first; the engine is deterministic, so replaying
+ * the update on the copy once the transaction committed leaves both
+ * tables alike. Returns what insert_hash_count() (or remove_hash_count())
+ * returned, and false (or -1) if the transaction aborted.
+ */
+//需要写入，不是根API
+static int mem_update(struct qf_mem *m, uint64_t hash, uint64_t count, bool insert)
+{
+	if (m->qm_view.qfv_backend == QF_BACKEND_HYBRID) {
+		TOID(struct quotient_filter) qf = m->qm_qf;
+		bool committed = false;
+
+		QF_COUNT(qc_tx, 1);
+		TX_BEGIN(m->qm_pop) {
+			TX_ADD_FIELD(qf, qf_entries);
+			if (insert) {
+				insert_hash_count(&D_RW(qf)->qf_entries, &m->qm_pview, hash, count);
+			} else {
+				remove_hash_count(&D_RW(qf)->qf_entries, &m->qm_pview, hash, count);
+			}
+		} TX_ONCOMMIT {
+			committed = true;
+		} TX_END;
+
+		if (!committed) {
+			QF_COUNT(qc_tx_aborts, 1);
+			return insert ? 0 : -1;
+		}
+	}
+
+	if (insert) {
+		return insert_hash_count(&m->qm_entries, &m->qm_view, hash, count);
+	}
+	return remove_hash_count(&m->qm_entries, &m->qm_view, hash, count);
+}
+
+//需要写入
+bool qf_mem_insert(struct qf_mem *m, uint64_t hash)
+{
+	return mem_update(m, hash, 1, true);
+}
+
+//需要写入
+bool qf_mem_insert_count(struct qf_mem *m, uint64_t hash, uint64_t count)
+{
+	if (count == 0) {
+		return false;
+	}
+	return mem_update(m, hash, count, true);
+}
+
+//需要写入
+bool qf_mem_remove(struct qf_mem *m, uint64_t hash)
+{
+	return qf_mem_remove_count(m, hash, 1);
+}
+
+//需要写入
+bool qf_mem_remove_count(struct qf_mem *m, uint64_t hash, uint64_t count)
+{
+	uint64_t highbits = hash & ~LOW_MASK(m->qm_view.qfv_qbits + m->qm_view.qfv_rbits);
+	if (highbits || count == 0) {
+		return false;
+	}
+	return mem_update(m, hash, count, false) >= 0;
+}
+
+//不需写入
+bool qf_mem_may_contain(const struct qf_mem *m, uint64_t hash)
+{
+	return qfv_may_contain(&m->qm_view, hash);
+}
+
+//不需写入
+uint64_t qf_mem_count(const struct qf_mem *m, uint64_t hash)
+{
+	return view_count(&m->qm_view, hash);
+}
+
+/*
+ * Metadata tier. The mirror is a view of its own over a DRAM table that
+ * keeps everything but the remainders: a classic table with r = 0, whose
+ * 3-bit slots hold only the flags, or blocked blocks cut short before
+ * their remainder words. find_run_index() and the blk_ functions run on
+ * it unchanged, and the remainders come from the pmem view.
+ */
+
+/* Lay out the mirror of the pmem view t->qt_view. */
+static void tier_layout(struct qf_tier *t)
+{
+	const struct qf_view *v = &t->qt_view;
+	struct qf_view *mv = &t->qt_meta;
+
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		*mv = *v;
+		mv->qfv_block_words = BLK_REMAINDERS;
+	} else {
+		qfv_layout(mv, v->qfv_qbits, 0, QF_FORMAT_CLASSIC);
+		mv->qfv_limit = v->qfv_limit;
+	}
+	mv->qfv_table = NULL;
+	mv->qfv_backend = QF_BACKEND_DRAM;
+}
+
+/* Copy the metadata of slots [lo, hi] (which may wrap) to the mirror. */
+//写入易失内存
+static void tier_refresh(struct qf_tier *t, uint64_t lo, uint64_t hi)
+{
+	const struct qf_view *v = &t->qt_view;
+	const struct qf_view *mv = &t->qt_meta;
+
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		uint64_t last = MAX(lo, hi) / QF_BLOCK_SLOTS;
+		uint64_t nblocks = v->qfv_nslots / QF_BLOCK_SLOTS;
+		last = (last < nblocks) ? last : nblocks - 1;
+		for (uint64_t b = lo / QF_BLOCK_SLOTS; b <= last; ++b) {
+			memcpy(blk_block(mv, b), blk_block(v, b),
+					BLK_REMAINDERS * sizeof(uint64_t));
+		}
+		return;
+	}
+
+	for (uint64_t s = lo; ; s = incr(v, s)) {
+		set_elem(mv, s, get_elem(v, s));
+		if (s == hi) {
+			break;
+		}
+	}
+}
+
+/*
+ * Return the last slot an update at quotient fq may rewrite: up to the
+ * first empty slot after fq, as the update itself snapshots. Read from
+ * the mirror, before the update.
+ */
+//不需写入
+static uint64_t tier_reach(const struct qf_tier *t, uint64_t fq)
+{
+	const struct qf_view *mv = &t->qt_meta;
+	if (mv->qfv_format == QF_FORMAT_BLOCKED) {
+		return blk_find_empty(mv, fq);
+	}
+	return find_empty_slot(mv, fq);
+}
+
+//只读，分配易失内存
+bool qf_tier_open(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+		struct qf_tier *t)
+{
+	if (!qf_open(pop, qf) || D_RO(qf)->qf_counting || D_RO(qf)->qf_log_len) {
+		//计数QF的余数里还有计数器，元数据不足以找到一组
+		return false;
+	}
+
+	t->qt_pop = pop;
+	t->qt_qf = qf;
+	qfv_init(qf, &t->qt_view);
+	tier_layout(t);
+
+	const struct qf_view *v = &t->qt_view;
+	size_t bytes = (v->qfv_format == QF_FORMAT_BLOCKED) ?
+			table_bytes(QF_FORMAT_BLOCKED, v->qfv_qbits, 0) :
+			qf_table_size(v->qfv_qbits, 0);
+	t->qt_meta.qfv_table = (uint64_t *)calloc(bytes / sizeof(uint64_t),
+			sizeof(uint64_t));
+	if (t->qt_meta.qfv_table == NULL) {
+		return false;
+	}
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		tier_refresh(t, 0, v->qfv_nslots - 1);
+	} else {
+		tier_refresh(t, 0, v->qfv_max_size - 1);
+	}
+	return true;
+}
+
+void qf_tier_fini(struct qf_tier *t)
+{
+	free(t->qt_meta.qfv_table);
+	t->qt_meta.qfv_table = NULL;
+}
+
+//不需写入
+bool qf_tier_may_contain(const struct qf_tier *t, uint64_t hash)
+{
+	const struct qf_view *v = &t->qt_view;
+	const struct qf_view *mv = &t->qt_meta;
+
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		return blk_lookup(mv, v, hash);
+	}
+
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t fr = hash_to_remainder(v, hash);
+	uint64_t k;
+
+	QF_COUNT(qc_lookups, 1);
+	if (!is_occupied(load_window(mv, NULL, fq, 1, &k))) {
+		return false;
+	}
+
+	/* Find the run and its length in the mirror. */
+	uint64_t s = find_run_index(mv, NULL, fq);
+	uint64_t len = 0;
+	uint64_t idx = s;
+	bool first = true;
+	for (;;) {
+		uint64_t w = load_window(mv, NULL, idx, mv->qfv_max_size, &k);
+		uint64_t ends = ~w & (mv->qfv_lsbs << 1) & LOW_MASK(k * mv->qfv_elem_bits);
+		if (first) {
+			ends &= ~LOW_MASK(mv->qfv_elem_bits);
+		}
+		if (ends) {
+			len += __builtin_ctzll(ends) / mv->qfv_elem_bits;
+			break;
+		}
+		len += k;
+		idx = (idx + k) & mv->qfv_index_mask;
+		first = false;
+	}
+	QF_COUNT(qc_scan_slots, len);
+
+	/* Only the remainders of the run come from pmem. */
+	uint64_t bits = v->qfv_elem_bits;
+	while (len) {
+		uint64_t w = load_window(v, NULL, s, len, &k);
+		if (swar_match(w, fr, v->qfv_lsbs, bits, 3, v->qfv_rbits, k)) {
+			return true;
+		}
+		if (get_remainder(w >> ((k - 1) * bits)) > fr) {
+			/* The run is sorted. */
+			return false;
+		}
+		len -= k;
+		s = (s + k) & v->qfv_index_mask;
+	}
+	return false;
+}
+
+/* Insert or remove hash through t, then refresh what the update touched. */
+//需要写入，不是根API
+static bool tier_update(struct qf_tier *t, uint64_t hash, bool insert)
+{
+	const struct qf_view *v = &t->qt_view;
+	TOID(struct quotient_filter) qf = t->qt_qf;
+	uint64_t fq = hash_to_quotient(v, hash);
+	uint64_t hi = tier_reach(t, fq);
+	bool committed = false;
+	bool ret = false;
+
+	QF_COUNT(qc_tx, 1);
+	TX_BEGIN(t->qt_pop) {
+		TX_ADD_FIELD(qf, qf_entries);
+		if (insert) {
+			ret = insert_hash_count(&D_RW(qf)->qf_entries, v, hash, 1);
+		} else {
+			ret = remove_hash_count(&D_RW(qf)->qf_entries, v, hash, 1) >= 0;
+		}
+	} TX_ONCOMMIT {
+		committed = true;
+	} TX_END;
+
+	if (!committed) {
+		QF_COUNT(qc_tx_aborts, 1);
+		return false;
+	}
+	tier_refresh(t, fq, hi);
+	return ret;
+}
+
+//需要写入
+bool qf_tier_insert(struct qf_tier *t, uint64_t hash)
+{
+	return tier_update(t, hash, true);
+}
+
+//需要写入
+bool qf_tier_remove(struct qf_tier *t, uint64_t hash)
+{
+	uint64_t highbits = hash & ~LOW_MASK(t->qt_view.qfv_qbits + t->qt_view.qfv_rbits);
+	if (highbits) {
+		return false;
+	}
+	return tier_update(t, hash, false);
 }
 
 //清空QF的存储空间，是根API
 void qf_clear(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
 {
-    TX_BEGIN(pop) {
-        //要修改qf的qf_entries字段
-        //TX_ADD_FIELD(qf,qf_entries);
-		TX_ADD(qf);
-        D_RW(qf)->qf_entries = 0;
+    TX_BEGIN(pop) {
+        //要修改qf的qf_entries字段
+        //TX_ADD_FIELD(qf,qf_entries);
+		TX_ADD(qf);
+        D_RW(qf)->qf_entries = 0;
+		D_RW(qf)->qf_log_len = 0;
+
+        //要修改qf_table中的内容
+        //pmemobj_tx_add_range_direct(D_RO(qf)->qf_table,
+            //qf_table_size(D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits));
+        TX_MEMSET(D_RW(D_RO(qf)->qf_table), 0, table_bytes(D_RO(qf)->qf_format,
+            D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits));
+        
+    } TX_END;
+
+}
+
+//销毁QF，是根API
+void qf_destroy(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+    TX_BEGIN(pop) {
+        //分配和释放内存都要添加整个qf
+        TX_ADD(qf);
+        TX_FREE(D_RO(qf)->qf_table);
+        D_RW(qf)->qf_table = TOID_NULL(uint64_t);
+		TX_FREE(D_RO(qf)->qf_log);
+		D_RW(qf)->qf_log = TOID_NULL(uint64_t);
+		D_RW(qf)->qf_log_cap = 0;
+		D_RW(qf)->qf_log_len = 0;
+        D_RW(qf)->qf_magic = 0;
+    } TX_END; 
+}
+
+//QF的存储空间，即2^q*(r+3)，返回向上取整到uint64_t的字节大小
+//表总是以uint64_t为单位读写和加入undo log，所以按字取整
+size_t qf_table_size(uint32_t q, uint32_t r)
+{
+	uint64_t words;
+	if (q >= 6) {
+		//2^q*(r+3)在q很大时会溢出64位，直接按字计算
+		words = (1ULL << (q - 6)) * (r + 3);
+	} else {
+		words = ((1ULL << q) * (r + 3) + 63) / 64;
+	}
+	return words * sizeof(uint64_t);
+}
+
+//迭代部分
+/*
+ * Iterators walk the table in slot order from the start of a cluster, so
+ * they know the quotient of every run they pass. An iterator yields the
+ * fingerprints whose quotient lies in qfi_lo + [0, qfi_span) modulo the
+ * table size, and always holds the next one in qfi_peek: it is done as
+ * soon as the walk reaches a quotient outside the range or has visited
+ * every entry.
+ */
+
+/*
+ * Return the fingerprint of the next used slot (for a counting QF, the
+ * next group) after i and step i past it. The QF must not be empty.
+ */
+//只读
+static uint64_t iter_step(const struct qf_view *v, struct qf_iterator *i)
+{
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		uint64_t s = i->qfi_index;
+		uint64_t hash = (i->qfi_quotient << v->qfv_rbits) | blk_get_rem(v, s);
+
+		if (blk_bit(v, BLK_RUNENDS, s)) {
+			/* The next run belongs to the next occupied quotient. */
+			i->qfi_quotient = blk_next_bit(v, BLK_OCCUPIEDS, i->qfi_quotient + 1);
+			i->qfi_index = MAX(s + 1, i->qfi_quotient);
+		} else {
+			i->qfi_index = s + 1;
+		}
+		++i->qfi_visited;
+		return hash;
+	}
+
+	//空槽不影响当前run，一次跳过一个窗口
+	i->qfi_index = next_nonempty(v, i->qfi_index);
+	uint64_t elt = get_elem(v, i->qfi_index);
+
+	/* Keep track of the current run. */
+	if (is_cluster_start(elt)) {
+		i->qfi_quotient = i->qfi_index;
+	} else if (is_run_start(elt)) {
+		uint64_t quot = i->qfi_quotient;
+		do {
+			quot = incr(v, quot);
+		} while (!is_occupied(get_elem(v, quot)));
+		i->qfi_quotient = quot;
+	}
+
+	uint64_t hash = (i->qfi_quotient << v->qfv_rbits) | get_remainder(elt);
+	if (v->qfv_counting) {
+		//计数模式下跳过整个组，组内的计数器槽不是指纹
+		uint64_t len;
+		cnt_decode(v, i->qfi_index, &len);
+		i->qfi_index = cnt_slot(v, i->qfi_index, len);
+		i->qfi_visited += len;
+	} else {
+		i->qfi_index = incr(v, i->qfi_index);
+		++i->qfi_visited;
+	}
+	return hash;
+}
+
+/* Whether i may step again: its walk has not run off the QF. */
+//只读
+static bool iter_more(const struct qf_view *v, const struct qf_iterator *i,
+		uint64_t entries)
+{
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		return i->qfi_quotient < v->qfv_max_size;
+	}
+	return i->qfi_visited < entries;
+}
+
+/* Load the next fingerprint of i into qfi_peek, if it is in range. */
+//只读
+static void iter_fill(const struct qf_view *v, struct qf_iterator *i,
+		uint64_t entries)
+{
+	i->qfi_more = false;
+	if (iter_more(v, i, entries)) {
+		uint64_t hash = iter_step(v, i);
+		uint64_t d = (hash_to_quotient(v, hash) - i->qfi_lo) & v->qfv_index_mask;
+		if (d < i->qfi_span) {
+			i->qfi_peek = hash;
+			i->qfi_more = true;
+		}
+	}
+}
+
+/* Point i at the fingerprints with quotients lo + [0, span), span >= 1. */
+//只读
+static void iter_seek(TOID(struct quotient_filter) qf, struct qf_iterator *i,
+		uint64_t lo, uint64_t span)
+{
+	uint64_t entries = D_RO(qf)->qf_entries;
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	i->qfi_visited = 0;
+	i->qfi_lo = lo;
+	i->qfi_span = span;
+	i->qfi_more = false;
+	if (entries == 0) {
+		return;
+	}
+
+	if (v.qfv_format == QF_FORMAT_BLOCKED) {
+		/* Runs never wrap: go straight to the first occupied quotient. */
+		i->qfi_quotient = blk_next_bit(&v, BLK_OCCUPIEDS, lo);
+		if (i->qfi_quotient < v.qfv_max_size) {
+			i->qfi_index = blk_run_start(&v, i->qfi_quotient,
+					blk_run_limit(&v, i->qfi_quotient) - 1);
+		}
+		iter_fill(&v, i, entries);
+		return;
+	}
+
+	/* Back up to the start of the cluster around slot lo. */
+	uint64_t c = lo;
+	for (uint64_t n = 0; n < v.qfv_max_size; ++n) {
+		uint64_t elt = get_elem(&v, c);
+		if (is_empty_element(elt) || is_cluster_start(elt)) {
+			break;
+		}
+		c = decr(&v, c);
+	}
+	i->qfi_index = c;
+	i->qfi_quotient = c;
+
+	/*
+	 * Skip the runs of the cluster that come before quotient lo. For the
+	 * whole table these are the runs wrapped around from its end, so they
+	 * do not count: the walk comes back to them last.
+	 */
+	uint64_t skip = (lo - c) & v.qfv_index_mask;
+	while (iter_more(&v, i, entries)) {
+		uint64_t skipped = i->qfi_visited;
+		uint64_t hash = iter_step(&v, i);
+		uint64_t quot = hash_to_quotient(&v, hash);
+		if (((quot - c) & v.qfv_index_mask) >= skip) {
+			i->qfi_visited -= skipped;
+			if (((quot - lo) & v.qfv_index_mask) < span) {
+				i->qfi_peek = hash;
+				i->qfi_more = true;
+			}
+			return;
+		}
+	}
+}
+
+void qfi_start(TOID(struct quotient_filter) qf, struct qf_iterator *i)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	uint64_t start = 0;
+
+	if (f->qf_entries && f->qf_format != QF_FORMAT_BLOCKED) {
+		/* Find the start of a cluster. */
+		struct qf_view v;
+		qfv_init(qf, &v);
+		for (start = 0; start < v.qfv_max_size; ++start) {
+			if (is_cluster_start(get_elem(&v, start))) {
+				break;
+			}
+		}
+		if (start == v.qfv_max_size) {
+			start = 0;
+		}
+	}
+	iter_seek(qf, i, start, f->qf_max_size);
+}
+
+//只读
+void qfi_seek(TOID(struct quotient_filter) qf, struct qf_iterator *i,
+		uint64_t quotient)
+{
+	uint64_t max = D_RO(qf)->qf_max_size;
+	if (quotient >= max) {
+		i->qfi_more = false;
+		return;
+	}
+	iter_seek(qf, i, quotient, max - quotient);
+}
+
+//只读
+bool qf_range_iter(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+		struct qf_iterator *i)
+{
+	if (qlo > qhi || qhi > D_RO(qf)->qf_max_size) {
+		return false;
+	}
+	if (qlo == qhi) {
+		i->qfi_more = false;
+		return true;
+	}
+	iter_seek(qf, i, qlo, qhi - qlo);
+	return true;
+}
+
+bool qfi_done(TOID(struct quotient_filter) qf, struct qf_iterator *i)
+{
+	return !i->qfi_more;
+}
+
+uint64_t qfi_next(TOID(struct quotient_filter) qf, struct qf_iterator *i)
+{
+	uint64_t hash = i->qfi_peek;
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	iter_fill(&v, i, D_RO(qf)->qf_entries);
+	return hash;
+}
+
+/*
+ * Whether a partition may begin at quotient b: nothing stored at or after
+ * slot b belongs to a quotient before b.
+ */
+//只读
+static bool partition_bound(const struct qf_view *v, uint64_t b)
+{
+	if (v->qfv_format == QF_FORMAT_BLOCKED) {
+		//块的offset为0说明没有run从前一块溢出到这一块
+		return b % QF_BLOCK_SLOTS == 0 && blk_block(v, b / QF_BLOCK_SLOTS)[BLK_OFFSET] == 0;
+	}
+	uint64_t elt = get_elem(v, b);
+	return is_empty_element(elt) || is_cluster_start(elt);
+}
+
+//只读
+size_t qf_partitions(TOID(struct quotient_filter) qf, size_t n, uint64_t *bounds)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+	uint64_t max = v.qfv_max_size;
+	uint64_t step = (v.qfv_format == QF_FORMAT_BLOCKED) ? QF_BLOCK_SLOTS : 1;
+	size_t parts = 0;
+
+	if (n == 0) {
+		n = 1;
+	}
+	if (n > max / step) {
+		n = MAX(max / step, 1);
+	}
+
+	bounds[0] = 0;
+	for (size_t k = 1; k < n; ++k) {
+		//在[k/n, (k+1)/n)内找第一个簇边界，找不到就与下一个分区合并
+		uint64_t lo = (uint64_t)((unsigned __int128)max * k / n);
+		uint64_t hi = (uint64_t)((unsigned __int128)max * (k + 1) / n);
+		lo = (lo + step - 1) / step * step;
+		lo = MAX(lo, bounds[parts] + step);
+		for (uint64_t b = lo; b < hi; b += step) {
+			if (partition_bound(&v, b)) {
+				bounds[++parts] = b;
+				break;
+			}
+		}
+	}
+	bounds[++parts] = max;
+	return parts;
+}
+
+struct par_task {
+	TOID(struct quotient_filter) pt_qf;
+	uint64_t pt_lo;
+	uint64_t pt_hi;
+	int (*pt_fn)(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+			void *arg);
+	void *pt_arg;
+	int pt_ret;
+	pthread_t pt_thread;
+	bool pt_started;
+};
+
+static void *par_run(void *p)
+{
+	struct par_task *t = (struct par_task *)p;
+	t->pt_ret = t->pt_fn(t->pt_qf, t->pt_lo, t->pt_hi, t->pt_arg);
+	return NULL;
+}
+
+/* Calls fn on the parts ranges of bounds, the first in the calling thread. */
+static int par_for(TOID(struct quotient_filter) qf, const uint64_t *bounds, size_t parts,
+		int (*fn)(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+				void *arg),
+		void *arg)
+{
+	struct par_task *tasks = (struct par_task *)calloc(parts, sizeof(*tasks));
+	if (tasks == NULL) {
+		return -1;
+	}
+
+	for (size_t k = 0; k < parts; ++k) {
+		struct par_task *t = &tasks[k];
+		t->pt_qf = qf;
+		t->pt_lo = bounds[k];
+		t->pt_hi = bounds[k + 1];
+		t->pt_fn = fn;
+		t->pt_arg = arg;
+		//第0个分区由调用者自己的线程做，线程建不起来时也就地做
+		t->pt_started = k > 0 && pthread_create(&t->pt_thread, NULL, par_run, t) == 0;
+	}
+
+	int ret = 0;
+	for (size_t k = 0; k < parts; ++k) {
+		struct par_task *t = &tasks[k];
+		if (t->pt_started) {
+			pthread_join(t->pt_thread, NULL);
+		} else {
+			par_run(t);
+		}
+		if (ret == 0) {
+			ret = t->pt_ret;
+		}
+	}
+
+	free(tasks);
+	return ret;
+}
+
+static unsigned online_cpus(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cpus > 0) ? (unsigned)cpus : 1;
+}
+
+//只读，是否写入取决于fn
+int qf_parallel_for(TOID(struct quotient_filter) qf, unsigned nthreads,
+		int (*fn)(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+				void *arg),
+		void *arg)
+{
+	if (nthreads == 0) {
+		nthreads = online_cpus();
+	}
+
+	uint64_t *bounds = (uint64_t *)malloc((nthreads + 1) * sizeof(uint64_t));
+	if (bounds == NULL) {
+		return -1;
+	}
+	int ret = par_for(qf, bounds, qf_partitions(qf, nthreads, bounds), fn, arg);
+	free(bounds);
+	return ret;
+}
+
+/*
+ * Checking and repair. qf_partitions() cuts at cluster starts, which is
+ * what the metadata says; a checker cannot take its word for it, so it
+ * cuts a classic table at all-zero slots and walks the slots in ring
+ * order from one of them, and cuts a blocked table at blocks whose offset
+ * is 0. A damaged cluster takes the cluster before it along, into a
+ * stretch of slots that qf_repair() clears and fills again.
+ */
+
+/* A stretch of slots to rebuild, ring positions lo to hi (exclusive). */
+struct check_range {
+	uint64_t cr_lo;
+	uint64_t cr_hi;
+	uint64_t cr_used;	/* used slots of the intact clusters it took along */
+};
+
+/* A cluster as the walk saw it. */
+struct check_unit {
+	uint64_t cu_lo;
+	uint64_t cu_hi;
+	uint64_t cu_used;
+	bool cu_bad;
+};
+
+/* What one thread found in its range. */
+struct check_part {
+	struct check_range *cp_bad;
+	size_t cp_nbad;
+	size_t cp_cap;
+	uint64_t cp_used;	/* used slots of intact clusters */
+	size_t cp_nunits;
+	struct check_unit cp_first;
+	struct check_unit cp_last;
+	bool cp_spill;	/* the last run reaches into the next range */
+	bool cp_oom;
+};
+
+struct check_ctx {
+	struct qf_view cc_view;
+	uint64_t cc_base;	/* slot at ring position 0 */
+	uint64_t *cc_bounds;
+	size_t cc_parts;
+	struct check_part *cc_part;
+	unsigned cc_flags;
+};
+
+/* Fingerprints read back from the stretches being rebuilt. */
+struct fp_list {
+	uint64_t *fl_fps;
+	size_t fl_n;
+	size_t fl_cap;
+	uint64_t fl_salvaged;
+	bool fl_oom;
+};
+
+static inline uint64_t check_slot(const struct check_ctx *c, uint64_t pos)
+{
+	if (c->cc_view.qfv_format == QF_FORMAT_BLOCKED) {
+		return pos;
+	}
+	return (c->cc_base + pos) & c->cc_view.qfv_index_mask;
+}
+
+static void fl_push(const struct check_ctx *c, struct fp_list *fl, uint64_t quot,
+		uint64_t rem)
+{
+	if (fl->fl_n == fl->fl_cap) {
+		size_t cap = fl->fl_cap ? 2 * fl->fl_cap : 256;
+		uint64_t *fps = (uint64_t *)realloc(fl->fl_fps, cap * sizeof(uint64_t));
+		if (fps == NULL) {
+			fl->fl_oom = true;
+			return;
+		}
+		fl->fl_fps = fps;
+		fl->fl_cap = cap;
+	}
+	fl->fl_fps[fl->fl_n++] = (check_slot(c, quot) << c->cc_view.qfv_rbits) | rem;
+}
+
+/*
+ * Decode the classic cluster at positions [lo, hi): runs go to the
+ * occupied quotients in order. Strict also wants the shifted bits and the
+ * order of remainders right; fl, if not NULL, gets the fingerprints.
+ */
+static bool classic_unit(const struct check_ctx *c, uint64_t lo, uint64_t hi,
+		bool strict, struct fp_list *fl)
+{
+	const struct qf_view *v = &c->cc_view;
+	uint64_t qp = lo;	/* first position that may still be owed a run */
+	uint64_t quot = lo;
+	uint64_t prev = 0;
+
+	for (uint64_t pos = lo; pos < hi; ++pos) {
+		uint64_t elt = get_elem(v, check_slot(c, pos));
+		uint64_t rem = get_remainder(elt);
+		if (!is_continuation(elt)) {
+			while (qp <= pos && !is_occupied(get_elem(v, check_slot(c, qp)))) {
+				++qp;
+			}
+			if (qp > pos || (strict && (is_shifted(elt) != 0) != (qp != pos))) {
+				return false;
+			}
+			quot = qp++;
+		} else if (pos == lo || (strict && (!is_shifted(elt) ||
+				(!v->qfv_counting && rem <= prev)))) {
+			return false;
+		}
+		prev = rem;
+		if (fl != NULL) {
+			fl_push(c, fl, quot, rem);
+		}
+	}
+	for (; qp < hi; ++qp) {
+		if (is_occupied(get_elem(v, check_slot(c, qp)))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//区间[lo, hi)内没有runend，余数都是0
+static bool blk_gap_empty(const struct qf_view *v, uint64_t lo, uint64_t hi)
+{
+	if (lo < hi && blk_next_bit(v, BLK_RUNENDS, lo) < hi) {
+		return false;
+	}
+	for (uint64_t s = lo; s < hi; ++s) {
+		if (blk_get_rem(v, s) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//run内的余数严格递增
+static bool blk_sorted(const struct qf_view *v, uint64_t start, uint64_t end)
+{
+	for (uint64_t s = start + 1; s <= end; ++s) {
+		if (blk_get_rem(v, s) <= blk_get_rem(v, s - 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Decode the blocked cluster at slots [lo, hi) without looking at the
+ * offsets or the order of remainders, into fl.
+ */
+static bool blk_unit(const struct check_ctx *c, uint64_t lo, uint64_t hi,
+		struct fp_list *fl)
+{
+	const struct qf_view *v = &c->cc_view;
+	uint64_t used = lo;
+
+	for (uint64_t quot = blk_next_bit(v, BLK_OCCUPIEDS, lo); quot < hi;
+			quot = blk_next_bit(v, BLK_OCCUPIEDS, quot + 1)) {
+		uint64_t start = MAX(quot, used);
+		uint64_t end = blk_next_bit(v, BLK_RUNENDS, start);
+		if (quot >= v->qfv_max_size || end >= hi) {
+			return false;
+		}
+		for (uint64_t s = start; s <= end; ++s) {
+			fl_push(c, fl, quot, blk_get_rem(v, s));
+		}
+		used = end + 1;
+	}
+	return used >= hi || blk_next_bit(v, BLK_RUNENDS, used) >= hi;
+}
+
+/*
+ * Whether blocked slot s seems to hold a remainder. Empty slots read as
+ * remainders of 0, and remainders ascend within a run, so a 0 counts
+ * only at the head of a run that goes on: after a runend or another
+ * remainder, or on an occupied quotient.
+ */
+static bool blk_holds(const struct qf_view *v, uint64_t s)
+{
+	if (blk_get_rem(v, s) != 0 || blk_bit(v, BLK_RUNENDS, s)) {
+		return true;
+	}
+	if (s + 1 >= v->qfv_nslots || blk_get_rem(v, s + 1) == 0) {
+		return false;
+	}
+	return s == 0 || blk_bit(v, BLK_RUNENDS, s - 1) || blk_get_rem(v, s - 1) != 0 ||
+			(s < v->qfv_max_size && blk_bit(v, BLK_OCCUPIEDS, s));
+}
+
+/*
+ * Read back a cluster that does not decode. Runs still come in the order
+ * of their quotients, so the k-th run of the stretch from rlo goes to the
+ * k-th occupied quotient, and to the ones before and after it in case a
+ * bit was lost or gained ahead of it.
+ */
+static void salvage(const struct check_ctx *c, uint64_t rlo,
+		const struct check_unit *u, struct fp_list *fl)
+{
+	const struct qf_view *v = &c->cc_view;
+	bool blocked = (v->qfv_format == QF_FORMAT_BLOCKED);
+	uint64_t *occ = (uint64_t *)malloc((u->cu_hi - rlo) * sizeof(uint64_t));
+	size_t nocc = 0;
+	size_t k = 0;	/* runs begun before pos */
+	uint64_t run = u->cu_lo;
+
+	if (occ == NULL) {
+		fl->fl_oom = true;
+		return;
+	}
+	for (uint64_t pos = rlo; pos < u->cu_hi; ++pos) {
+		if (blocked ? (pos < v->qfv_max_size && blk_bit(v, BLK_OCCUPIEDS, pos)) :
+				is_occupied(get_elem(v, check_slot(c, pos)))) {
+			occ[nocc++] = pos;
+		}
+	}
+	for (uint64_t pos = rlo; pos < u->cu_lo; ++pos) {
+		uint64_t elt = blocked ? 0 : get_elem(v, check_slot(c, pos));
+		if (blocked ? blk_bit(v, BLK_RUNENDS, pos) : (elt != 0 && !is_continuation(elt))) {
+			++k;
+		}
+	}
+
+	for (uint64_t pos = u->cu_lo; pos < u->cu_hi; ++pos) {
+		uint64_t rem;
+		size_t kk = k;
+		if (blocked) {
+			if (!blk_holds(v, pos)) {
+				continue;
+			}
+			rem = blk_get_rem(v, pos);
+			if (blk_bit(v, BLK_RUNENDS, pos)) {
+				++k;
+			}
+		} else {
+			uint64_t elt = get_elem(v, check_slot(c, pos));
+			rem = get_remainder(elt);
+			if (!is_continuation(elt)) {
+				run = pos;
+				kk = k++;
+			} else if (kk > 0) {
+				--kk;
+			}
+		}
+
+		bool owned = false;
+		for (size_t i = (kk > 0) ? kk - 1 : 0; i <= kk + 1 && i < nocc; ++i) {
+			if (occ[i] <= pos) {
+				fl_push(c, fl, occ[i], rem);
+				owned = true;
+			}
+		}
+		if (!owned && (!blocked || pos < v->qfv_max_size)) {
+			fl_push(c, fl, blocked ? pos : run, rem);
+		}
+	}
+	free(occ);
+}
+
+/*
+ * Record a cluster the walk is done with. A damaged one goes into a
+ * stretch with the cluster before it, or extends the stretch that
+ * cluster is already in.
+ */
+static bool check_close(struct check_part *p, const struct check_unit *u)
+{
+	if (!u->cu_bad) {
+		p->cp_used += u->cu_used;
+	} else if (p->cp_nbad > 0 && p->cp_bad[p->cp_nbad - 1].cr_hi == p->cp_last.cu_hi) {
+		p->cp_bad[p->cp_nbad - 1].cr_hi = u->cu_hi;
+	} else {
+		if (p->cp_nbad == p->cp_cap) {
+			size_t cap = p->cp_cap ? 2 * p->cp_cap : 16;
+			struct check_range *bad = (struct check_range *)realloc(p->cp_bad,
+					cap * sizeof(*bad));
+			if (bad == NULL) {
+				p->cp_oom = true;
+				return false;
+			}
+			p->cp_bad = bad;
+			p->cp_cap = cap;
+		}
+		struct check_range *r = &p->cp_bad[p->cp_nbad++];
+		r->cr_lo = p->cp_nunits ? p->cp_last.cu_lo : u->cu_lo;
+		r->cr_hi = u->cu_hi;
+		r->cr_used = p->cp_nunits ? p->cp_last.cu_used : 0;
+	}
+	if (p->cp_nunits++ == 0) {
+		p->cp_first = *u;
+	}
+	p->cp_last = *u;
+	return true;
+}
+
+/*
+ * A cluster is done: checking records it in p, repairing reads it back
+ * into fl (rlo is where the stretch began). Returns false to stop.
+ */
+static bool unit_done(const struct check_ctx *c, struct check_part *p,
+		struct fp_list *fl, uint64_t rlo, const struct check_unit *u)
+{
+	if (fl == NULL) {
+		return check_close(p, u) && !(u->cu_bad && (c->cc_flags & QF_CHECK_FIRST));
+	}
+
+	size_t n = fl->fl_n;
+	bool exact = (c->cc_view.qfv_format == QF_FORMAT_BLOCKED) ?
+			blk_unit(c, u->cu_lo, u->cu_hi, fl) :
+			classic_unit(c, u->cu_lo, u->cu_hi, false, fl);
+	if (!exact) {
+		fl->fl_n = n;
+		++fl->fl_salvaged;
+		salvage(c, rlo, u, fl);
+	}
+	return !fl->fl_oom;
+}
+
+//只读，依次检查ring位置[lo, hi)中的簇
+static bool classic_walk(const struct check_ctx *c, uint64_t lo, uint64_t hi,
+		struct check_part *p, struct fp_list *fl)
+{
+	const struct qf_view *v = &c->cc_view;
+	uint64_t pos = lo;
 
-        //要修改qf_table中的内容
-        //pmemobj_tx_add_range_direct(D_RO(qf)->qf_table,
-            //qf_table_size(D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits));
-        TX_MEMSET(D_RO(qf)->qf_table, 0, 
-            qf_table_size(D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits));
-        
-    } TX_END;
+	while (pos < hi) {
+		if (get_elem(v, check_slot(c, pos)) == 0) {
+			++pos;
+			continue;
+		}
+		struct check_unit u;
+		u.cu_lo = pos;
+		while (pos < hi && get_elem(v, check_slot(c, pos)) != 0) {
+			++pos;
+		}
+		u.cu_hi = pos;
+		u.cu_used = pos - u.cu_lo;
+		u.cu_bad = !classic_unit(c, u.cu_lo, u.cu_hi, true, NULL);
+		if (!unit_done(c, p, fl, lo, &u)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Walk the blocks of slots [lo, hi), block-aligned, where lo takes no
+ * run from before. A cluster ends at a block whose offset is 0, and any
+ * other offset must say how far the runs reach. Checking cuts there even
+ * if a run reaches past, so that one bad run does not throw off the rest
+ * of the table (the cluster after it is damaged too, and taken along);
+ * reading back a stretch lets the runs go on.
+ */
+static bool blk_walk(const struct check_ctx *c, uint64_t lo, uint64_t hi,
+		struct check_part *p, struct fp_list *fl)
+{
+	const struct qf_view *v = &c->cc_view;
+	struct check_unit u = {lo, lo, 0, false};
+	uint64_t used = lo;
+
+	for (uint64_t first = lo; first < hi; first += QF_BLOCK_SLOTS) {
+		const uint64_t *blk = blk_block(v, first / QF_BLOCK_SLOTS);
+		uint64_t expect = (used > first) ? used - first : 0;
+		if (first > u.cu_lo && blk[BLK_OFFSET] == 0 && (fl == NULL || expect == 0)) {
+			u.cu_bad |= (expect != 0) || !blk_gap_empty(v, used, first);
+			u.cu_hi = first;
+			if (!unit_done(c, p, fl, lo, &u)) {
+				return false;
+			}
+			u.cu_lo = first;
+			u.cu_used = 0;
+			u.cu_bad = (expect != 0);
+			used = first;
+		} else if (blk[BLK_OFFSET] != expect) {
+			u.cu_bad = true;
+		}
+
+		for (uint64_t occ = blk[BLK_OCCUPIEDS]; occ; occ &= occ - 1) {
+			uint64_t quot = first + __builtin_ctzll(occ);
+			uint64_t start = MAX(quot, used);
+			uint64_t end = blk_next_bit(v, BLK_RUNENDS, start);
+			if (quot >= v->qfv_max_size || end >= v->qfv_nslots) {
+				u.cu_bad = true;
+				continue;
+			}
+			u.cu_bad |= !blk_gap_empty(v, used, start) || !blk_sorted(v, start, end);
+			u.cu_used += end - start + 1;
+			used = end + 1;
+		}
+	}
 
+	if (used > hi) {
+		//最后的run伸进了下一个范围
+		u.cu_bad = true;
+		if (p != NULL) {
+			p->cp_spill = true;
+		}
+	} else {
+		u.cu_bad |= !blk_gap_empty(v, used, hi);
+	}
+	u.cu_hi = hi;
+	return unit_done(c, p, fl, lo, &u);
 }
 
-//销毁QF，是根API
-void qf_destroy(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+static int check_fn(TOID(struct quotient_filter) qf, uint64_t lo, uint64_t hi, void *arg)
 {
-    TX_BEGIN(pop) {
-        //分配和释放内存都要添加整个qf
-        TX_ADD(qf);
-        TX_FREE(qf_table_toid);
-        D_RW(qf)->qf_table=NULL;
-    } TX_END; 
+	(void)qf;	/* everything is read through cc_view */
+	struct check_ctx *c = (struct check_ctx *)arg;
+	size_t k = 0;
+	while (c->cc_bounds[k] != lo) {
+		++k;
+	}
+	struct check_part *p = &c->cc_part[k];
+
+	if (c->cc_view.qfv_format == QF_FORMAT_BLOCKED) {
+		blk_walk(c, lo, hi, p, NULL);
+	} else {
+		classic_walk(c, lo, hi, p, NULL);
+	}
+	return p->cp_oom ? -1 : 0;
 }
 
-//QF的存储空间，即2^q*(r+3)，返回向上取整的字节大小
-size_t qf_table_size(uint32_t q, uint32_t r)
+/*
+ * Pick the ring base and cut the table into at most n ranges for the
+ * check threads. Every cut falls on an all-zero slot (classic) or on a
+ * block with offset 0 (blocked); without one, ranges merge.
+ */
+static size_t check_bounds(struct check_ctx *c, size_t n)
 {
-	size_t bits = (1 << q) * (r + 3);
-	size_t bytes = bits / 8;
-	return (bits % 8) ? (bytes + 1) : bytes;
+	const struct qf_view *v = &c->cc_view;
+	bool blocked = (v->qfv_format == QF_FORMAT_BLOCKED);
+	uint64_t end = blocked ? v->qfv_nslots : v->qfv_max_size;
+	uint64_t step = blocked ? QF_BLOCK_SLOTS : 1;
+	size_t parts = 0;
+
+	c->cc_base = 0;
+	if (!blocked) {
+		uint64_t s = 0;
+		while (s < end && get_elem(v, s) != 0) {
+			++s;
+		}
+		if (s == end) {
+			//一个空槽都没有，整张表是一个簇，从某个簇头开始
+			for (s = 0; s < end && !is_cluster_start(get_elem(v, s)); ++s) {
+			}
+			c->cc_base = (s < end) ? s : 0;
+			n = 1;
+		} else {
+			c->cc_base = s;
+		}
+	}
+	if (n > end / step) {
+		n = end / step;
+	}
+
+	c->cc_bounds[0] = 0;
+	for (size_t k = 1; k < n; ++k) {
+		uint64_t lo = (uint64_t)((unsigned __int128)end * k / n);
+		uint64_t hi = (uint64_t)((unsigned __int128)end * (k + 1) / n);
+		lo = (lo + step - 1) / step * step;
+		lo = MAX(lo, c->cc_bounds[parts] + step);
+		for (uint64_t b = lo; b < hi; b += step) {
+			if (blocked ? blk_block(v, b / QF_BLOCK_SLOTS)[BLK_OFFSET] == 0 :
+					get_elem(v, check_slot(c, b)) == 0) {
+				c->cc_bounds[++parts] = b;
+				break;
+			}
+		}
+	}
+	c->cc_bounds[++parts] = end;
+	return parts;
 }
 
-//根API，需要写入
-bool qf_merge(PMEMobjpool *pop, TOID(struct quotient_filter) qf1, 
-	TOID(struct quotient_filter) qf2, TOID(struct quotient_filter) qfout)
+/* Append r to the stretches, merging it into the last one if they touch. */
+static bool range_add(struct check_range **rs, size_t *n, size_t *cap,
+		const struct check_range *r)
 {
-	uint32_t q = 1 + MAX(D_RO(qf1)->qf_qbits, D_RO(qf2)->qf_qbits);
-	uint32_t r = MAX(D_RO(qf1)->qf_rbits, D_RO(qf2)->qf_rbits);
+	if (*n > 0 && (*rs)[*n - 1].cr_hi >= r->cr_lo) {
+		struct check_range *last = &(*rs)[*n - 1];
+		last->cr_hi = MAX(last->cr_hi, r->cr_hi);
+		last->cr_used += r->cr_used;
+		return true;
+	}
+	if (*n == *cap) {
+		size_t c = *cap ? 2 * *cap : 16;
+		struct check_range *p = (struct check_range *)realloc(*rs, c * sizeof(*p));
+		if (p == NULL) {
+			return false;
+		}
+		*rs = p;
+		*cap = c;
+	}
+	(*rs)[(*n)++] = *r;
+	return true;
+}
 
-	bool ret;
-	struct qf_iterator qfi;
+/*
+ * Check qf into c and gather the damaged stretches, in ring order, into
+ * *rs (to be freed). *clean gets the used slots outside them.
+ */
+static int check_table(TOID(struct quotient_filter) qf, unsigned flags,
+		struct check_ctx *c, struct check_range **rs, size_t *nrs, uint64_t *clean)
+{
+	size_t n = (flags & QF_CHECK_PARALLEL) ? online_cpus() : 1;
+	size_t cap = 0;
+	int ret = -1;
 
-	TX_BEGIN(pop) {
-		if (!qf_init(pop,qfout, q, r)) {
-			pmemobj_tx_abort(-1);
+	qfv_init(qf, &c->cc_view);
+	c->cc_flags = flags;
+	c->cc_bounds = (uint64_t *)malloc((n + 1) * sizeof(uint64_t));
+	c->cc_part = (struct check_part *)calloc(n, sizeof(struct check_part));
+	*rs = NULL;
+	*nrs = 0;
+	*clean = 0;
+	if (c->cc_bounds == NULL || c->cc_part == NULL) {
+		goto out;
+	}
+	c->cc_parts = check_bounds(c, n);
+	if (par_for(qf, c->cc_bounds, c->cc_parts, check_fn, c) != 0) {
+		goto out;
+	}
+
+	for (size_t k = 0; k < c->cc_parts; ++k) {
+		const struct check_part *p = &c->cc_part[k];
+		const struct check_part *prev = NULL;
+		size_t i = 0;
+
+		*clean += p->cp_used;
+		for (size_t j = k; j-- > 0 && prev == NULL; ) {
+			if (c->cc_part[j].cp_nunits > 0) {
+				prev = &c->cc_part[j];
+			}
 		}
-		qfi_start(qf1, &qfi);
-		while (!qfi_done(qf1, &qfi)) {
-			qf_insert(pop,qfout, qfi_next(qf1, &qfi));
+		if (p->cp_nunits > 0 && (p->cp_first.cu_bad || (k > 0 && c->cc_part[k - 1].cp_spill))) {
+			//本范围的第一个簇坏了，或者上一个范围的run伸了进来：带上前一个簇
+			struct check_range r;
+			if (p->cp_nbad > 0 && p->cp_bad[0].cr_lo == p->cp_first.cu_lo) {
+				r = p->cp_bad[i++];
+			} else {
+				r.cr_lo = p->cp_first.cu_lo;
+				r.cr_hi = p->cp_first.cu_hi;
+				r.cr_used = p->cp_first.cu_used;
+			}
+			if (prev != NULL && !(*nrs > 0 && (*rs)[*nrs - 1].cr_hi == prev->cp_last.cu_hi)) {
+				r.cr_lo = prev->cp_last.cu_lo;
+				r.cr_used += prev->cp_last.cu_used;
+			} else if (*nrs > 0 && prev != NULL) {
+				(*rs)[*nrs - 1].cr_hi = prev->cp_last.cu_hi;
+				r.cr_lo = (*rs)[*nrs - 1].cr_hi;
+			}
+			if (!range_add(rs, nrs, &cap, &r)) {
+				goto out;
+			}
 		}
-		qfi_start(qf2, &qfi);
-		while (!qfi_done(qf2, &qfi)) {
-			qf_insert(pop,qfout, qfi_next(qf2, &qfi));
+		for (; i < p->cp_nbad; ++i) {
+			if (!range_add(rs, nrs, &cap, &p->cp_bad[i])) {
+				goto out;
+			}
 		}
-	}TX_ONABORT{
-		ret=false;
-	}TX_ONCOMMIT{
-		ret=true;
-	}TX_END;
+	}
+
+	if (c->cc_view.qfv_format == QF_FORMAT_CLASSIC && *nrs > 0) {
+		//经典格式的簇首尾相接：第一个簇坏了就带上环上最后一个簇
+		const struct check_part *first = NULL;
+		const struct check_part *last = NULL;
+		for (size_t j = 0; j < c->cc_parts; ++j) {
+			if (c->cc_part[j].cp_nunits > 0) {
+				first = (first != NULL) ? first : &c->cc_part[j];
+				last = &c->cc_part[j];
+			}
+		}
+		struct check_range *r0 = &(*rs)[0];
+		struct check_range *rl = &(*rs)[*nrs - 1];
+		if (first->cp_first.cu_bad && r0->cr_lo == first->cp_first.cu_lo &&
+				!(*nrs == 1 && rl->cr_hi == last->cp_last.cu_hi)) {
+			uint64_t size = c->cc_view.qfv_max_size;
+			if (rl->cr_hi == last->cp_last.cu_hi) {
+				rl->cr_hi = r0->cr_hi + size;
+				rl->cr_used += r0->cr_used;
+			} else {
+				struct check_range r = *r0;
+				r.cr_lo = last->cp_last.cu_lo;
+				r.cr_hi = r0->cr_hi + size;
+				r.cr_used += last->cp_last.cu_used;
+				if (!range_add(rs, nrs, &cap, &r)) {
+					goto out;
+				}
+			}
+			memmove(&(*rs)[0], &(*rs)[1], (*nrs - 1) * sizeof(**rs));
+			--*nrs;
+		}
+	}
 
+	for (size_t i = 0; i < *nrs; ++i) {
+		*clean -= (*rs)[i].cr_used;
+	}
+	ret = 0;
+out:
+	if (c->cc_part != NULL) {
+		for (size_t k = 0; k < n; ++k) {
+			free(c->cc_part[k].cp_bad);
+		}
+	}
+	free(c->cc_part);
+	free(c->cc_bounds);
+	c->cc_part = NULL;
+	c->cc_bounds = NULL;
+	if (ret != 0) {
+		free(*rs);
+		*rs = NULL;
+		*nrs = 0;
+	}
 	return ret;
 }
 
+static void check_report(const struct check_ctx *c, const struct check_range *rs,
+		size_t nrs, uint64_t clean, struct qf_check_info *info)
+{
+	if (info == NULL) {
+		return;
+	}
+	memset(info, 0, sizeof(*info));
+	info->qci_damaged = nrs;
+	info->qci_entries = clean;
+	if (nrs > 0) {
+		info->qci_first = check_slot(c, rs[0].cr_lo);
+		info->qci_len = rs[0].cr_hi - rs[0].cr_lo;
+	}
+}
+
+//只读，可并行
+int qf_check(TOID(struct quotient_filter) qf, unsigned flags,
+		struct qf_check_info *info)
+{
+	PMEMobjpool *pop = TOID_IS_NULL(qf) ? NULL : pmemobj_pool_by_oid(qf.oid);
+	struct check_ctx c;
+	struct check_range *rs;
+	size_t nrs;
+	uint64_t clean;
 
-//迭代部分，只在QF的merge中用到
-void qfi_start(TOID(struct quotient_filter) qf, struct qf_iterator *i)
+	if (pop == NULL || !qf_open(pop, qf) || check_table(qf, flags, &c, &rs, &nrs, &clean) != 0) {
+		return -1;
+	}
+	check_report(&c, rs, nrs, clean, info);
+	free(rs);
+	return (nrs > 0 || clean != D_RO(qf)->qf_entries) ? 1 : 0;
+}
+
+//需要写入，只重建坏掉的簇
+int qf_repair(PMEMobjpool *pop, TOID(struct quotient_filter) qf, unsigned flags,
+		struct qf_check_info *info)
 {
-	/* Mark the iterator as done. */
-	i->qfi_visited = D_RO(qf)->qf_entries;
+	struct check_ctx c;
+	struct check_range *rs;
+	size_t nrs;
+	uint64_t clean;
 
-	if (D_RO(qf)->qf_entries == 0) {
-		return;
+	if (!qf_open(pop, qf) ||
+			check_table(qf, flags & ~QF_CHECK_FIRST, &c, &rs, &nrs, &clean) != 0) {
+		return -1;
+	}
+	check_report(&c, rs, nrs, clean, info);
+	if (nrs == 0 && clean == D_RO(qf)->qf_entries) {
+		free(rs);
+		return 0;
+	}
+	if (nrs > 0 && D_RO(qf)->qf_counting) {
+		//计数器的位置依赖run的结构，读不回来
+		free(rs);
+		return -1;
 	}
 
-	/* Find the start of a cluster. */
-	uint64_t start;
-	for (start = 0; start < D_RO(qf)->qf_max_size; ++start) {
-		if (is_cluster_start(get_elem(qf, start))) {
-			break;
+	struct qf_view *v = &c.cc_view;
+	bool blocked = (v->qfv_format == QF_FORMAT_BLOCKED);
+	struct fp_list fl;
+	memset(&fl, 0, sizeof(fl));
+	for (size_t i = 0; i < nrs && !fl.fl_oom; ++i) {
+		if (blocked) {
+			blk_walk(&c, rs[i].cr_lo, rs[i].cr_hi, NULL, &fl);
+		} else {
+			classic_walk(&c, rs[i].cr_lo, rs[i].cr_hi, NULL, &fl);
+		}
+	}
+	if (info != NULL) {
+		info->qci_salvaged = fl.fl_salvaged;
+	}
+	if (fl.fl_oom) {
+		free(fl.fl_fps);
+		free(rs);
+		return -1;
+	}
+	if (fl.fl_n > 0) {
+		qsort(fl.fl_fps, fl.fl_n, sizeof(uint64_t), fp_cmp);
+	}
+	size_t nfps = 0;
+	for (size_t i = 0; i < fl.fl_n; ++i) {
+		if (nfps == 0 || fl.fl_fps[i] != fl.fl_fps[nfps - 1]) {
+			fl.fl_fps[nfps++] = fl.fl_fps[i];
 		}
 	}
 
-	i->qfi_visited = 0;
-	i->qfi_index = start;
+	bool committed = false;
+	QF_COUNT(qc_tx, 1);
+	TX_BEGIN(pop) {
+		TX_ADD_FIELD(qf, qf_entries);
+		for (size_t i = 0; i < nrs; ++i) {
+			uint64_t lo = rs[i].cr_lo;
+			uint64_t hi = rs[i].cr_hi;
+			if (blocked) {
+				uint64_t *first = blk_block(v, lo / QF_BLOCK_SLOTS);
+				size_t words = (hi - lo) / QF_BLOCK_SLOTS * v->qfv_block_words;
+				log_words(v, first, words);
+				memset(first, 0, words * sizeof(uint64_t));
+			} else {
+				snapshot_slots(v, check_slot(&c, lo), check_slot(&c, hi - 1));
+				for (uint64_t pos = lo; pos < hi; ++pos) {
+					set_elem(v, check_slot(&c, pos), 0);
+				}
+			}
+		}
+
+		//清空后其余的簇都完好，按普通插入放回去
+		uint64_t entries = clean;
+		v->qfv_limit = v->qfv_max_size;
+		for (size_t i = 0; i < nfps; ++i) {
+			if (!insert_hash_count(&entries, v, fl.fl_fps[i], 1)) {
+				pmemobj_tx_abort(-1);
+			}
+		}
+		D_RW(qf)->qf_entries = entries;
+	} TX_ONCOMMIT {
+		committed = true;
+	} TX_END;
+
+	if (!committed) {
+		QF_COUNT(qc_tx_aborts, 1);
+	}
+	free(fl.fl_fps);
+	free(rs);
+	return committed ? 1 : -1;
 }
 
-bool qfi_done(TOID(struct quotient_filter) qf, struct qf_iterator *i)
+/*
+ * Merging: every input is read as an ascending stream of fingerprints and
+ * the streams are merged into the builder, so the output table is written
+ * in one sequential pass instead of by a random insert per fingerprint.
+ *
+ * The iterator yields a classic QF in order of quotient, starting at the
+ * first cluster that begins at or after slot 0. A cluster that wraps
+ * around the end is visited last, so the fingerprints of its runs with
+ * small quotients come out at the very end. A cursor collects just those
+ * up front and yields them first.
+ */
+struct qf_cursor {
+	TOID(struct quotient_filter) qc_qf;
+	struct qf_iterator qc_it;
+	uint64_t qc_left;		/* still to come from the iterator */
+	uint64_t *qc_low;		/* wrapped fingerprints, ascending */
+	size_t qc_nlow;
+	size_t qc_i;
+};
+
+/* Returns false on ENOMEM; free qc_low either way. */
+static bool cursor_start(struct qf_cursor *c, TOID(struct quotient_filter) qf)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	c->qc_qf = qf;
+	c->qc_left = D_RO(qf)->qf_entries;
+	c->qc_low = NULL;
+	c->qc_nlow = 0;
+	c->qc_i = 0;
+	qfi_start(qf, &c->qc_it);
+
+	if (c->qc_left == 0 || v.qfv_format == QF_FORMAT_BLOCKED) {
+		return true;
+	}
+	uint64_t elt = get_elem(&v, 0);
+	if (is_empty_element(elt) || is_cluster_start(elt)) {
+		return true;
+	}
+
+	/* Slot 0 is in a cluster that wrapped: walk it from its start. */
+	uint64_t start = v.qfv_max_size - 1;
+	while (!is_cluster_start(get_elem(&v, start))) {
+		--start;
+	}
+	struct qf_iterator it;
+	it.qfi_index = start;
+	it.qfi_quotient = start;
+	it.qfi_visited = 0;
+	size_t cap = 0;
+	do {
+		uint64_t hash = iter_step(&v, &it);
+		if ((hash >> v.qfv_rbits) < start) {
+			if (c->qc_nlow == cap) {
+				cap = cap ? 2 * cap : 64;
+				uint64_t *low = (uint64_t *)realloc(c->qc_low,
+						cap * sizeof(uint64_t));
+				if (low == NULL) {
+					return false;
+				}
+				c->qc_low = low;
+			}
+			c->qc_low[c->qc_nlow++] = hash;
+		}
+		elt = get_elem(&v, it.qfi_index);
+	} while (!is_empty_element(elt) && !is_cluster_start(elt));
+
+	c->qc_left -= c->qc_nlow;
+	return true;
+}
+
+static bool cursor_next(struct qf_cursor *c, uint64_t *fp)
 {
-	return D_RO(qf)->qf_entries == i->qfi_visited;
+	if (c->qc_i < c->qc_nlow) {
+		*fp = c->qc_low[c->qc_i++];
+		return true;
+	}
+	if (c->qc_left == 0) {
+		return false;
+	}
+	--c->qc_left;
+	*fp = qfi_next(c->qc_qf, &c->qc_it);
+	return true;
 }
 
-uint64_t qfi_next(TOID(struct quotient_filter) qf, struct qf_iterator *i)
+/* A k-way merge of cursors, kept as a min-heap on their next fingerprint. */
+struct merge_source {
+	struct qf_cursor *ms_cur;
+	uint64_t *ms_head;		/* next fingerprint of each cursor */
+	size_t *ms_heap;		/* cursor indices */
+	size_t ms_n;
+};
+
+static void merge_sift(struct merge_source *m, size_t i)
+{
+	size_t *h = m->ms_heap;
+	for (;;) {
+		size_t min = i;
+		size_t l = 2 * i + 1;
+		if (l < m->ms_n && m->ms_head[h[l]] < m->ms_head[h[min]]) {
+			min = l;
+		}
+		if (l + 1 < m->ms_n && m->ms_head[h[l + 1]] < m->ms_head[h[min]]) {
+			min = l + 1;
+		}
+		if (min == i) {
+			return;
+		}
+		size_t t = h[i];
+		h[i] = h[min];
+		h[min] = t;
+		i = min;
+	}
+}
+
+static bool merge_next(void *arg, uint64_t *fp)
+{
+	struct merge_source *m = (struct merge_source *)arg;
+	if (m->ms_n == 0) {
+		return false;
+	}
+
+	//重复的指纹会相邻出现，由builder去重
+	size_t top = m->ms_heap[0];
+	*fp = m->ms_head[top];
+	if (!cursor_next(&m->ms_cur[top], &m->ms_head[top])) {
+		m->ms_heap[0] = m->ms_heap[--m->ms_n];
+	}
+	merge_sift(m, 0);
+	return true;
+}
+
+//根API，需要写入
+bool qf_merge_many(PMEMobjpool *pop, const TOID(struct quotient_filter) *qfs,
+		size_t k, TOID(struct quotient_filter) qfout)
 {
-	while (!qfi_done(qf, i)) {
-		uint64_t elt = get_elem(qf, i->qfi_index);
+	uint32_t q = 0;
+	uint32_t r = 0;
+	uint32_t bits = 0;
+	bool keyed = true;
+	int kind = QF_HASH_NONE;
+	uint64_t seed = 0;
+	size_t i;
 
-		/* Keep track of the current run. */
-		if (is_cluster_start(elt)) {
-			i->qfi_quotient = i->qfi_index;
+	if (k == 0) {
+		return false;
+	}
+	for (i = 0; i < k; ++i) {
+		const struct quotient_filter *f = D_RO(qfs[i]);
+		if (f->qf_counting || !qf_log_drain(pop, qfs[i])) {
+			//游标只读表，暂存的插入要先排空
+			return false;
+		}
+		if (f->qf_hash == QF_HASH_NONE) {
+			keyed = false;
+		} else if (kind != QF_HASH_NONE && (f->qf_hash != kind || f->qf_seed != seed)) {
+			//键按不同的方式哈希，合并后无法再查询
+			return false;
 		} else {
-			if (is_run_start(elt)) {
-				uint64_t quot = i->qfi_quotient;
-				do {
-					quot = incr(qf, quot);
-				} while (!is_occupied(get_elem(qf, quot)));
-				i->qfi_quotient = quot;
+			kind = f->qf_hash;
+			seed = f->qf_seed;
+		}
+		if (i > 0 && f->qf_qbits + f->qf_rbits != bits) {
+			keyed = false;
+		}
+		bits = f->qf_qbits + f->qf_rbits;
+		q = MAX(q, f->qf_qbits);
+		r = MAX(r, f->qf_rbits);
+	}
+	//k个输入各自可能是满的，输出的容量要放得下它们的总和
+	for (i = 1; i < k; i *= 2) {
+		++q;
+	}
+	if (keyed && q < bits && qf_params_valid(q, bits - q)) {
+		//和qf_resize一样保持q+r，多出的商位从余数里拿，键的哈希不变
+		r = bits - q;
+	} else {
+		//q+r变了，key_hash截出的位数跟着变，已有的指纹对不上键了
+		kind = QF_HASH_NONE;
+		seed = 0;
+	}
+	if (!qf_params_valid(q, r)) {
+		return false;
+	}
+
+	struct merge_source m;
+	m.ms_cur = (struct qf_cursor *)calloc(k, sizeof(struct qf_cursor));
+	m.ms_head = (uint64_t *)malloc(k * sizeof(uint64_t));
+	m.ms_heap = (size_t *)malloc(k * sizeof(size_t));
+	m.ms_n = 0;
+	volatile bool ret = m.ms_cur != NULL && m.ms_head != NULL && m.ms_heap != NULL;
+
+	for (i = 0; ret && i < k; ++i) {
+		if (!cursor_start(&m.ms_cur[i], qfs[i])) {
+			ret = false;
+		} else if (cursor_next(&m.ms_cur[i], &m.ms_head[i])) {
+			m.ms_heap[m.ms_n++] = i;
+		}
+	}
+	for (i = m.ms_n / 2; ret && i-- > 0; ) {
+		merge_sift(&m, i);
+	}
+
+	if (ret) {
+		TX_BEGIN(pop) {
+			//和qf_init一样不释放qfout原有的表，表由builder一次写好
+			TX_ADD(qfout);
+			D_RW(qfout)->qf_table = TOID_NULL(uint64_t);
+			D_RW(qfout)->qf_log = TOID_NULL(uint64_t);
+			D_RW(qfout)->qf_log_cap = 0;
+			D_RW(qfout)->qf_log_len = 0;
+			set_policy(qfout, 100, QF_FULL_REJECT, TOID_NULL(struct quotient_filter));
+			set_hash(qfout, kind, seed);
+			if (!build_table(pop, qfout, q, r, QF_FORMAT_CLASSIC, merge_next, &m)) {
+				pmemobj_tx_abort(-1);
 			}
+		} TX_ONABORT {
+			ret = false;
+		} TX_END;
+	}
+
+	if (m.ms_cur != NULL) {
+		for (i = 0; i < k; ++i) {
+			free(m.ms_cur[i].qc_low);
+		}
+	}
+	free(m.ms_cur);
+	free(m.ms_head);
+	free(m.ms_heap);
+	return ret;
+}
+
+//根API，需要写入
+bool qf_merge(PMEMobjpool *pop, TOID(struct quotient_filter) qf1, 
+	TOID(struct quotient_filter) qf2, TOID(struct quotient_filter) qfout)
+{
+	TOID(struct quotient_filter) qfs[2];
+	qfs[0] = qf1;
+	qfs[1] = qf2;
+	return qf_merge_many(pop, qfs, 2, qfout);
+}
+
+static bool cursor_source(void *arg, uint64_t *fp)
+{
+	return cursor_next((struct qf_cursor *)arg, fp);
+}
+
+/*
+ * Resizing keeps the q+r fingerprint bits and moves the boundary between
+ * quotient and remainder, so the stored fingerprints stay exact and come
+ * out of the old table in the order the new one needs.
+ */
+//需要写入，分配内存，是根API
+bool qf_resize(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint32_t q)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	uint32_t bits = f->qf_qbits + f->qf_rbits;
+
+	if (f->qf_counting) {
+		return false;
+	}
+	if (q == f->qf_qbits) {
+		return true;
+	}
+	if (q >= bits || !qf_params_valid(q, bits - q) || f->qf_entries > (1ULL << q)) {
+		return false;
+	}
+
+	struct qf_cursor c;
+	bool ret = cursor_start(&c, qf) &&
+			build_table(pop, qf, q, bits - q, f->qf_format, cursor_source, &c);
+	free(c.qc_low);
+	return ret;
+}
+
+//目录部分：具名的QF挂在根对象的链表上
+static TOID(struct qf_dir_entry) dir_find(PMEMobjpool *pop, const char *name,
+		TOID(struct qf_dir_entry) *prevp)
+{
+	TOID(struct my_root) root = POBJ_ROOT(pop, struct my_root);
+	TOID(struct qf_dir_entry) prev = TOID_NULL(struct qf_dir_entry);
+	TOID(struct qf_dir_entry) e;
+
+	for (e = D_RO(root)->qf_dir; !TOID_IS_NULL(e); e = D_RO(e)->qde_next) {
+		if (!strncmp(D_RO(e)->qde_name, name, QF_NAME_MAX)) {
+			break;
 		}
+		prev = e;
+	}
+	if (prevp) {
+		*prevp = prev;
+	}
+	return e;
+}
 
-		i->qfi_index = incr(qf, i->qfi_index);
+//需要写入，分配内存，是根API
+TOID(struct quotient_filter) qf_dir_create(PMEMobjpool *pop, const char *name,
+		uint32_t q, uint32_t r)
+{
+	TOID(struct quotient_filter) qf = TOID_NULL(struct quotient_filter);
+	size_t len = strlen(name);
+
+	if (len == 0 || len >= QF_NAME_MAX || !qf_params_valid(q, r)) {
+		return qf;
+	}
+	if (!TOID_IS_NULL(dir_find(pop, name, NULL))) {
+		return qf;
+	}
 
-		if (!is_empty_element(elt)) {
-			uint64_t quot = i->qfi_quotient;
-			uint64_t rem = get_remainder(elt);
-			uint64_t hash = (quot << D_RO(qf)->qf_rbits) | rem;
-			++i->qfi_visited;
-			return hash;
+	TOID(struct my_root) root = POBJ_ROOT(pop, struct my_root);
+
+	TX_BEGIN(pop) {
+		TOID(struct qf_dir_entry) e = TX_ZNEW(struct qf_dir_entry);
+		TOID(struct quotient_filter) nqf = TX_ZNEW(struct quotient_filter);
+		if (!qf_init(pop, nqf, q, r)) {
+			pmemobj_tx_abort(-1);
 		}
+
+		//新分配的对象不需要添加，只有根对象的链表头需要
+		memcpy(D_RW(e)->qde_name, name, len + 1);
+		D_RW(e)->qde_qf = nqf;
+		D_RW(e)->qde_next = D_RO(root)->qf_dir;
+		TX_ADD_FIELD(root, qf_dir);
+		D_RW(root)->qf_dir = e;
+		qf = nqf;
+	} TX_ONABORT {
+		qf = TOID_NULL(struct quotient_filter);
+	} TX_END;
+
+	return qf;
+}
+
+//只读，是根API
+TOID(struct quotient_filter) qf_dir_lookup(PMEMobjpool *pop, const char *name)
+{
+	TOID(struct qf_dir_entry) e = dir_find(pop, name, NULL);
+	if (TOID_IS_NULL(e)) {
+		return TOID_NULL(struct quotient_filter);
 	}
+	return D_RO(e)->qde_qf;
+}
+
+//只读，是根API
+int qf_dir_foreach(PMEMobjpool *pop,
+		int (*cb)(const char *name, TOID(struct quotient_filter) qf, void *arg),
+		void *arg)
+{
+	TOID(struct my_root) root = POBJ_ROOT(pop, struct my_root);
+	TOID(struct qf_dir_entry) e;
+	int ret = 0;
 
-	abort();
+	for (e = D_RO(root)->qf_dir; !TOID_IS_NULL(e); e = D_RO(e)->qde_next) {
+		ret = cb(D_RO(e)->qde_name, D_RO(e)->qde_qf, arg);
+		if (ret) {
+			break;
+		}
+	}
+	return ret;
 }
 
+//需要写入，释放内存，是根API
+bool qf_dir_drop(PMEMobjpool *pop, const char *name)
+{
+	TOID(struct qf_dir_entry) prev;
+	TOID(struct qf_dir_entry) e = dir_find(pop, name, &prev);
+	if (TOID_IS_NULL(e)) {
+		return false;
+	}
+
+	TOID(struct my_root) root = POBJ_ROOT(pop, struct my_root);
+	bool ret;
+
+	TX_BEGIN(pop) {
+		TOID(struct quotient_filter) qf = D_RO(e)->qde_qf;
+		qf_destroy(pop, qf);
+		TX_FREE(qf);
+
+		//把e从链表中摘下
+		if (TOID_IS_NULL(prev)) {
+			TX_ADD_FIELD(root, qf_dir);
+			D_RW(root)->qf_dir = D_RO(e)->qde_next;
+		} else {
+			TX_ADD_FIELD(prev, qde_next);
+			D_RW(prev)->qde_next = D_RO(e)->qde_next;
+		}
+		TX_FREE(e);
+	} TX_ONABORT {
+		ret = false;
+	} TX_ONCOMMIT {
+		ret = true;
+	} TX_END;
+
+	return ret;
+}
@@ -12,10 +12,60 @@
 
 //#define LAYOUT_NAME "pmem_qf"
 
+/* Upper bound on the number of hashes applied per batch transaction. */
+#define QF_BATCH_CHUNK 1024
+
+/* Slots a bulk build lays out in DRAM before streaming them to pmem. */
+#define QF_BUILD_CHUNK (1 << 16)
+
+/* Lookups ahead of the current one whose lines a batch prefetches. */
+#define QF_PREFETCH_DISTANCE 16
+
+/* log2 of the slots covered by one qf_sync sequence counter. */
+#define QF_SYNC_REGION_SHIFT 10
+#define QF_SYNC_REGION_SLOTS (1ULL << QF_SYNC_REGION_SHIFT)
+
+/* Table formats, see qf_init() and qf_init_blocked(). */
+#define QF_FORMAT_CLASSIC 0
+#define QF_FORMAT_BLOCKED 1
+
+/* Slots per block in the blocked format. */
+#define QF_BLOCK_SLOTS 64
+
+/* What an insert does once a QF is at its maximum load, see qf_set_max_load(). */
+#define QF_FULL_REJECT 0
+#define QF_FULL_RESIZE 1
+#define QF_FULL_SPILL 2
+
+/* How the key functions turn a key into a hash, see qf_set_hash(). */
+#define QF_HASH_WY 0
+#define QF_HASH_INVERTIBLE 1
+#define QF_HASH_NONE 2
+
+/* Kernel sets for decoding table words, see qf_set_kernels(). */
+#define QF_KERNELS_SCALAR 0
+#define QF_KERNELS_BMI2 1
+
+/* Where a view's table lives, see struct qf_view and struct qf_mem. */
+#define QF_BACKEND_PMEM 0
+#define QF_BACKEND_DRAM 1
+#define QF_BACKEND_HYBRID 2
+
+/* Buckets of the histograms in struct qf_stats. */
+#define QF_STATS_BUCKETS 32
+
+/* Longest filter name in the pool directory, including the NUL. */
+#define QF_NAME_MAX 32
+
+/* Flags of qf_check() and qf_repair(). */
+#define QF_CHECK_PARALLEL 1	/* one thread per online CPU */
+#define QF_CHECK_FIRST 2	/* stop at the first damaged cluster */
+
 POBJ_LAYOUT_BEGIN(pmem_qf);
 POBJ_LAYOUT_ROOT(pmem_qf,struct my_root);
 POBJ_LAYOUT_TOID(pmem_qf,struct quotient_filter);
 POBJ_LAYOUT_TOID(pmem_qf,uint64_t);
+POBJ_LAYOUT_TOID(pmem_qf,struct qf_dir_entry);
 POBJ_LAYOUT_END(pmem_qf);
 
 struct my_root {
@@ -24,45 +74,336 @@ struct my_root {
 	TOID(struct quotient_filter) qf2_test;
 	TOID(struct quotient_filter) qf21_test;
 	TOID(struct quotient_filter) qf22_test;
+	TOID(struct qf_dir_entry) qf_dir;//池内所有具名QF的目录
+};
+
+/* One named QF in the pool directory, a singly-linked list off the root. */
+struct qf_dir_entry {
+	TOID(struct qf_dir_entry) qde_next;
+	TOID(struct quotient_filter) qde_qf;
+	char qde_name[QF_NAME_MAX];
 };
 
 
+/* Identifies an initialized struct quotient_filter ("PMEMQF06"). */
+#define QF_MAGIC 0x363046514d454d50ULL
+
 struct quotient_filter {
     //元数据
+	uint64_t qf_magic;//qf_init写入，qf_destroy清除
 	uint8_t qf_qbits;//商长度
 	uint8_t qf_rbits;//余数长度
-	uint8_t qf_elem_bits;//整个elt长度，r+3
+	uint8_t qf_elem_bits;//整个elt长度，经典格式为r+3，分块格式为r
+	uint8_t qf_format;//QF_FORMAT_CLASSIC或QF_FORMAT_BLOCKED
+	uint8_t qf_max_load;//最大负载百分比，1到100，见qf_set_max_load
+	uint8_t qf_full_policy;//达到最大负载后插入怎么办，QF_FULL_*
+	uint8_t qf_counting;//1表示计数模式，见qf_init_counting，qf_entries此时是已用槽数
+	uint8_t qf_hash;//键的哈希函数，QF_HASH_*，见qf_set_hash
 	uint64_t qf_index_mask;//取出一个elt
 	uint64_t qf_rmask;//取出余数
 	uint64_t qf_elem_mask;//取出商
 
-    uint32_t qf_entries;//已有元素个数n？
+    uint64_t qf_entries;//已有元素个数n
 	uint64_t qf_max_size;//最多元素个数m=2^q
-    uint64_t* qf_table;
+	uint64_t qf_nblocks;//分块格式的块数（含溢出块），经典格式为0
+	uint64_t qf_seed;//键的哈希种子，所有打开这个池的进程用同一个
+    TOID(uint64_t) qf_table;//不保存虚拟地址，池每次可能映射到不同位置
+	TOID(struct quotient_filter) qf_spill;//QF_FULL_SPILL时接收插入的QF
+	TOID(uint64_t) qf_log;//暂存插入的指纹，见qf_set_log，没有日志时为NULL
+	uint64_t qf_log_cap;//日志能放的指纹数，没有日志时为0
+	uint64_t qf_log_len;//日志中的指纹数，追加时最后写入
 
     //实现是以64bit为单位，但概念上是r+3 bit为单位
 };
 
+/*
+ * A read handle on a QF that lives in volatile memory. The table pointer
+ * and the masks are resolved once by qfv_init(), so lookups through a view
+ * never go back through the PMEMoid machinery.
+ *
+ * A view is invalidated by anything that reallocates the table:
+ * qf_init(), qf_destroy(), qf_build(), qf_resize(), an insert that grows
+ * the QF (see qf_set_max_load()) and qf_merge() into the same QF. A view
+ * only sees its own table, never the QF spilled into nor the inserts
+ * staged in its log (see qf_set_log()).
+ *
+ * The slot code reads and writes tables through views alone, so the same
+ * engine runs over a pmem table, where an update adds what it rewrites to
+ * the undo log of the open transaction, and over a DRAM table, where it
+ * just stores (see struct qf_mem).
+ */
+struct qf_view {
+	uint64_t *qfv_table;
+	uint64_t qfv_index_mask;
+	uint64_t qfv_rmask;
+	uint64_t qfv_elem_mask;
+	uint64_t qfv_max_size;
+	uint64_t qfv_limit;	/* entries admitted by the maximum load */
+	uint64_t qfv_nslots;	/* slots in the table, spill blocks included */
+	uint64_t qfv_block_words;	/* words per block (blocked format only) */
+	uint64_t qfv_lsbs;	/* lowest bit of every slot that fits in a word */
+	size_t qfv_prefetch;	/* prefetch distance of batched lookups */
+	uint8_t qfv_qbits;
+	uint8_t qfv_rbits;
+	uint8_t qfv_elem_bits;
+	uint8_t qfv_format;
+	uint8_t qfv_counting;	/* runs hold counters, see qf_init_counting() */
+	uint8_t qfv_backend;	/* QF_BACKEND_*, whether updates are undo-logged */
+};
+
+/*
+ * A volatile handle for sharing a classic QF between threads: any number
+ * of threads may call qf_sync_insert(), qf_sync_remove() and
+ * qf_sync_may_contain() at once.
+ *
+ * The table is split into regions of QF_SYNC_REGION_SLOTS slots, each with
+ * a sequence counter in DRAM. An update locks the regions it can rewrite
+ * by making their counters odd, in ascending order, and runs its own
+ * transaction; updates in different clusters proceed in parallel. A lookup
+ * records the counters of the regions it reads and starts over if any of
+ * them moved, so lookups never write shared memory.
+ *
+ * The handle is only valid while nothing else updates the QF.
+ */
+struct qf_sync {
+	PMEMobjpool *qs_pop;
+	TOID(struct quotient_filter) qs_qf;
+	struct qf_view qs_view;
+	uint64_t *qs_seqs;	/* one sequence counter (and lock) per region */
+	uint64_t qs_nregions;
+	uint64_t qs_begun;	/* updates started */
+	uint64_t qs_done;	/* updates finished */
+	uint64_t qs_reserved;	/* entries plus inserts in flight */
+	uint32_t qs_hdr_lock;	/* serializes updates of qf_entries */
+};
+
+/*
+ * A volatile handle on a QF whose table is in DRAM. It runs on the same
+ * engine as a pmem QF, so the same updates leave the same table words,
+ * and the view in qm_view works with every qfv_ function.
+ *
+ * QF_BACKEND_DRAM: set up by qf_mem_init() and friends. Updates are plain
+ *	stores without transactions, and the QF is gone after qf_mem_fini()
+ *	or a crash.
+ * QF_BACKEND_HYBRID: set up by qf_mem_open() over a pmem QF, whose table
+ *	is copied to DRAM. Lookups read the copy alone; an update goes to the
+ *	pmem QF in a transaction first and to the copy once that commits.
+ *	The handle is only valid while nothing else updates the pmem QF.
+ */
+struct qf_mem {
+	struct qf_view qm_view;	/* over the DRAM table */
+	uint64_t qm_entries;
+	PMEMobjpool *qm_pop;	/* hybrid: the pmem QF kept in step */
+	TOID(struct quotient_filter) qm_qf;
+	struct qf_view qm_pview;	/* hybrid: over the pmem table */
+};
+
+/*
+ * A volatile handle that mirrors the slot metadata of a pmem QF in DRAM:
+ * the occupied, continuation and shifted bits of a classic QF, 3 bits per
+ * slot, or the offset word and bitvectors of every block of a blocked
+ * one. A lookup finds the run of its quotient in the mirror alone and
+ * reads pmem only to compare the remainders of that run, so a negative
+ * lookup whose quotient has no run never touches pmem.
+ *
+ * The mirror is built from the table by qf_tier_open(), since a pool can
+ * be reopened by another process, and is only valid while nothing but
+ * the qf_tier functions updates the QF.
+ */
+struct qf_tier {
+	PMEMobjpool *qt_pop;
+	TOID(struct quotient_filter) qt_qf;
+	struct qf_view qt_view;	/* over the pmem table */
+	struct qf_view qt_meta;	/* metadata alone, over a DRAM table */
+};
+
+/* What qf_check() found, see there. */
+struct qf_check_info {
+	uint64_t qci_damaged;	/* damaged stretches of slots */
+	uint64_t qci_first;	/* first slot of the first one */
+	uint64_t qci_len;	/* its length in slots */
+	uint64_t qci_entries;	/* used slots outside them */
+	uint64_t qci_salvaged;	/* clusters qf_repair() could not decode */
+};
+
+/* How full a QF is, see qf_load(). */
+struct qf_load_info {
+	uint64_t ql_entries;
+	uint64_t ql_limit;	/* entries the maximum load admits */
+	double ql_load;		/* entries / 2^q */
+	double ql_cluster;	/* expected slots a lookup scans */
+};
+
+/*
+ * How a QF's slots are laid out, see qf_stats(). Bucket i of a histogram
+ * counts the clusters (or runs) of 2^i to 2^(i+1) - 1 slots; the last
+ * bucket takes everything longer.
+ */
+struct qf_stats {
+	uint64_t qs_fingerprints;	/* distinct fingerprints */
+	uint64_t qs_used;	/* slots in use */
+	uint64_t qs_shifted;	/* used slots away from their quotient */
+	uint64_t qs_clusters;
+	uint64_t qs_runs;
+	uint64_t qs_longest_cluster;
+	uint64_t qs_longest_run;
+	double qs_shifted_frac;	/* qs_shifted / qs_used */
+	double qs_mean_cluster;	/* slots per cluster */
+	uint64_t qs_cluster_hist[QF_STATS_BUCKETS];
+	uint64_t qs_run_hist[QF_STATS_BUCKETS];
+};
+
+/* A false-positive rate measured by qf_measure_fpr(). */
+struct qf_fpr {
+	uint64_t qp_probes;
+	uint64_t qp_hits;
+	double qp_rate;		/* qp_hits / qp_probes */
+	double qp_expected;	/* fingerprints / 2^(q+r) */
+};
+
+/*
+ * What the hot paths of one thread did, see qf_counters_thread(). Only
+ * kept in a build with -DQF_INSTRUMENT.
+ */
+struct qf_counters {
+	uint64_t qc_lookups;	/* membership and count queries */
+	uint64_t qc_scan_slots;	/* run slots those queries compared */
+	uint64_t qc_walk_slots;	/* slots walked from cluster starts to runs */
+	uint64_t qc_inserts;	/* inserts that took effect */
+	uint64_t qc_shift_slots;	/* slots moved right to make room */
+	uint64_t qc_tx;		/* transactions begun by updates */
+	uint64_t qc_tx_aborts;
+	uint64_t qc_tx_bytes;	/* table bytes added to undo logs */
+	uint64_t qc_lines;	/* cache lines read by word loads or logged */
+};
+
 struct qf_iterator {
 	uint64_t qfi_index;
 	uint64_t qfi_quotient;
 	uint64_t qfi_visited;
+	uint64_t qfi_lo;	/* quotients yielded: qfi_lo + [0, qfi_span) */
+	uint64_t qfi_span;
+	uint64_t qfi_peek;	/* next fingerprint, if qfi_more */
+	bool qfi_more;
 };
 
 /*
  * Initializes a quotient filter with capacity 2^q.
  * Increasing r improves the filter's accuracy but uses more space.
  * 
- * Returns false if q == 0, r == 0, q+r > 64, or on ENOMEM.
+ * Returns false if q == 0, r == 0, q+r > 64, r > 61 (a slot of r+3 bits
+ * must fit in 64 bits), or on ENOMEM. All sizes and counts are 64-bit, so
+ * q is only bounded by the size of the pool.
  */
 //需要写入，分配内存
 bool qf_init(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint32_t q, uint32_t r);
 
+/*
+ * Same as qf_init(), but lays the table out in blocks of QF_BLOCK_SLOTS
+ * slots. Each block holds an offset word, occupieds and runends bitvectors
+ * and 64 packed r-bit remainders (one cache line when r == 5), so finding
+ * a run costs a popcount and a select over one or two blocks instead of a
+ * slot-by-slot walk of the cluster. Runs do not wrap around the table;
+ * a few spill blocks past the last quotient absorb the overflow, and an
+ * insert that would run past them fails like an insert into a full QF.
+ *
+ * Every other QF function accepts either format. qf_merge() always
+ * produces a classic QF.
+ */
+//需要写入，分配内存
+bool qf_init_blocked(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	uint32_t q, uint32_t r);
+
+/*
+ * Same as qf_init(), but the QF counts how often each fingerprint was
+ * inserted instead of only whether it was. A fingerprint inserted once
+ * takes one slot, as before; a larger count is kept in a variable-length
+ * counter of r-bit digits in the slots right after it, so a count of c
+ * takes about 2 + log(c) / r slots and skewed input costs little more
+ * than its distinct fingerprints.
+ *
+ * qf_entries counts the slots in use, counters included, so the load
+ * checks of qf_insert() and qf_set_max_load() apply as usual. The table
+ * is classic. qf_build(), qf_merge() with a counting input, qf_resize()
+ * and qf_sync_init() refuse a counting QF, and so does QF_FULL_RESIZE.
+ *
+ * Returns false if r is below 2 (a counter needs room for its digits), or
+ * for the same reasons as qf_init().
+ */
+//需要写入，分配内存
+bool qf_init_counting(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	uint32_t q, uint32_t r);
+
+/*
+ * Checks that a QF found in a (re)opened pool is usable: the header must
+ * carry QF_MAGIC and consistent parameters, and the table must belong to
+ * the pool and be large enough. Nothing in the QF depends on the address
+ * the pool is mapped at, so no rebuild is needed after a restart.
+ *
+ * Returns false if the QF was never initialized, has been destroyed, or
+ * its header is damaged.
+ */
+//只读
+bool qf_open(PMEMobjpool *pop, TOID(struct quotient_filter) qf);
+
+/*
+ * Checks the table of qf against the invariants a lookup relies on. The
+ * slots are cut into clusters at all-zero slots (classic) or at blocks
+ * whose offset is 0 (blocked), and every cluster is decoded the
+ * way a lookup reads it: each run must belong to an occupied quotient at
+ * or before it, every occupied quotient must have a run, the shifted
+ * bits or block offsets must match where the runs lie, and remainders
+ * must ascend within a run (counters aside). The used slots of the
+ * clusters must add up to qf_entries.
+ *
+ * A damaged cluster is reported together with the cluster before it, as
+ * a zeroed slot may have cut one cluster in two; info (if not NULL)
+ * gets the number of such stretches, the first of them, and the used
+ * slots outside them. With QF_CHECK_PARALLEL the table is split among
+ * threads, at the same boundaries; with QF_CHECK_FIRST each thread stops
+ * at its first damaged cluster, which is enough to decide whether a pool
+ * needs qf_repair() but leaves the counts short. The log and the spill
+ * QF are not checked beyond qf_open().
+ *
+ * Returns 0 if the table is consistent, 1 if it is not, or -1 if qf
+ * does not pass qf_open() or on ENOMEM.
+ */
+//只读
+int qf_check(TOID(struct quotient_filter) qf, unsigned flags,
+	struct qf_check_info *info);
+
+/*
+ * Runs qf_check() (QF_CHECK_FIRST aside) and rebuilds the damaged
+ * stretches alone, in one transaction: their slots are cleared and the
+ * fingerprints read back from them inserted again. A cluster whose
+ * occupied quotients and runs still pair up is read back exactly. One
+ * that does not is salvaged: the k-th run of the stretch is inserted
+ * under the k-th occupied quotient and the ones on either side of it,
+ * which covers one occupied, continuation or runend bit lost or gained
+ * per cluster. That adds false positives; a fingerprint is lost only if
+ * its remainder is gone, its quotient lost its occupied bit, or its
+ * cluster took more than one hit. qf_entries is set to what the table
+ * holds afterwards.
+ *
+ * Returns 0 if qf was consistent, 1 if it was repaired (info as from
+ * qf_check(), with qci_salvaged set), or -1 if qf does not pass
+ * qf_open(), is counting and damaged (a counter cannot be told from a
+ * remainder without its run), the salvaged fingerprints do not fit, on
+ * ENOMEM, or on transaction failure; qf is unchanged then.
+ */
+//需要写入
+int qf_repair(PMEMobjpool *pop, TOID(struct quotient_filter) qf, unsigned flags,
+	struct qf_check_info *info);
+
 /*
  * Inserts a hash into the QF.
  * Only the lowest q+r bits are actually inserted into the QF table.
  *
- * Returns false only if the QF is full.
+ * Returns false if the QF is full (at its maximum load, see
+ * qf_set_max_load() for when an insert resizes or spills instead), if a
+ * counting QF has no room for the longer counter or the count would pass
+ * UINT64_MAX, if a blocked QF has no empty slot left before the end of
+ * its spill blocks, or on ENOMEM.
  */
 //需要写入
 bool qf_insert(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash);
@@ -73,6 +414,38 @@ bool qf_insert(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash)
 //查询是只读的
 bool qf_may_contain(TOID(struct quotient_filter) qf, uint64_t hash);
 
+/*
+ * Initializes a read handle for the QF.
+ */
+//只读
+void qfv_init(TOID(struct quotient_filter) qf, struct qf_view *v);
+
+/*
+ * Same as qf_may_contain(), through a view.
+ */
+//只读
+bool qfv_may_contain(const struct qf_view *v, uint64_t hash);
+
+/*
+ * Looks up n hashes. out[i] is set to 1 if the QF may contain hashes[i]
+ * and to 0 otherwise.
+ *
+ * The lookups are pipelined: the lines a lookup needs are prefetched
+ * QF_PREFETCH_DISTANCE lookups ahead, so the pmem read latency of one
+ * overlaps with the work on the others. Set qfv_prefetch in a view to
+ * tune the distance (0 disables prefetching).
+ */
+//只读
+void qf_may_contain_batch(TOID(struct quotient_filter) qf, const uint64_t *hashes,
+	size_t n, uint8_t *out);
+
+/*
+ * Same as qf_may_contain_batch(), through a view.
+ */
+//只读
+void qfv_may_contain_batch(const struct qf_view *v, const uint64_t *hashes,
+	size_t n, uint8_t *out);
+
 /*
  * Removes a hash from the QF.
  *
@@ -85,11 +458,163 @@ bool qf_may_contain(TOID(struct quotient_filter) qf, uint64_t hash);
  *
  * Now, may-contain(qf, B:X) == false, which is a ruinous false negative.
  *
- * Returns false if the hash uses more than q+r bits.
+ * Returns false if the hash uses more than q+r bits, or if the log of qf
+ * could not be drained (see qf_log_drain()).
  */
 //需要写入
 bool qf_remove(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t hash);
 
+/*
+ * Inserts count occurrences of a hash at once. A QF that is not counting
+ * (see qf_init_counting()) treats this as qf_insert().
+ *
+ * Returns false if count is 0, if the QF is full, or if the count would
+ * pass UINT64_MAX; the count is unchanged then.
+ */
+//需要写入
+bool qf_insert_count(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	uint64_t hash, uint64_t count);
+
+/*
+ * Removes up to count occurrences of a hash; the fingerprint goes away
+ * when its count reaches 0. qf_remove() removes one. A QF that is not
+ * counting treats this as qf_remove(). The caution on qf_remove() applies.
+ *
+ * Returns false if count is 0, the hash uses more than q+r bits, or the
+ * log could not be drained.
+ */
+//需要写入
+bool qf_remove_count(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	uint64_t hash, uint64_t count);
+
+/*
+ * Returns how many times the QF may contain the hash: never less than the
+ * true count, larger only by the counts of colliding hashes. A QF that is
+ * not counting returns 0 or 1. Counts in the spill QF are added.
+ */
+//只读
+uint64_t qf_count(TOID(struct quotient_filter) qf, uint64_t hash);
+
+/*
+ * Chooses how the key functions below hash keys for qf. The choice and
+ * the seed are kept in the QF header, so every process that opens the
+ * pool hashes the same way. qf_init() picks QF_HASH_WY with seed 0.
+ *
+ * QF_HASH_WY: a wyhash-style 64-bit hash of keys of any length; only
+ *	its low q+r bits are used.
+ * QF_HASH_INVERTIBLE: keys are integers below 2^(q+r), read little-endian
+ *	from at most 8 bytes, and the hash is a seeded bijection on q+r
+ *	bits. Distinct keys never collide, so there are no false positives,
+ *	and qf_unhash() turns the fingerprints the iterator returns back
+ *	into keys. qf_resize() keeps q+r, and with it the keys.
+ *
+ * QF_HASH_NONE cannot be chosen here: qf_merge_many() gives it to a QF
+ * whose fingerprints no longer match any key hash, and the key functions
+ * refuse such a QF.
+ *
+ * Returns false if kind is unknown or qf is not empty (its log included).
+ */
+//需要写入
+bool qf_set_hash(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	int kind, uint64_t seed);
+
+/*
+ * Computes the hash the key functions use for a key of len bytes.
+ *
+ * Returns false if the key does not fit a QF_HASH_INVERTIBLE QF, or if
+ * qf is QF_HASH_NONE.
+ */
+//只读
+bool qf_hash_key(TOID(struct quotient_filter) qf, const void *key, size_t len,
+	uint64_t *hash);
+
+/*
+ * Same as qf_hash_key() for n 8-byte keys, in one tight loop; the
+ * results are meant for the batched functions.
+ *
+ * Returns false if some key does not fit a QF_HASH_INVERTIBLE QF, or if
+ * qf is QF_HASH_NONE; the hashes are unspecified then.
+ */
+//只读
+bool qf_hash_keys(TOID(struct quotient_filter) qf, const uint64_t *keys,
+	size_t n, uint64_t *hashes);
+
+/*
+ * Turns a fingerprint of a QF_HASH_INVERTIBLE QF, as returned by
+ * qfi_next(), back into its key.
+ *
+ * Returns false if qf is not QF_HASH_INVERTIBLE.
+ */
+//只读
+bool qf_unhash(TOID(struct quotient_filter) qf, uint64_t hash, uint64_t *key);
+
+/*
+ * Same as qf_insert(), qf_may_contain() and qf_remove(), for a key of len
+ * bytes hashed by qf (see qf_set_hash()). The caution on qf_remove()
+ * applies to keys whose hashes collide.
+ *
+ * Return false also if the key does not fit a QF_HASH_INVERTIBLE QF, or
+ * if qf is QF_HASH_NONE.
+ */
+//需要写入
+bool qf_insert_key(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	const void *key, size_t len);
+
+//只读
+bool qf_may_contain_key(TOID(struct quotient_filter) qf, const void *key,
+	size_t len);
+
+//需要写入
+bool qf_remove_key(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	const void *key, size_t len);
+
+/*
+ * Inserts n hashes into the QF, amortizing the transaction cost over the
+ * whole batch. The hashes are sorted by quotient and applied in chunks of
+ * at most QF_BATCH_CHUNK hashes, one transaction per chunk.
+ *
+ * If results is not NULL, results[i] receives what qf_insert() would have
+ * returned for hashes[i]. If a chunk's transaction aborts, none of its
+ * hashes (nor any later ones) are inserted and their results are false.
+ *
+ * Returns the number of hashes whose result is true (0 on ENOMEM, or if
+ * the log of qf could not be drained).
+ */
+//需要写入
+size_t qf_insert_batch(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	const uint64_t *hashes, size_t n, bool *results);
+
+/*
+ * Removes n hashes from the QF, with the same batching and result
+ * reporting as qf_insert_batch(). The caution on qf_remove() applies.
+ */
+//需要写入
+size_t qf_remove_batch(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	const uint64_t *hashes, size_t n, bool *results);
+
+/*
+ * Replaces the contents of qf with n hashes, which must be sorted by their
+ * lowest q+r bits (repeats are fine). qf keeps its parameters and format,
+ * so it must have been set up by qf_init() or qf_init_blocked().
+ *
+ * Instead of n inserts, the table is laid out in one left-to-right pass
+ * over a DRAM window that is streamed to a new pmem table with
+ * non-temporal stores, drained once, and swapped in by one transaction.
+ *
+ * Returns false if the hashes are not sorted, do not fit, if qf is
+ * counting, or on ENOMEM; qf is unchanged then.
+ */
+//需要写入，分配内存
+bool qf_build_from_sorted(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	const uint64_t *hashes, size_t n);
+
+/*
+ * Same as qf_build_from_sorted(), for hashes in any order: a copy of them
+ * is radix sorted first (2n words of DRAM).
+ */
+//需要写入，分配内存
+bool qf_build(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	const uint64_t *hashes, size_t n);
 
 /*
  * Resets the QF table. This function does not deallocate any memory.
@@ -104,7 +629,7 @@ void qf_clear(PMEMobjpool *pop, TOID(struct quotient_filter) qf);
 void qf_destroy(PMEMobjpool *pop, TOID(struct quotient_filter) qf);
 
 /*
- * Finds the size (in bytes) of a QF table.
+ * Finds the size (in bytes) of a classic QF table.
  *
  * Caution: sizeof(struct quotient_filter) is not included.
  */
@@ -115,27 +640,428 @@ size_t qf_table_size(uint32_t q, uint32_t r);
  * Initializes qfout and copies over all elements from qf1 and qf2.
  * Caution: qfout holds twice as many entries as either qf1 or qf2.
  *
+ * Same as qf_merge_many() with two inputs.
+ *
  * Returns false on ENOMEM.
  */
 bool qf_merge(PMEMobjpool *pop, TOID(struct quotient_filter) qf1, 
 	TOID(struct quotient_filter) qf2, TOID(struct quotient_filter) qfout);
 
+/*
+ * Initializes qfout as a classic QF and copies over all elements from the
+ * k QFs in qfs, which may be of either format and of any size. qfout gets
+ * a capacity of 2^ceil(log2(k)) times the largest input, so it can hold
+ * all of them even if they are full.
+ *
+ * The inputs are read in fingerprint order and merged into qfout in one
+ * sequential pass (see qf_build_from_sorted()); qfout must not be one of
+ * them. Fingerprints found in several inputs are stored once.
+ *
+ * The key functions cut hashes to q+r bits, so keys stay findable only
+ * if qfout keeps the q+r of the inputs. When all inputs have the same q+r,
+ * qfout keeps it and takes the extra quotient bits from r, as qf_resize()
+ * does, and hashes keys like the inputs. Otherwise, or if r would drop
+ * below one bit, qfout gets the largest r of the inputs, holds the
+ * fingerprints alone and is QF_HASH_NONE (see qf_set_hash()); so is it
+ * when an input is QF_HASH_NONE.
+ *
+ * Returns false if k is 0, if an input is counting, if the inputs hash
+ * keys differently (QF_HASH_NONE inputs aside), if qfout would be too
+ * large for qf_init(), if the log of an input could not be drained, or on
+ * ENOMEM.
+ */
+//需要写入，分配内存
+bool qf_merge_many(PMEMobjpool *pop, const TOID(struct quotient_filter) *qfs,
+	size_t k, TOID(struct quotient_filter) qfout);
+
+
+/*
+ * Changes the capacity of qf to 2^q without touching the stored
+ * fingerprints: the q+r fingerprint bits stay the same, so growing by one
+ * bit takes that bit from the remainder. Each step up doubles capacity and
+ * doubles the false-positive rate, and the remainder cannot drop below one
+ * bit. The table is rewritten in one sequential pass into a new
+ * allocation that is swapped in by one transaction, so a crash leaves the
+ * old table in place. qf keeps its format; q may also be smaller than the
+ * current one as long as the entries fit.
+ *
+ * Returns false if q is out of range, if the entries would not fit (or,
+ * for the blocked format, would overflow the spill blocks), if qf is
+ * counting, or on ENOMEM.
+ */
+//需要写入，分配内存
+bool qf_resize(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint32_t q);
+
+/*
+ * Caps the load of qf at load percent of its capacity, from 1 to 100,
+ * and says what an insert that would go past the cap does instead:
+ *
+ * QF_FULL_REJECT: fails, like an insert into a full QF.
+ * QF_FULL_RESIZE: grows qf first with qf_resize(), as far as it takes, for
+ *	as long as a remainder bit is left to give up; then rejects. Not
+ *	available for a counting QF.
+ * QF_FULL_SPILL: goes into spill, an open QF of its own. qf_may_contain(),
+ *	qf_may_contain_batch() and qf_remove() look in spill as well; views,
+ *	iterators, qf_remove_batch(), qf_merge() and the qf_sync functions see
+ *	qf alone. The spill of spill is not followed, so two QFs may spill
+ *	into each other.
+ *
+ * qf_insert_batch() follows the policy too. qf_sync_insert() is capped
+ * but never resizes or spills. qf_build() and qf_resize() may fill a QF
+ * past its cap; inserts resume once removes bring it back under.
+ *
+ * Lookups and removes go on looking in spill for as long as it is set, so
+ * pass it along with any policy to keep spilled entries visible. qf_init()
+ * leaves a QF at 100 percent with QF_FULL_REJECT and no spill. The
+ * setting is kept in the pool.
+ *
+ * Returns false if load or policy is out of range, if spill is set but is
+ * not an open QF other than qf, if policy is QF_FULL_SPILL and spill is
+ * not set, or if policy is QF_FULL_RESIZE and qf is counting.
+ */
+//需要写入
+bool qf_set_max_load(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	uint32_t load, int policy, TOID(struct quotient_filter) spill);
+
+/*
+ * Gives qf a staging log of cap fingerprints, kept in the pool. While qf
+ * has one, qf_insert() appends the fingerprint to the log and returns:
+ * one sequential write and two flushes (the fingerprint, then the
+ * length), no transaction and no shifting. A crash loses at most the
+ * insert that had not returned. When the log is full, or the load cap
+ * leaves no room for more, the insert drains it first (see
+ * qf_log_drain()).
+ *
+ * qf_may_contain(), qf_may_contain_batch() and qf_count() look in the log
+ * after the table, so keep cap small: a lookup that misses the table
+ * scans it. Removes, batches and qf_merge() drain the log first;
+ * qf_build() and qf_clear() discard it, and qf_resize() keeps it, as
+ * resizing keeps the q+r fingerprint bits. Views, iterators, qf_stats()
+ * and the qf_sync, qf_mem and qf_tier handles see the table alone.
+ *
+ * A cap of 0 drains the log and frees it. Returns false if qf is
+ * counting, if the old log could not be drained, or on transaction
+ * failure.
+ */
+//需要写入，分配内存
+bool qf_set_log(PMEMobjpool *pop, TOID(struct quotient_filter) qf, uint64_t cap);
+
+/*
+ * Inserts the fingerprints staged in the log of qf into its table, in
+ * sorted order so that the inserts into one cluster shift it once between
+ * them, and empties the log, all in one transaction. Fingerprints the
+ * table has no room for stay in the log and are still found by lookups.
+ *
+ * Returns true if the log is empty afterwards (or qf has none).
+ */
+//需要写入
+bool qf_log_drain(PMEMobjpool *pop, TOID(struct quotient_filter) qf);
+
+/*
+ * Reports the load of qf and the number of slots a lookup is expected to
+ * scan at that load: (1 + 1 / (1 - load)^2) / 2, as in linear probing,
+ * which clusters the same way. The estimate costs nothing to compute, so
+ * it can be checked before every insert; it grows past 10 slots at a load
+ * of about 0.78 and past 50 at 0.9.
+ */
+//只读
+void qf_load(TOID(struct quotient_filter) qf, struct qf_load_info *info);
+
+/*
+ * Walks the slots of qf once and reports its clusters and runs. A
+ * cluster is a stretch of used slots that starts at its own quotient; a
+ * run holds the slots of one quotient (counters included, in a counting
+ * QF). Lookups scan a run, and inserts shift the rest of a cluster, so
+ * the histograms show what the average in qf_load() hides: a long tail
+ * of clusters, or a shifted fraction well above what the load explains,
+ * points to a hash that does not spread its keys. Like a view, it sees
+ * qf alone, not its spill.
+ */
+//只读
+void qf_stats(TOID(struct quotient_filter) qf, struct qf_stats *st);
+
+/*
+ * Measures the false-positive rate of qf by looking up n hashes that were
+ * never inserted, so every hit is a false positive. If hashes is NULL,
+ * n random (q+r)-bit fingerprints are probed instead; they measure the
+ * rate a uniform hash would give. Either way the result comes with the
+ * rate expected from the number of distinct fingerprints, which is about
+ * load / 2^r. Looks at qf alone, not its spill.
+ */
+//只读
+void qf_measure_fpr(TOID(struct quotient_filter) qf, const uint64_t *hashes,
+	size_t n, struct qf_fpr *fpr);
+
+/*
+ * Creates a QF called name in the pool directory and initializes it with
+ * capacity 2^q (see qf_init()). Every QF in the directory owns its own
+ * table, so any number of them can be live in one pool.
+ *
+ * Returns TOID_NULL if name is empty, longer than QF_NAME_MAX - 1 or
+ * already taken, if qf_init() would reject q and r, or on ENOMEM.
+ */
+//需要写入，分配内存
+TOID(struct quotient_filter) qf_dir_create(PMEMobjpool *pop, const char *name,
+	uint32_t q, uint32_t r);
+
+/*
+ * Finds the QF called name in the pool directory.
+ *
+ * Returns TOID_NULL if there is no such QF. The directory is a list, so
+ * keep the result around rather than looking a QF up for every operation.
+ */
+//只读
+TOID(struct quotient_filter) qf_dir_lookup(PMEMobjpool *pop, const char *name);
+
+/*
+ * Calls cb for every QF in the pool directory, most recently created
+ * first. Stops as soon as cb returns non-zero.
+ *
+ * Returns the last value cb returned, or 0 if the directory is empty.
+ */
+//只读
+int qf_dir_foreach(PMEMobjpool *pop,
+	int (*cb)(const char *name, TOID(struct quotient_filter) qf, void *arg),
+	void *arg);
+
+/*
+ * Destroys the QF called name and removes it from the pool directory.
+ *
+ * Returns false if there is no such QF or on transaction failure.
+ */
+//需要写入，释放内存
+bool qf_dir_drop(PMEMobjpool *pop, const char *name);
+
+/*
+ * Sets up s for concurrent use of qf (see struct qf_sync).
+ *
+ * Returns false if qf does not pass qf_open(), is not a classic QF, is
+ * counting, has staged inserts (see qf_log_drain()), or on ENOMEM.
+ */
+//只读，分配易失内存
+bool qf_sync_init(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	struct qf_sync *s);
+
+/*
+ * Frees what qf_sync_init() allocated. The QF itself is untouched.
+ */
+void qf_sync_fini(struct qf_sync *s);
+
+/*
+ * Same as qf_insert(), but safe to call from several threads at once.
+ * Returns false if the QF is full or the transaction aborted.
+ */
+//需要写入，可并发
+bool qf_sync_insert(struct qf_sync *s, uint64_t hash);
+
+/*
+ * Same as qf_remove(), but safe to call from several threads at once.
+ * The caution on qf_remove() applies.
+ */
+//需要写入，可并发
+bool qf_sync_remove(struct qf_sync *s, uint64_t hash);
+
+/*
+ * Same as qf_may_contain(). May run concurrently with other lookups and
+ * updates; it retries its reads until they did not overlap an update of
+ * the regions they touched.
+ */
+//只读，可并发
+bool qf_sync_may_contain(const struct qf_sync *s, uint64_t hash);
+
+/*
+ * Same as qf_init(), qf_init_blocked() and qf_init_counting(), for a QF
+ * that lives in DRAM only (QF_BACKEND_DRAM). Its maximum load is 100
+ * percent and an insert past it fails.
+ *
+ * Returns false for the same reasons as its pmem counterpart.
+ */
+//分配易失内存
+bool qf_mem_init(struct qf_mem *m, uint32_t q, uint32_t r);
+
+//分配易失内存
+bool qf_mem_init_blocked(struct qf_mem *m, uint32_t q, uint32_t r);
+
+//分配易失内存
+bool qf_mem_init_counting(struct qf_mem *m, uint32_t q, uint32_t r);
+
+/*
+ * Sets up m as a DRAM copy of qf that updates qf as well
+ * (QF_BACKEND_HYBRID). Like qf_sync_insert(), inserts are capped by the
+ * maximum load of qf but never resize or spill, and lookups do not look
+ * in the spill QF. With -DQF_INSTRUMENT, an update counts once for each
+ * table it goes to.
+ *
+ * Returns false if qf does not pass qf_open(), has staged inserts (see
+ * qf_log_drain()), or on ENOMEM.
+ */
+//只读，分配易失内存
+bool qf_mem_open(struct qf_mem *m, PMEMobjpool *pop, TOID(struct quotient_filter) qf);
+
+/*
+ * Frees the DRAM table of m. A pmem QF behind a hybrid handle is untouched.
+ */
+void qf_mem_fini(struct qf_mem *m);
+
+/*
+ * Same as qf_insert(), qf_insert_count(), qf_remove(), qf_remove_count(),
+ * qf_may_contain() and qf_count(), through m. The updates of a hybrid
+ * handle also return false if the transaction aborted; the copy is
+ * unchanged then.
+ */
+//需要写入
+bool qf_mem_insert(struct qf_mem *m, uint64_t hash);
+
+//需要写入
+bool qf_mem_insert_count(struct qf_mem *m, uint64_t hash, uint64_t count);
+
+//需要写入
+bool qf_mem_remove(struct qf_mem *m, uint64_t hash);
+
+//需要写入
+bool qf_mem_remove_count(struct qf_mem *m, uint64_t hash, uint64_t count);
+
+//只读
+bool qf_mem_may_contain(const struct qf_mem *m, uint64_t hash);
+
+//只读
+uint64_t qf_mem_count(const struct qf_mem *m, uint64_t hash);
+
+/*
+ * Sets up t over qf and builds its metadata mirror with one pass over
+ * the table. Like qf_sync_insert(), inserts through t are capped by the
+ * maximum load of qf but never resize or spill, and lookups do not look
+ * in the spill QF.
+ *
+ * Returns false if qf does not pass qf_open(), is counting, has staged
+ * inserts (see qf_log_drain()), or on ENOMEM.
+ */
+//只读，分配易失内存
+bool qf_tier_open(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	struct qf_tier *t);
+
+/*
+ * Frees the mirror of t. The QF itself is untouched.
+ */
+void qf_tier_fini(struct qf_tier *t);
+
+/*
+ * Same as qf_may_contain(), resolving the run in DRAM.
+ */
+//只读
+bool qf_tier_may_contain(const struct qf_tier *t, uint64_t hash);
 
+/*
+ * Same as qf_insert() and qf_remove(); the mirror is brought up to date
+ * for the slots the update may have rewritten once it commits. Also
+ * return false if the transaction aborted.
+ */
+//需要写入
+bool qf_tier_insert(struct qf_tier *t, uint64_t hash);
+
+//需要写入
+bool qf_tier_remove(struct qf_tier *t, uint64_t hash);
+
+/*
+ * Selects the kernels used to scan table words (QF_KERNELS_SCALAR or
+ * QF_KERNELS_BMI2). The best set the CPU supports is picked when the
+ * program starts, so this is only needed to compare or debug the sets.
+ *
+ * Returns false if the CPU or the compiler cannot run the set.
+ */
+bool qf_set_kernels(int kernels);
+
+/*
+ * Returns the kernel set in use.
+ */
+int qf_kernels(void);
+
+/*
+ * Copies the counters of the calling thread into c. Each thread keeps its
+ * own counters and bumps them with plain stores, so counting adds no
+ * shared writes to the hot paths. Without -DQF_INSTRUMENT the hooks
+ * compile to nothing and c is zeroed.
+ *
+ * Returns false if the library was built without QF_INSTRUMENT.
+ */
+bool qf_counters_thread(struct qf_counters *c);
+
+/*
+ * Same as qf_counters_thread(), summed over every thread that has used a
+ * QF, including threads that have exited. A reader sampling this
+ * periodically can export the differences; counts still being added by
+ * other threads may be a few operations behind.
+ */
+bool qf_counters_total(struct qf_counters *c);
+
+/*
+ * Zeroes the counters of the calling thread.
+ */
+void qf_counters_reset(void);
 
 /*
  * Initialize an iterator for the QF.
  */
 void qfi_start(TOID(struct quotient_filter) qf, struct qf_iterator *i);
 
+/*
+ * Initialize an iterator for the fingerprints whose quotient is at least
+ * quotient. A classic QF backs up to the start of the cluster holding
+ * that slot, so this costs a cluster, not a scan from slot 0.
+ */
+//只读
+void qfi_seek(TOID(struct quotient_filter) qf, struct qf_iterator *i,
+	uint64_t quotient);
+
+/*
+ * Initialize an iterator for the fingerprints whose quotient lies in
+ * [qlo, qhi). Unlike qfi_start(), it yields them in order of quotient.
+ *
+ * Returns false unless qlo <= qhi <= 2^q.
+ */
+//只读
+bool qf_range_iter(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+	struct qf_iterator *i);
+
 /*
  * Returns true if there are no elements left to visit.
  */
 bool qfi_done(TOID(struct quotient_filter) qf, struct qf_iterator *i);
 
 /*
- * Returns the next (q+r)-bit fingerprint in the QF.
+ * Returns the next (q+r)-bit fingerprint in the QF. A counting QF returns
+ * each fingerprint once, whatever its count (see qf_count()).
  *
  * Caution: Do not call this routine if qfi_done() == true.
  */
 uint64_t qfi_next(TOID(struct quotient_filter) qf, struct qf_iterator *i);
 
+/*
+ * Splits the quotients of qf into at most n ranges, bounds[k] to
+ * bounds[k+1], with bounds[0] = 0 and the last bound 2^q; bounds must
+ * have room for n+1 entries. Every inner bound falls where a cluster (a
+ * block without spill-in, for a blocked QF) begins, so the fingerprints
+ * of different ranges live in disjoint slots, and the ranges are about
+ * equal in slots. Where no cluster begins near a bound, the ranges
+ * around it are merged.
+ *
+ * Returns the number of ranges.
+ */
+//只读
+size_t qf_partitions(TOID(struct quotient_filter) qf, size_t n, uint64_t *bounds);
+
+/*
+ * Calls fn on each range of qf_partitions(qf, nthreads), each in its own
+ * thread; the calling thread takes the first. fn usually walks its range
+ * with qf_range_iter(). nthreads = 0 means one per online CPU.
+ *
+ * Returns 0, or the first nonzero value fn returned in order of range,
+ * or -1 on ENOMEM. Nothing stops fn from updating qf, but concurrent
+ * updates must go through the qf_sync functions.
+ */
+//只读，是否写入取决于fn
+int qf_parallel_for(TOID(struct quotient_filter) qf, unsigned nthreads,
+	int (*fn)(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+		void *arg),
+	void *arg);
+
@@ -10,12 +10,17 @@ extern "C"
 }
 
 #include <set>
+#include <map>
+#include <algorithm>
 #include <vector>
+#include <thread>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cmath>
 #include <sys/time.h>
 #include <unistd.h>
+#include <malloc.h>
 
 #define POOL_SIZE	(1024 * 1024 * 1024) /* 1GB */
 
@@ -39,6 +44,8 @@ static uint64_t rand64()
 
 static void qf_print(TOID(struct quotient_filter) qf)
 {
+	struct qf_view v;
+	qfv_init(qf, &v);
 	char buf[32];
 	uint32_t pad = uint32_t(ceil(float(D_RO(qf)->qf_qbits) / logf(10.f))) + 1;
 
@@ -47,7 +54,7 @@ static void qf_print(TOID(struct quotient_filter) qf)
 		printf(" ");
 	}
 	printf("| is_shifted | is_continuation | is_occupied | remainder"
-		   " nel=%u\n",
+		   " nel=%lu\n",
 		   D_RO(qf)->qf_entries);
 
 	for (uint64_t idx = 0; idx < D_RO(qf)->qf_max_size; ++idx)
@@ -62,7 +69,7 @@ static void qf_print(TOID(struct quotient_filter) qf)
 		}
 		printf("| ");
 
-		uint64_t elt = get_elem(qf, idx);
+		uint64_t elt = get_elem(&v, idx);
 		printf("%d          | ", !!is_shifted(elt));
 		printf("%d               | ", !!is_continuation(elt));
 		printf("%d           | ", !!is_occupied(elt));
@@ -70,14 +77,86 @@ static void qf_print(TOID(struct quotient_filter) qf)
 	}
 }
 
+/* Check the invariants of a blocked QF: runs, runends and block offsets. */
+static void blk_consistent(TOID(struct quotient_filter) qf)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	assert(D_RO(qf)->qf_elem_bits == D_RO(qf)->qf_rbits);
+	assert(D_RO(qf)->qf_entries <= D_RO(qf)->qf_max_size);
+
+	uint64_t nslots = v.qfv_nslots;
+	uint64_t quot = blk_next_bit(&v, BLK_OCCUPIEDS, 0);
+	uint64_t used = 0;	/* first slot after the last run seen */
+	uint64_t visited = 0;
+	vector<uint64_t> offsets(nslots / QF_BLOCK_SLOTS, 0);
+
+	while (quot < nslots)
+	{
+		assert(quot < D_RO(qf)->qf_max_size);
+		uint64_t start = MAX(quot, used);
+		uint64_t end = blk_next_bit(&v, BLK_RUNENDS, start);
+		assert(end < nslots);
+
+		/* Slots between runs are empty. */
+		for (uint64_t s = used; s < start; ++s)
+		{
+			assert(blk_get_rem(&v, s) == 0);
+		}
+		for (uint64_t s = start; s <= end; ++s)
+		{
+			if (s > start)
+			{
+				assert(blk_get_rem(&v, s) > blk_get_rem(&v, s - 1));
+			}
+			++visited;
+		}
+		used = end + 1;
+
+		/* Record how far this run reaches into later blocks. */
+		uint64_t next = blk_next_bit(&v, BLK_OCCUPIEDS, quot + 1);
+		for (uint64_t b = quot / QF_BLOCK_SLOTS + 1;
+			 b * QF_BLOCK_SLOTS < MAX(used, next) && b < offsets.size(); ++b)
+		{
+			if (used > b * QF_BLOCK_SLOTS)
+			{
+				offsets[b] = used - b * QF_BLOCK_SLOTS;
+			}
+		}
+		quot = next;
+	}
+
+	/* No stray runends or remainders after the last run. */
+	assert(blk_next_bit(&v, BLK_RUNENDS, used) == nslots);
+	for (uint64_t s = used; s < nslots; ++s)
+	{
+		assert(blk_get_rem(&v, s) == 0);
+	}
+	for (uint64_t b = 0; b < offsets.size(); ++b)
+	{
+		assert(blk_block(&v, b)[BLK_OFFSET] == offsets[b]);
+	}
+	assert(D_RO(qf)->qf_entries == visited);
+}
+
 /* Check QF structural invariants. */
 static void qf_consistent(TOID(struct quotient_filter) qf)
 {
+	if (D_RO(qf)->qf_format == QF_FORMAT_BLOCKED)
+	{
+		blk_consistent(qf);
+		return;
+	}
+
+	struct qf_view v;
+	qfv_init(qf, &v);
+
 	assert(D_RO(qf)->qf_qbits);
 	assert(D_RO(qf)->qf_rbits);
 	assert(D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits <= 64);
 	assert(D_RO(qf)->qf_elem_bits == (D_RO(qf)->qf_rbits + 3));
-	assert(D_RO(qf)->qf_table);
+	assert(!TOID_IS_NULL(D_RO(qf)->qf_table));
 
 	uint64_t idx;
 	uint64_t start;
@@ -90,14 +169,14 @@ static void qf_consistent(TOID(struct quotient_filter) qf)
 	{
 		for (start = 0; start < size; ++start)
 		{
-			assert(get_elem(qf, start) == 0);
+			assert(get_elem(&v, start) == 0);
 		}
 		return;
 	}
 
 	for (start = 0; start < size; ++start)
 	{
-		if (is_cluster_start(get_elem(qf, start)))
+		if (is_cluster_start(get_elem(&v, start)))
 		{
 			break;
 		}
@@ -108,7 +187,7 @@ static void qf_consistent(TOID(struct quotient_filter) qf)
 	idx = start;
 	do
 	{
-		uint64_t elt = get_elem(qf, idx);
+		uint64_t elt = get_elem(&v, idx);
 
 		/* Make sure there are no dirty entries. */
 		if (is_empty_element(elt))
@@ -122,7 +201,7 @@ static void qf_consistent(TOID(struct quotient_filter) qf)
 			assert(is_shifted(elt));
 
 			/* Check that this is actually a continuation. */
-			uint64_t prev = get_elem(qf, decr(qf, idx));
+			uint64_t prev = get_elem(&v, decr(&v, idx));
 			assert(!is_empty_element(prev));
 		}
 
@@ -130,7 +209,8 @@ static void qf_consistent(TOID(struct quotient_filter) qf)
 		if (!is_empty_element(elt))
 		{
 			uint64_t rem = get_remainder(elt);
-			if (is_continuation(elt))
+			/* Counters sit between the remainders; see qf_test_counting. */
+			if (is_continuation(elt) && !v.qfv_counting)
 			{
 				assert(rem > last_run_elt);
 			}
@@ -138,7 +218,7 @@ static void qf_consistent(TOID(struct quotient_filter) qf)
 			++visited;
 		}
 
-		idx = incr(qf, idx);
+		idx = incr(&v, idx);
 	} while (idx != start);
 
 	assert(D_RO(qf)->qf_entries == visited);
@@ -148,6 +228,8 @@ static void qf_consistent(TOID(struct quotient_filter) qf)
 static uint64_t genhash(TOID(struct quotient_filter) qf, bool clrhigh,
 						set<uint64_t> &keys)
 {
+	struct qf_view v;
+	qfv_init(qf, &v);
 	uint64_t hash;
 	uint64_t mask = clrhigh ? LOW_MASK(D_RO(qf)->qf_qbits + D_RO(qf)->qf_rbits) : ~0ULL;
 	uint64_t size = D_RO(qf)->qf_max_size;
@@ -157,9 +239,9 @@ static uint64_t genhash(TOID(struct quotient_filter) qf, bool clrhigh,
 	{
 		uint64_t probe;
 		uint64_t start = rand64() & D_RO(qf)->qf_index_mask;
-		for (probe = incr(qf, start); probe != start; probe = incr(qf, probe))
+		for (probe = incr(&v, start); probe != start; probe = incr(&v, probe))
 		{
-			if (is_empty_element(get_elem(qf, probe)))
+			if (is_empty_element(get_elem(&v, probe)))
 			{
 				uint64_t hi = clrhigh ? 0 : (rand64() & ~mask);
 				hash = hi | (probe << D_RO(qf)->qf_rbits) | (rand64() & D_RO(qf)->qf_rmask);
@@ -210,6 +292,31 @@ static void ht_check(TOID(struct quotient_filter) qf, set<uint64_t> &keys)
 		uint64_t hash = *it;
 		assert(qf_may_contain(qf, hash));
 	}
+
+	/* The batched view lookup must agree with qf_may_contain(). */
+	struct qf_view v;
+	qfv_init(qf, &v);
+	vector<uint64_t> probes(keys.begin(), keys.end());
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		probes.push_back(rand64());
+	}
+	vector<uint8_t> out(probes.size());
+	qf_may_contain_batch(qf, probes.data(), probes.size(), out.data());
+	for (size_t i = 0; i < probes.size(); ++i)
+	{
+		assert(out[i] == qf_may_contain(qf, probes[i]));
+	}
+
+	/* The prefetch distance must not change the answers. */
+	const size_t dists[] = {0, 1, 3, probes.size() + 1};
+	for (size_t d = 0; d < sizeof(dists) / sizeof(dists[0]); ++d)
+	{
+		vector<uint8_t> again(probes.size());
+		v.qfv_prefetch = dists[d];
+		qfv_may_contain_batch(&v, probes.data(), probes.size(), again.data());
+		assert(again == out);
+	}
 }
 
 static void qf_test_basic(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
@@ -217,16 +324,18 @@ static void qf_test_basic(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
 	// 此时传入的QF是刚初始化的
 	// 基本插入和查询
 	/* Basic get/set tests. */
+	struct qf_view v;
+	qfv_init(qf, &v);
 	uint64_t idx;
 	uint64_t size = D_RO(qf)->qf_max_size;
 	for (idx = 0; idx < size; ++idx)
 	{
-		assert(get_elem(qf, idx) == 0);
-		set_elem(qf, idx, idx & D_RO(qf)->qf_elem_mask);
+		assert(get_elem(&v, idx) == 0);
+		set_elem(&v, idx, idx & D_RO(qf)->qf_elem_mask);
 	}
 	for (idx = 0; idx < size; ++idx)
 	{
-		assert(get_elem(qf, idx) == (idx & D_RO(qf)->qf_elem_mask));
+		assert(get_elem(&v, idx) == (idx & D_RO(qf)->qf_elem_mask));
 	}
 	qf_clear(pop,qf);
 
@@ -237,12 +346,12 @@ static void qf_test_basic(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
 	{
 		uint64_t slot = rand64() % size;
 		uint64_t hash = rand64();
-		set_elem(qf, slot, hash & D_RO(qf)->qf_elem_mask);
+		set_elem(&v, slot, hash & D_RO(qf)->qf_elem_mask);
 		elements[slot] = hash & D_RO(qf)->qf_elem_mask;
 	}
 	for (idx = 0; idx < elements.size(); ++idx)
 	{
-		assert(get_elem(qf, idx) == elements[idx]);
+		assert(get_elem(&v, idx) == elements[idx]);
 	}
 	qf_clear(pop,qf);
 
@@ -283,6 +392,123 @@ static void qf_test_basic(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
 	}
 }
 
+/* Check that batched inserts/removes agree with the one-at-a-time API. */
+static void qf_test_batch(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	uint64_t size = D_RO(qf)->qf_max_size;
+	set<uint64_t> keys;
+	vector<uint64_t> batch;
+
+	qf_clear(pop, qf);
+
+	/*
+	 * Fill all but one slot with p-bit hashes, repeating some of them
+	 * (a repeat that arrives once the QF is full would be rejected).
+	 */
+	while (keys.size() < size - 1)
+	{
+		uint64_t hash = genhash(qf, true, keys);
+		keys.insert(hash);
+		batch.push_back(hash);
+		if (rand() % 4 == 0)
+		{
+			batch.push_back(hash);
+		}
+	}
+
+	bool *results = new bool[batch.size()];
+	assert(qf_insert_batch(pop, qf, batch.data(), batch.size(), results) == batch.size());
+	for (size_t i = 0; i < batch.size(); ++i)
+	{
+		assert(results[i]);
+	}
+	assert(D_RO(qf)->qf_entries == keys.size());
+	ht_check(qf, keys);
+
+	uint64_t extra = genhash(qf, true, keys);
+	assert(qf_insert_batch(pop, qf, &extra, 1, results) == 1);
+	keys.insert(extra);
+	ht_check(qf, keys);
+
+	/* The QF is full: one more hash must be rejected. */
+	extra = genhash(qf, true, keys);
+	assert(qf_insert_batch(pop, qf, &extra, 1, results) == 0);
+	assert(!results[0]);
+
+	/* Remove every other key in one batch. */
+	vector<uint64_t> victims;
+	set<uint64_t>::iterator it;
+	bool odd = false;
+	for (it = keys.begin(); it != keys.end(); ++it, odd = !odd)
+	{
+		if (odd)
+		{
+			victims.push_back(*it);
+		}
+	}
+	assert(qf_remove_batch(pop, qf, victims.data(), victims.size(), results) == victims.size());
+	for (size_t i = 0; i < victims.size(); ++i)
+	{
+		assert(!qf_may_contain(qf, victims[i]));
+		keys.erase(victims[i]);
+	}
+	assert(D_RO(qf)->qf_entries == keys.size());
+	ht_check(qf, keys);
+
+	delete[] results;
+	qf_clear(pop, qf);
+}
+
+/*
+ * Check that the undo log covers every table word an update touches:
+ * aborting an enclosing transaction must restore the table bit for bit.
+ */
+static void qf_test_abort(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	size_t bytes = qf_table_size(D_RO(qf)->qf_qbits, D_RO(qf)->qf_rbits);
+	uint64_t size = D_RO(qf)->qf_max_size;
+	vector<uint8_t> before(bytes);
+	set<uint64_t> keys;
+
+	qf_clear(pop, qf);
+	while (keys.size() < size / 2)
+	{
+		ht_put(pop, qf, keys);
+	}
+	memcpy(before.data(), D_RO(D_RO(qf)->qf_table), bytes);
+	uint64_t entries = D_RO(qf)->qf_entries;
+
+	/* Inserts and removes are checked separately so neither masks the other. */
+	for (int round = 0; round < 2; ++round)
+	{
+		set<uint64_t> scratch(keys);
+		TX_BEGIN(pop)
+		{
+			if (round == 0)
+			{
+				while (D_RO(qf)->qf_entries < size)
+				{
+					ht_put(pop, qf, scratch);
+				}
+			}
+			else
+			{
+				while (!scratch.empty())
+				{
+					ht_del(pop, qf, scratch);
+				}
+			}
+			pmemobj_tx_abort(-1);
+		}
+		TX_END;
+
+		assert(D_RO(qf)->qf_entries == entries);
+		assert(!memcmp(before.data(), D_RO(D_RO(qf)->qf_table), bytes));
+		ht_check(qf, keys);
+	}
+	qf_clear(pop, qf);
+}
+
 /* Fill up the QF (at least partially). */
 static void random_fill(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
 {
@@ -321,6 +547,72 @@ static void supersetof(TOID(struct quotient_filter) qf, TOID(struct quotient_fil
 	}
 }
 
+static int count_dir(const char *name, TOID(struct quotient_filter) qf, void *arg)
+{
+	assert(qf_open(pmemobj_pool_by_oid(qf.oid), qf));
+	++*(int *)arg;
+	return 0;
+}
+
+/* Check that directory filters are independent of one another. */
+static void qf_test_dir(PMEMobjpool *pop)
+{
+	const char *names[] = {"shard-0", "shard-1", "shard-2"};
+	const int nnames = sizeof(names) / sizeof(names[0]);
+	set<uint64_t> keys[nnames];
+	int count = 0;
+
+	/* A pool reused from an earlier run may still hold the shards. */
+	for (int i = 0; i < nnames; ++i)
+	{
+		qf_dir_drop(pop, names[i]);
+	}
+	qf_dir_foreach(pop, count_dir, &count);
+
+	for (int i = 0; i < nnames; ++i)
+	{
+		TOID(struct quotient_filter) qf = qf_dir_create(pop, names[i], Q_MAX, R_MAX);
+		assert(!TOID_IS_NULL(qf));
+		assert(TOID_IS_NULL(qf_dir_create(pop, names[i], Q_MAX, R_MAX)));
+		assert(TOID_EQUALS(qf, qf_dir_lookup(pop, names[i])));
+	}
+	assert(TOID_IS_NULL(qf_dir_create(pop, "", Q_MAX, R_MAX)));
+	assert(TOID_IS_NULL(qf_dir_create(pop, "bad-params", 0, R_MAX)));
+	assert(TOID_IS_NULL(qf_dir_lookup(pop, "missing")));
+
+	int total = 0;
+	qf_dir_foreach(pop, count_dir, &total);
+	assert(total == count + nnames);
+
+	for (int i = 0; i < nnames; ++i)
+	{
+		TOID(struct quotient_filter) qf = qf_dir_lookup(pop, names[i]);
+		for (int j = 0; j <= i; ++j)
+		{
+			ht_put(pop, qf, keys[i]);
+		}
+	}
+	for (int i = 0; i < nnames; ++i)
+	{
+		TOID(struct quotient_filter) qf = qf_dir_lookup(pop, names[i]);
+		assert(D_RO(qf)->qf_entries == keys[i].size());
+		ht_check(qf, keys[i]);
+	}
+
+	/* Dropping one filter leaves the others intact. */
+	assert(qf_dir_drop(pop, names[1]));
+	assert(!qf_dir_drop(pop, names[1]));
+	assert(TOID_IS_NULL(qf_dir_lookup(pop, names[1])));
+	ht_check(qf_dir_lookup(pop, names[0]), keys[0]);
+	ht_check(qf_dir_lookup(pop, names[2]), keys[2]);
+
+	assert(qf_dir_drop(pop, names[0]));
+	assert(qf_dir_drop(pop, names[2]));
+	total = 0;
+	qf_dir_foreach(pop, count_dir, &total);
+	assert(total == count);
+}
+
 static void qf_bench(PMEMobjpool *pop,TOID(struct quotient_filter) qf1_bench)
 {
 	//struct quotient_filter qf;
@@ -390,14 +682,2070 @@ static void qf_bench(PMEMobjpool *pop,TOID(struct quotient_filter) qf1_bench)
 	qf_destroy(pop,qf1_bench);
 }
 
-static void qf_test(PMEMobjpool *pop,TOID(struct quotient_filter) qf1_test,
-	TOID(struct quotient_filter) qf2_test,TOID(struct quotient_filter) qf21_test,TOID(struct quotient_filter) qf22_test)
+/* Check 64-bit size arithmetic and filters whose fingerprints use all 64 bits. */
+static void qf_test_wide(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	assert(qf_table_size(1, 1) == 8);
+	assert(qf_table_size(32, 5) == (1ULL << 32));
+	assert(qf_table_size(36, 13) == (1ULL << 37));
+	assert(qf_table_size(62, 2) == (1ULL << 56) * 5 * 8);
+
+	assert(!qf_init(pop, qf, 1, 62));
+	assert(!qf_init(pop, qf, 4, 61));
+	assert(qf_init(pop, qf, 3, 61));
+
+	set<uint64_t> keys;
+	while (D_RO(qf)->qf_entries < D_RO(qf)->qf_max_size)
+	{
+		ht_put(pop, qf, keys);
+	}
+	ht_check(qf, keys);
+
+	struct qf_iterator qfi;
+	qfi_start(qf, &qfi);
+	while (!qfi_done(qf, &qfi))
+	{
+		assert(keys.count(qfi_next(qf, &qfi)));
+	}
+	while (!keys.empty())
+	{
+		ht_del(pop, qf, keys);
+	}
+	qf_consistent(qf);
+	qf_destroy(pop, qf);
+}
+
+/* Check the word kernels against slot-by-slot versions, with every kernel set. */
+static void qf_test_kernels(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	int kernels = qf_kernels();
+
+	for (int ks = QF_KERNELS_SCALAR; ks <= QF_KERNELS_BMI2; ++ks)
+	{
+		if (!qf_set_kernels(ks))
+		{
+			continue;
+		}
+		printf("Starting rounds for qf_test_kernels::set=%d\n", ks);
+
+		for (int i = 0; i < 10000; ++i)
+		{
+			uint64_t w = rand64() & rand64();
+			unsigned k = rand() % 66;
+			unsigned want = 64;
+			for (unsigned b = 0, seen = 0; b < 64; ++b)
+			{
+				if ((w >> b) & 1 && seen++ == k)
+				{
+					want = b;
+					break;
+				}
+			}
+			assert(bit_select(w, k) == want);
+		}
+
+		/* Fill past the point where clusters get long, then look up. */
+		for (uint32_t r = 1; r <= 13; r += 4)
+		{
+			assert(qf_init(pop, qf, 8, r));
+			set<uint64_t> keys;
+			while (keys.size() < 15 * D_RO(qf)->qf_max_size / 16)
+			{
+				ht_put(pop, qf, keys);
+			}
+			ht_check(qf, keys);
+			while (keys.size() > D_RO(qf)->qf_max_size / 2)
+			{
+				ht_del(pop, qf, keys);
+			}
+			ht_check(qf, keys);
+			qf_destroy(pop, qf);
+		}
+	}
+
+	assert(qf_set_kernels(kernels));
+	assert(qf_kernels() == kernels);
+	assert(!qf_set_kernels(-1));
+}
+
+/* Exercise the blocked format across block boundaries and the spill area. */
+static void qf_test_blocked(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	TOID(struct quotient_filter) qfout)
+{
+	const uint32_t qs[] = {3, 7, 10};
+	const uint32_t rs[] = {1, 5, 13};
+
+	for (size_t qi = 0; qi < sizeof(qs) / sizeof(qs[0]); ++qi)
+	{
+		for (size_t ri = 0; ri < sizeof(rs) / sizeof(rs[0]); ++ri)
+		{
+			uint32_t q = qs[qi];
+			uint32_t r = rs[ri];
+			printf("Starting rounds for qf_test_blocked::q=%u,r=%u\n", q, r);
+
+			assert(qf_init_blocked(pop, qf, q, r));
+			assert(qf_open(pop, qf));
+			qf_consistent(qf);
+
+			/* Fill up, then churn at high load. */
+			set<uint64_t> keys;
+			uint64_t size = D_RO(qf)->qf_max_size;
+			while (keys.size() < size)
+			{
+				ht_put(pop, qf, keys);
+			}
+			ht_check(qf, keys);
+			for (uint64_t i = 0; i < 4 * size; ++i)
+			{
+				if (keys.size() == size || (keys.size() && rand() % 2))
+				{
+					ht_del(pop, qf, keys);
+				}
+				else
+				{
+					ht_put(pop, qf, keys);
+				}
+				if (i % 64 == 0)
+				{
+					qf_consistent(qf);
+				}
+			}
+			ht_check(qf, keys);
+
+			/* The iterator yields every fingerprint in sorted order. */
+			struct qf_iterator qfi;
+			uint64_t prev = 0;
+			size_t seen = 0;
+			qfi_start(qf, &qfi);
+			while (!qfi_done(qf, &qfi))
+			{
+				uint64_t hash = qfi_next(qf, &qfi);
+				assert(keys.count(hash));
+				assert(seen == 0 || hash > prev);
+				prev = hash;
+				++seen;
+			}
+			assert(seen == keys.size());
+
+			/* A classic QF can be merged from a blocked one. */
+			assert(qf_merge(pop, qf, qf, qfout));
+			for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+			{
+				assert(qf_may_contain(qfout, *it));
+			}
+			qf_destroy(pop, qfout);
+
+			/* Batches go through the same code. */
+			vector<uint64_t> batch(keys.begin(), keys.end());
+			assert(qf_remove_batch(pop, qf, batch.data(), batch.size(), NULL) == batch.size());
+			qf_consistent(qf);
+			assert(D_RO(qf)->qf_entries == 0);
+			assert(qf_insert_batch(pop, qf, batch.data(), batch.size(), NULL) == batch.size());
+			ht_check(qf, keys);
+
+			qf_clear(pop, qf);
+			keys.clear();
+			qf_consistent(qf);
+			qf_destroy(pop, qf);
+			assert(!qf_open(pop, qf));
+		}
+	}
+}
+
+/*
+ * Bulk-build filters and compare them word for word with filters of the
+ * same keys built by inserts: the layout only depends on the key set.
+ */
+static void qf_test_build(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	TOID(struct quotient_filter) ref)
+{
+	const uint32_t qs[] = {3, 8, 14};
+	const double loads[] = {0.3, 0.95, 1.0};
+
+	for (int blocked = 0; blocked <= 1; ++blocked)
+	{
+		for (size_t qi = 0; qi < sizeof(qs) / sizeof(qs[0]); ++qi)
+		{
+			for (size_t li = 0; li < sizeof(loads) / sizeof(loads[0]); ++li)
+			{
+				if (blocked && loads[li] == 1.0)
+				{
+					continue;	/* a full blocked table can overflow its spill area */
+				}
+				uint32_t q = qs[qi];
+				uint32_t r = 7;
+				printf("Starting rounds for qf_test_build::blocked=%d,q=%u,load=%.2f\n",
+					   blocked, q, loads[li]);
+
+				bool (*init)(PMEMobjpool *, TOID(struct quotient_filter), uint32_t, uint32_t) =
+					blocked ? qf_init_blocked : qf_init;
+				assert(init(pop, qf, q, r));
+				assert(init(pop, ref, q, r));
+
+				/* Random keys with junk above q+r bits and some repeats. */
+				set<uint64_t> keys;
+				vector<uint64_t> hashes;
+				uint64_t want = (uint64_t)(loads[li] * D_RO(qf)->qf_max_size);
+				while (keys.size() < want)
+				{
+					uint64_t hash = rand64();
+					keys.insert(hash & LOW_MASK(q + r));
+					hashes.push_back(hash);
+					if (rand() % 8 == 0)
+					{
+						hashes.push_back(hash);
+					}
+				}
+				/* A full QF refuses even a repeat, so ref gets each key once. */
+				for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+				{
+					assert(qf_insert(pop, ref, *it));
+				}
+
+				assert(qf_build(pop, qf, hashes.data(), hashes.size()));
+				assert(qf_open(pop, qf));
+				ht_check(qf, keys);
+				assert(D_RO(qf)->qf_entries == D_RO(ref)->qf_entries);
+				size_t bytes = pmemobj_alloc_usable_size(D_RO(ref)->qf_table.oid);
+				bytes = min(bytes, pmemobj_alloc_usable_size(D_RO(qf)->qf_table.oid));
+				bytes = min<size_t>(bytes, blocked ? D_RO(qf)->qf_nblocks * (3 + r) * 8
+											: qf_table_size(q, r));
+				assert(!memcmp(D_RO(D_RO(qf)->qf_table), D_RO(D_RO(ref)->qf_table), bytes));
+
+				/* Unsorted input is refused and leaves the filter alone. */
+				if (hashes.size() > 1)
+				{
+					vector<uint64_t> desc(keys.rbegin(), keys.rend());
+					assert(!qf_build_from_sorted(pop, qf, desc.data(), desc.size()));
+					ht_check(qf, keys);
+				}
+
+				/* An empty build clears the filter. */
+				assert(qf_build_from_sorted(pop, qf, NULL, 0));
+				assert(D_RO(qf)->qf_entries == 0);
+				qf_consistent(qf);
+
+				qf_destroy(pop, qf);
+				qf_destroy(pop, ref);
+			}
+		}
+	}
+
+	/* A refused build frees its buffers, though its abort skips the code after TX_END. */
+	printf("Starting rounds for qf_test_build::leak\n");
+	for (int blocked = 0; blocked <= 1; ++blocked)
+	{
+		assert(blocked ? qf_init_blocked(pop, qf, 10, 7) : qf_init(pop, qf, 10, 7));
+		/* A run on the last quotient, which wraps in a classic build, then a step back. */
+		vector<uint64_t> bad;
+		for (uint64_t rem = 0; rem < 16; ++rem)
+		{
+			bad.push_back(((D_RO(qf)->qf_max_size - 1) << 7) | rem);
+		}
+		bad.push_back(5);
+		assert(!qf_build_from_sorted(pop, qf, bad.data(), bad.size()));
+		size_t before = mallinfo2().uordblks;
+		for (int i = 0; i < 8; ++i)
+		{
+			assert(!qf_build_from_sorted(pop, qf, bad.data(), bad.size()));
+		}
+		assert(mallinfo2().uordblks == before);
+		qf_consistent(qf);
+		qf_destroy(pop, qf);
+	}
+}
+
+/*
+ * Merge several filters of mixed formats and sizes. The result must match,
+ * word for word, a filter that got the same fingerprints by qf_insert().
+ */
+static void qf_test_merge_many(PMEMobjpool *pop, TOID(struct quotient_filter) qfout,
+	TOID(struct quotient_filter) ref)
+{
+	const char *names[] = {"merge-0", "merge-1", "merge-2", "merge-3", "merge-4"};
+	const size_t nnames = sizeof(names) / sizeof(names[0]);
+	TOID(struct quotient_filter) qfs[nnames];
+
+	for (size_t k = 1; k <= nnames; ++k)
+	{
+		printf("Starting rounds for qf_test_merge_many::k=%zu\n", k);
+		for (int round = 0; round < 20; ++round)
+		{
+			set<uint64_t> all;
+			vector<uint64_t> prev;
+			for (size_t i = 0; i < k; ++i)
+			{
+				qf_dir_drop(pop, names[i]);
+				uint32_t q = 2 + rand() % 9;
+				uint32_t r = 1 + rand() % 12;
+				qfs[i] = qf_dir_create(pop, names[i], q, r);
+				assert(!TOID_IS_NULL(qfs[i]));
+				if (rand() % 3 == 0)
+				{
+					qf_destroy(pop, qfs[i]);
+					assert(qf_init_blocked(pop, qfs[i], q, r));
+				}
+
+				/* Dense fills wrap clusters around the end; some keys repeat. */
+				set<uint64_t> keys;
+				uint64_t want = D_RO(qfs[i])->qf_max_size * (rand() % 101) / 100;
+				while (keys.size() < want)
+				{
+					uint64_t hash = rand64() & LOW_MASK(q + r);
+					if (rand() % 4 == 0 && !prev.empty())
+					{
+						hash = prev[rand() % prev.size()] & LOW_MASK(q + r);
+					}
+					if (qf_insert(pop, qfs[i], hash))
+					{
+						keys.insert(hash);
+					}
+					else
+					{
+						break;
+					}
+				}
+				all.insert(keys.begin(), keys.end());
+				prev.assign(all.begin(), all.end());
+			}
+
+			assert(qf_merge_many(pop, qfs, k, qfout));
+			qf_consistent(qfout);
+			ht_check(qfout, all);
+			assert(D_RO(qfout)->qf_entries == all.size());
+
+			uint32_t q = D_RO(qfout)->qf_qbits;
+			uint32_t r = D_RO(qfout)->qf_rbits;
+			assert(qf_init(pop, ref, q, r));
+			for (set<uint64_t>::iterator it = all.begin(); it != all.end(); ++it)
+			{
+				assert(qf_insert(pop, ref, *it));
+			}
+			assert(!memcmp(D_RO(D_RO(qfout)->qf_table), D_RO(D_RO(ref)->qf_table),
+						   qf_table_size(q, r)));
+			qf_destroy(pop, qfout);
+			qf_destroy(pop, ref);
+		}
+	}
+	for (size_t i = 0; i < nnames; ++i)
+	{
+		qf_dir_drop(pop, names[i]);
+	}
+	assert(!qf_merge_many(pop, qfs, 0, qfout));
+}
+
+/*
+ * Resize filters of both formats up and down. The fingerprints must all
+ * survive, and the table must match one that got them by qf_insert().
+ */
+static void qf_test_resize(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	TOID(struct quotient_filter) ref)
 {
+	const uint32_t qs[] = {3, 6, 12};
+	const uint32_t bits = 16;
+
+	for (int blocked = 0; blocked <= 1; ++blocked)
+	{
+		for (size_t qi = 0; qi < sizeof(qs) / sizeof(qs[0]); ++qi)
+		{
+			uint32_t q = qs[qi];
+			printf("Starting rounds for qf_test_resize::blocked=%d,q=%u\n", blocked, q);
+
+			bool (*init)(PMEMobjpool *, TOID(struct quotient_filter), uint32_t, uint32_t) =
+				blocked ? qf_init_blocked : qf_init;
+			assert(init(pop, qf, q, bits - q));
+			set<uint64_t> keys;
+			while (keys.size() < D_RO(qf)->qf_max_size * 9 / 10)
+			{
+				ht_put(pop, qf, keys);
+			}
+
+			/* Out of range, or too small for the entries. */
+			assert(!qf_resize(pop, qf, bits));
+			assert(!qf_resize(pop, qf, 0));
+			assert(!qf_resize(pop, qf, q - 1));
+			assert(qf_resize(pop, qf, q));
+			ht_check(qf, keys);
+
+			const int steps[] = {1, 2, -1, -2};
+			for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i)
+			{
+				uint32_t nq = D_RO(qf)->qf_qbits + steps[i];
+				assert(qf_resize(pop, qf, nq));
+				assert(qf_open(pop, qf));
+				assert(D_RO(qf)->qf_qbits == nq && D_RO(qf)->qf_rbits == bits - nq);
+				assert(D_RO(qf)->qf_format == (blocked ? QF_FORMAT_BLOCKED : QF_FORMAT_CLASSIC));
+				assert(D_RO(qf)->qf_entries == keys.size());
+				ht_check(qf, keys);
+
+				assert(init(pop, ref, nq, bits - nq));
+				for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+				{
+					assert(qf_insert(pop, ref, *it));
+				}
+				size_t bytes = blocked ? D_RO(qf)->qf_nblocks * (3 + bits - nq) * 8
+									   : qf_table_size(nq, bits - nq);
+				assert(!memcmp(D_RO(D_RO(qf)->qf_table), D_RO(D_RO(ref)->qf_table), bytes));
+				qf_destroy(pop, ref);
+			}
+			qf_destroy(pop, qf);
+		}
+	}
+
+	/* Auto-grow keeps the load under the threshold as keys come in. */
+	printf("Starting rounds for qf_test_resize::autogrow\n");
+	assert(qf_init(pop, qf, 2, bits - 2));
+	assert(qf_set_max_load(pop, qf, 75, QF_FULL_RESIZE, TOID_NULL(struct quotient_filter)));
+	set<uint64_t> keys;
+	for (int i = 0; i < 3000; ++i)
+	{
+		uint64_t hash = rand64() & LOW_MASK(bits);
+		assert(qf_insert(pop, qf, hash));
+		keys.insert(hash);
+		assert(D_RO(qf)->qf_entries * 100 <= D_RO(qf)->qf_max_size * 75);
+	}
+	vector<uint64_t> batch;
+	for (int i = 0; i < 5000; ++i)
+	{
+		batch.push_back(rand64() & LOW_MASK(bits));
+		keys.insert(batch.back());
+	}
+	assert(qf_insert_batch(pop, qf, batch.data(), batch.size(), NULL) == batch.size());
+	assert(D_RO(qf)->qf_entries == keys.size());
+	assert(D_RO(qf)->qf_entries * 100 <= D_RO(qf)->qf_max_size * 75);
+	assert(D_RO(qf)->qf_max_load == 75);
+	assert(qf_open(pop, qf));
+	ht_check(qf, keys);
+
+	/* Without a remainder bit left to give, inserts stop at the cap. */
+	while (D_RO(qf)->qf_rbits > 1)
+	{
+		assert(qf_insert(pop, qf, rand64()));
+	}
+	while (D_RO(qf)->qf_entries < D_RO(qf)->qf_max_size * 3 / 4)
+	{
+		assert(qf_insert(pop, qf, rand64()));
+	}
+	assert(!qf_insert(pop, qf, rand64()));
+	qf_destroy(pop, qf);
+}
+
+/*
+ * Check the maximum load and the three things an insert past it can do.
+ */
+static void qf_test_load(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	TOID(struct quotient_filter) spill)
+{
+	const uint32_t q = 10;
+	const uint32_t r = 8;
+	TOID(struct quotient_filter) none = TOID_NULL(struct quotient_filter);
+	struct qf_load_info info;
+
+	printf("Starting rounds for qf_test_load::reject\n");
+	assert(qf_init(pop, qf, q, r));
+	assert(D_RO(qf)->qf_max_load == 100 && D_RO(qf)->qf_full_policy == QF_FULL_REJECT);
+	qf_load(qf, &info);
+	assert(info.ql_entries == 0 && info.ql_limit == (1ULL << q));
+	assert(info.ql_load == 0.0 && info.ql_cluster == 1.0);
+
+	assert(!qf_set_max_load(pop, qf, 0, QF_FULL_REJECT, none));
+	assert(!qf_set_max_load(pop, qf, 101, QF_FULL_REJECT, none));
+	assert(!qf_set_max_load(pop, qf, 50, QF_FULL_SPILL + 1, none));
+	assert(!qf_set_max_load(pop, qf, 50, QF_FULL_SPILL, none));
+	assert(!qf_set_max_load(pop, qf, 50, QF_FULL_SPILL, qf));
+	assert(qf_set_max_load(pop, qf, 50, QF_FULL_REJECT, none));
+	assert(qf_open(pop, qf));
+
+	set<uint64_t> keys;
+	while (keys.size() < (1ULL << q) / 2)
+	{
+		ht_put(pop, qf, keys);
+	}
+	qf_load(qf, &info);
+	assert(info.ql_entries == keys.size() && info.ql_limit == keys.size());
+	assert(info.ql_load == 0.5 && info.ql_cluster == 2.5);
+	uint64_t hash = genhash(qf, true, keys);
+	assert(!qf_insert(pop, qf, hash));
+	assert(!qf_may_contain(qf, hash));
+	assert(qf_insert_batch(pop, qf, &hash, 1, NULL) == 0);
+
+	/* A remove makes room for one more. */
+	ht_del(pop, qf, keys);
+	assert(qf_insert(pop, qf, hash));
+	keys.insert(hash);
+	assert(!qf_insert(pop, qf, genhash(qf, true, keys)));
+	ht_check(qf, keys);
+
+	/* Raising the cap lets inserts go on. */
+	assert(qf_set_max_load(pop, qf, 90, QF_FULL_REJECT, none));
+	while (keys.size() < (1ULL << q) * 9 / 10)
+	{
+		ht_put(pop, qf, keys);
+	}
+	assert(!qf_insert(pop, qf, genhash(qf, true, keys)));
+	qf_load(qf, &info);
+	assert(info.ql_cluster > 40 && info.ql_cluster < 60);
+
+	printf("Starting rounds for qf_test_load::spill\n");
+	assert(qf_init(pop, spill, q - 2, r + 2));
+	assert(qf_set_max_load(pop, qf, 90, QF_FULL_SPILL, spill));
+	assert(qf_open(pop, qf));
+	set<uint64_t> spilled;
+	for (int i = 0; i < 50; ++i)
+	{
+		hash = genhash(qf, true, keys);
+		assert(qf_insert(pop, qf, hash));
+		keys.insert(hash);
+		spilled.insert(hash);
+	}
+	vector<uint64_t> batch;
+	for (int i = 0; i < 50; ++i)
+	{
+		batch.push_back(genhash(qf, true, keys));
+		keys.insert(batch.back());
+		spilled.insert(batch.back());
+	}
+	bool res[50];
+	assert(qf_insert_batch(pop, qf, batch.data(), batch.size(), res) == batch.size());
+	assert(count(res, res + 50, true) == 50);
+	assert(D_RO(qf)->qf_entries == (1ULL << q) * 9 / 10);
+	assert(D_RO(spill)->qf_entries == spilled.size());
+	ht_check(spill, spilled);
+
+	/* Lookups and removes see the spilled keys through qf. */
+	for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+	{
+		assert(qf_may_contain(qf, *it));
+	}
+	vector<uint64_t> all(keys.begin(), keys.end());
+	vector<uint8_t> out(all.size());
+	qf_may_contain_batch(qf, all.data(), all.size(), out.data());
+	for (size_t i = 0; i < out.size(); ++i)
+	{
+		assert(out[i]);
+	}
+	hash = *spilled.begin();
+	assert(qf_remove(pop, qf, hash));
+	assert(!qf_may_contain(qf, hash));
+	assert(D_RO(spill)->qf_entries == spilled.size() - 1);
+
+	/* A full spill rejects in turn, without following its own spill. */
+	assert(qf_set_max_load(pop, spill, 100, QF_FULL_SPILL, qf));
+	while (D_RO(spill)->qf_entries < D_RO(spill)->qf_max_size)
+	{
+		assert(qf_insert(pop, spill, rand64() & LOW_MASK(q + r)));
+	}
+	assert(!qf_insert(pop, qf, genhash(qf, true, keys)));
+
+	qf_destroy(pop, spill);
+	qf_destroy(pop, qf);
+}
+
+/*
+ * Run lookups from several threads while one thread inserts and removes.
+ * Keys that are present throughout must always be found, and keys that
+ * are never inserted must never be (fingerprints are exact here).
+ */
+/* Slots a counting QF with r-bit remainders takes for count c of remainder x. */
+static uint64_t count_slots(uint64_t x, uint64_t c, uint32_t r)
+{
+	if (c <= 1)
+	{
+		return c;
+	}
+	uint64_t base = (1ULL << r) - (x ? 2 : 1);
+	uint64_t k = 0;
+	uint64_t top = 0;
+	for (uint64_t val = c - 2; val; val /= base)
+	{
+		top = val % base;
+		++k;
+	}
+	if (x == 0)
+	{
+		return 3 + k;
+	}
+	uint64_t first = top + ((top + 1 >= x) ? 2 : 1);
+	return 2 + k + (k && first > x);
+}
+
+static uint64_t random_count()
+{
+	switch (rand() % 4)
+	{
+	case 0:
+		return 1;
+	case 1:
+		return 1 + rand() % 5;
+	case 2:
+		return 1 + rand() % 1000;
+	default:
+		return 1 + (rand64() >> (rand() % 64));
+	}
+}
+
+/* Check a counting QF against the true counts, slot for slot. */
+static void count_check(TOID(struct quotient_filter) qf, map<uint64_t, uint64_t> &counts)
+{
+	uint32_t r = D_RO(qf)->qf_rbits;
+	uint64_t slots = 0;
+	set<uint64_t> live;
+
+	qf_consistent(qf);
+	for (map<uint64_t, uint64_t>::iterator it = counts.begin(); it != counts.end(); ++it)
+	{
+		assert(qf_count(qf, it->first) == it->second);
+		assert(qf_may_contain(qf, it->first) == (it->second != 0));
+		slots += count_slots(it->first & LOW_MASK(r), it->second, r);
+		if (it->second)
+		{
+			live.insert(it->first);
+		}
+	}
+	assert(D_RO(qf)->qf_entries == slots);
+
+	/* The iterator returns every fingerprint once. */
+	struct qf_iterator qfi;
+	set<uint64_t> seen;
+	qfi_start(qf, &qfi);
+	while (!qfi_done(qf, &qfi))
+	{
+		assert(seen.insert(qfi_next(qf, &qfi)).second);
+	}
+	assert(seen == live);
+}
+
+static void qf_test_counting(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	TOID(struct quotient_filter) other)
+{
+	const uint32_t q = 8;
+	const uint32_t rs[] = {2, 3, 5, 12};
+	TOID(struct quotient_filter) none = TOID_NULL(struct quotient_filter);
+
+	assert(!qf_init_counting(pop, qf, q, 1));
+	for (size_t ri = 0; ri < sizeof(rs) / sizeof(rs[0]); ++ri)
+	{
+		uint32_t r = rs[ri];
+		printf("Starting rounds for qf_test_counting::r=%u\n", r);
+		assert(qf_init_counting(pop, qf, q, r));
+		assert(qf_open(pop, qf) && D_RO(qf)->qf_counting);
+		if (ri == 1)
+		{
+			assert(qf_set_max_load(pop, qf, 50, QF_FULL_REJECT, none));
+		}
+		uint64_t limit = load_limit(q, D_RO(qf)->qf_max_load);
+
+		/*
+		 * A few fingerprints crowded into the lowest and highest
+		 * quotients, so that counters share runs and clusters and wrap
+		 * around the table; remainders 0, 1 and the largest are the
+		 * edge cases of the encoding.
+		 */
+		vector<uint64_t> fps;
+		while (fps.size() < 24)
+		{
+			uint64_t quot = (rand() % 2) ? rand() % 6 : LOW_MASK(q) - rand() % 3;
+			uint64_t rem;
+			switch (rand() % 4)
+			{
+			case 0:
+				rem = 0;
+				break;
+			case 1:
+				rem = 1;
+				break;
+			case 2:
+				rem = LOW_MASK(r);
+				break;
+			default:
+				rem = rand64() & LOW_MASK(r);
+			}
+			uint64_t fp = (quot << r) | rem;
+			if (find(fps.begin(), fps.end(), fp) == fps.end())
+			{
+				fps.push_back(fp);
+			}
+		}
+
+		map<uint64_t, uint64_t> counts;
+		for (int i = 0; i < 3000; ++i)
+		{
+			uint64_t fp = fps[rand() % fps.size()];
+			uint64_t old = counts[fp];
+			uint64_t x = fp & LOW_MASK(r);
+			uint64_t entries = D_RO(qf)->qf_entries;
+
+			if (rand() % 3)
+			{
+				uint64_t c = (rand() % 4) ? random_count() : 1;
+				bool fits = c <= UINT64_MAX - old &&
+					entries - count_slots(x, old, r) + count_slots(x, old + c, r) <= limit;
+				bool ok = (c == 1 && rand() % 2) ? qf_insert(pop, qf, fp)
+					: qf_insert_count(pop, qf, fp, c);
+				assert(ok == fits);
+				if (ok)
+				{
+					counts[fp] = old + c;
+				}
+			}
+			else
+			{
+				uint64_t c = (rand() % 4) ? random_count() : 1;
+				assert((c == 1 && rand() % 2) ? qf_remove(pop, qf, fp)
+					: qf_remove_count(pop, qf, fp, c));
+				counts[fp] = (c < old) ? old - c : 0;
+			}
+			assert(qf_count(qf, fp) == counts[fp]);
+			if (i % 100 == 0)
+			{
+				count_check(qf, counts);
+			}
+		}
+		count_check(qf, counts);
+
+		/* The batch paths add and take one at a time. */
+		vector<uint64_t> batch(fps.begin(), fps.begin() + 8);
+		batch.insert(batch.end(), fps.begin(), fps.begin() + 4);
+		size_t added = qf_insert_batch(pop, qf, batch.data(), batch.size(), NULL);
+		for (size_t j = 0; j < added; ++j)
+		{
+			++counts[batch[j]];
+		}
+		if (added == batch.size())
+		{
+			count_check(qf, counts);
+		}
+		qf_remove_batch(pop, qf, fps.data(), fps.size(), NULL);
+		for (size_t j = 0; j < fps.size(); ++j)
+		{
+			counts[fps[j]] = 0;
+		}
+		for (size_t j = 0; j < fps.size(); ++j)
+		{
+			qf_remove_count(pop, qf, fps[j], UINT64_MAX);
+		}
+		count_check(qf, counts);
+		assert(D_RO(qf)->qf_entries == 0);
+	}
+
+	printf("Starting rounds for qf_test_counting::unsupported\n");
+	assert(qf_init_counting(pop, qf, q, 4));
+	assert(qf_insert_count(pop, qf, 5, 3));
+	assert(!qf_insert_count(pop, qf, 5, 0));
+	assert(!qf_remove_count(pop, qf, 5, 0));
+	assert(!qf_insert_count(pop, qf, 5, UINT64_MAX));
+	assert(qf_count(qf, 5) == 3);
+	uint64_t hash = 5;
+	struct qf_sync sync;
+	assert(!qf_build(pop, qf, &hash, 1));
+	assert(!qf_resize(pop, qf, q + 1));
+	assert(!qf_sync_init(pop, qf, &sync));
+	assert(!qf_set_max_load(pop, qf, 90, QF_FULL_RESIZE, none));
+	assert(!qf_merge(pop, qf, qf, other));
+	assert(qf_count(qf, 5) == 3);
+
+	/* Counts spill like inserts, and a plain QF holds at most one. */
+	assert(qf_init(pop, other, q, 4));
+	assert(qf_set_max_load(pop, qf, 1, QF_FULL_SPILL, other));
+	assert(qf_insert_count(pop, qf, 7, 4));
+	assert(qf_count(other, 7) == 1 && qf_count(qf, 7) == 1);
+	assert(qf_insert_count(pop, qf, 5, 2));
+	assert(qf_count(qf, 5) == 5);
+	/* A count that needs another slot spills too. */
+	assert(qf_insert_count(pop, qf, 5, 2));
+	assert(qf_count(qf, 5) == 6 && D_RO(qf)->qf_entries == 3);
+	assert(qf_remove_count(pop, qf, 7, 2));
+	assert(qf_count(qf, 7) == 0);
+	qf_destroy(pop, other);
+	qf_destroy(pop, qf);
+}
+
+static void qf_test_keys(PMEMobjpool *pop, TOID(struct quotient_filter) qf,
+	TOID(struct quotient_filter) other, TOID(struct quotient_filter) out)
+{
+	const uint32_t q = 12;
+	const uint32_t r = 6;
+	uint64_t hash;
+	uint64_t again;
+
+	printf("Starting rounds for qf_test_keys::wy\n");
+	assert(qf_init(pop, qf, q, r));
+	assert(D_RO(qf)->qf_hash == QF_HASH_WY && D_RO(qf)->qf_seed == 0);
+	assert(!qf_set_hash(pop, qf, QF_HASH_INVERTIBLE + 1, 0));
+
+	/* Every length takes a different path through the short-key reads. */
+	vector<vector<uint8_t> > keys;
+	set<uint64_t> hashes;
+	for (size_t len = 0; len <= 40; ++len)
+	{
+		for (int i = 0; i < 20; ++i)
+		{
+			vector<uint8_t> key(len);
+			for (size_t j = 0; j < len; ++j)
+			{
+				key[j] = rand();
+			}
+			keys.push_back(key);
+		}
+	}
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		assert(qf_hash_key(qf, keys[i].data(), keys[i].size(), &hash));
+		assert(hash < (1ULL << (q + r)));
+		assert(qf_insert_key(pop, qf, keys[i].data(), keys[i].size()));
+		hashes.insert(hash);
+	}
+	ht_check(qf, hashes);
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		assert(qf_may_contain_key(qf, keys[i].data(), keys[i].size()));
+	}
+
+	/* A trailing zero byte, a flipped bit or another seed changes the hash. */
+	const char abc[] = "abcdefghijklmnopqrstuvwxyz";
+	for (size_t len = 1; len < sizeof(abc); ++len)
+	{
+		vector<char> key(abc, abc + len);
+		assert(qf_hash_key(qf, key.data(), len, &hash));
+		key.push_back(0);
+		assert(qf_hash_key(qf, key.data(), len + 1, &again));
+		assert(hash != again);
+		key[len / 2] ^= 1;
+		assert(qf_hash_key(qf, key.data(), len, &again));
+		assert(hash != again);
+	}
+	assert(!qf_set_hash(pop, qf, QF_HASH_WY, 42));
+	assert(qf_hash_key(qf, abc, 8, &hash));
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		assert(qf_remove_key(pop, qf, keys[i].data(), keys[i].size()));
+	}
+	assert(D_RO(qf)->qf_entries == 0);
+	assert(qf_set_hash(pop, qf, QF_HASH_WY, 42));
+	assert(qf_open(pop, qf));
+	assert(qf_hash_key(qf, abc, 8, &again));
+	assert(hash != again);
+
+	/* The batched hash agrees with the one-key hash. */
+	vector<uint64_t> ints(1000);
+	vector<uint64_t> res(ints.size());
+	for (size_t i = 0; i < ints.size(); ++i)
+	{
+		ints[i] = rand64();
+	}
+	assert(qf_hash_keys(qf, ints.data(), ints.size(), res.data()));
+	for (size_t i = 0; i < ints.size(); ++i)
+	{
+		uint8_t buf[8];
+		for (int j = 0; j < 8; ++j)
+		{
+			buf[j] = ints[i] >> (8 * j);
+		}
+		assert(qf_hash_key(qf, buf, 8, &hash) && hash == res[i]);
+	}
+	assert(!qf_unhash(qf, res[0], &hash));
+
+	/* Inputs hashed differently cannot be merged. */
+	assert(qf_init(pop, other, q, r));
+	assert(!qf_merge(pop, qf, other, out));
+	assert(qf_set_hash(pop, other, QF_HASH_WY, 42));
+
+	/* A merge keeps q+r, so every key of every input is still found. */
+	TOID(struct quotient_filter) third = qf_dir_create(pop, "keys-third", q, r);
+	assert(!TOID_IS_NULL(third));
+	assert(qf_set_hash(pop, third, QF_HASH_WY, 42));
+	TOID(struct quotient_filter) ins[3] = {qf, other, third};
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		assert(qf_insert_key(pop, ins[i % 3], keys[i].data(), keys[i].size()));
+	}
+	for (size_t k = 2; k <= 3; ++k)
+	{
+		assert(qf_merge_many(pop, ins, k, out));
+		qf_consistent(out);
+		assert(D_RO(out)->qf_hash == QF_HASH_WY && D_RO(out)->qf_seed == 42);
+		assert(D_RO(out)->qf_qbits == q + k - 1);
+		assert(D_RO(out)->qf_qbits + D_RO(out)->qf_rbits == q + r);
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			assert(i % 3 >= k || qf_may_contain_key(out, keys[i].data(), keys[i].size()));
+		}
+		qf_destroy(pop, out);
+	}
+
+	/* Inputs of another q+r only leave the fingerprints to merge. */
+	qf_dir_drop(pop, "keys-third");
+	third = qf_dir_create(pop, "keys-third", q, r + 1);
+	assert(qf_set_hash(pop, third, QF_HASH_WY, 42));
+	assert(qf_merge_many(pop, ins, 3, out));
+	assert(D_RO(out)->qf_hash == QF_HASH_NONE);
+	assert(!qf_hash_key(out, abc, 8, &hash));
+	assert(!qf_insert_key(pop, out, abc, 8));
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		assert(!qf_may_contain_key(out, keys[i].data(), keys[i].size()));
+		if (i % 3 == 0)
+		{
+			assert(qf_hash_key(qf, keys[i].data(), keys[i].size(), &hash));
+			assert(qf_may_contain(out, hash));
+		}
+	}
+	qf_destroy(pop, out);
+	qf_dir_drop(pop, "keys-third");
+	qf_destroy(pop, other);
+	qf_clear(pop, qf);
+
+	printf("Starting rounds for qf_test_keys::invertible\n");
+	/* Small widths: the hash is a bijection and unhash undoes it. */
+	for (uint32_t bits = 2; bits <= 12; ++bits)
+	{
+		assert(qf_init(pop, other, bits - 1, 1));
+		assert(qf_set_hash(pop, other, QF_HASH_INVERTIBLE, rand64()));
+		vector<bool> hit(1ULL << bits);
+		for (uint64_t k = 0; k < (1ULL << bits); ++k)
+		{
+			assert(qf_hash_key(other, &k, sizeof(k), &hash));
+			assert(!hit[hash]);
+			hit[hash] = true;
+			assert(qf_unhash(other, hash, &again) && again == k);
+		}
+		uint64_t k = 1ULL << bits;
+		assert(!qf_hash_key(other, &k, sizeof(k), &hash));
+		assert(!qf_insert_key(pop, other, &k, sizeof(k)));
+		qf_destroy(pop, other);
+	}
+
+	assert(qf_set_hash(pop, qf, QF_HASH_INVERTIBLE, 7));
+	set<uint64_t> inserted;
+	while (inserted.size() < (1ULL << q) / 2)
+	{
+		uint64_t k = rand64() & LOW_MASK(q + r);
+		assert(qf_insert_key(pop, qf, &k, sizeof(k)));
+		inserted.insert(k);
+	}
+	vector<uint64_t> ks(inserted.begin(), inserted.end());
+	vector<uint64_t> hs(ks.size());
+	assert(qf_hash_keys(qf, ks.data(), ks.size(), hs.data()));
+	for (size_t i = 0; i < ks.size(); ++i)
+	{
+		assert(qf_hash_key(qf, &ks[i], sizeof(ks[i]), &hash) && hash == hs[i]);
+	}
+	ks.push_back(1ULL << (q + r));
+	hs.push_back(0);
+	assert(!qf_hash_keys(qf, ks.data(), ks.size(), hs.data()));
+
+	/* The iterator gives the keys back, before and after a resize. */
+	for (int round = 0; round < 2; ++round)
+	{
+		struct qf_iterator qfi;
+		set<uint64_t> seen;
+		qfi_start(qf, &qfi);
+		while (!qfi_done(qf, &qfi))
+		{
+			uint64_t k;
+			assert(qf_unhash(qf, qfi_next(qf, &qfi), &k));
+			seen.insert(k);
+		}
+		assert(seen == inserted);
+		assert(qf_resize(pop, qf, q + 1));
+	}
+
+	/* No false positives: every key below 2^(q+r) is exact. */
+	for (int i = 0; i < 10000; ++i)
+	{
+		uint64_t k = rand64() & LOW_MASK(q + r);
+		assert(qf_may_contain_key(qf, &k, sizeof(k)) == (inserted.count(k) != 0));
+	}
+
+	/* Merging keeps the hash as long as q+r stays. */
+	TOID(struct quotient_filter) one[1] = {qf};
+	assert(qf_merge_many(pop, one, 1, other));
+	assert(D_RO(other)->qf_hash == QF_HASH_INVERTIBLE && D_RO(other)->qf_seed == 7);
+	for (set<uint64_t>::iterator it = inserted.begin(); it != inserted.end(); ++it)
+	{
+		assert(qf_may_contain_key(other, &*it, sizeof(*it)));
+	}
+	assert(qf_merge(pop, qf, other, out));
+	assert(D_RO(out)->qf_hash == QF_HASH_INVERTIBLE && D_RO(out)->qf_seed == 7);
+	for (set<uint64_t>::iterator it = inserted.begin(); it != inserted.end(); ++it)
+	{
+		assert(qf_may_contain_key(out, &*it, sizeof(*it)));
+	}
+	qf_destroy(pop, out);
+	qf_destroy(pop, other);
+	qf_destroy(pop, qf);
+}
+
+/* Check the parts of qf_stats() that follow from each other. */
+static void stats_consistent(TOID(struct quotient_filter) qf, const struct qf_stats &st)
+{
+	uint64_t clusters = 0;
+	uint64_t runs = 0;
+	for (int b = 0; b < QF_STATS_BUCKETS; ++b)
+	{
+		clusters += st.qs_cluster_hist[b];
+		runs += st.qs_run_hist[b];
+	}
+	assert(clusters == st.qs_clusters && runs == st.qs_runs);
+	assert(st.qs_used == D_RO(qf)->qf_entries);
+	assert(st.qs_clusters <= st.qs_runs && st.qs_runs <= st.qs_used);
+	assert(st.qs_longest_run <= st.qs_longest_cluster);
+	assert(st.qs_shifted >= st.qs_used - st.qs_runs);
+}
+
+static void qf_test_stats(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t q = 10;
+	const uint32_t r = 8;
+	struct qf_stats st;
+
+	printf("Starting rounds for qf_test_stats::layout\n");
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, q, r) : qf_init_blocked(pop, qf, q, r));
+		qf_stats(qf, &st);
+		assert(st.qs_used == 0 && st.qs_clusters == 0 && st.qs_longest_cluster == 0);
+
+		/* Quotient 5 three times and 6 once: one cluster of 4, runs of 3 and 1. */
+		const uint64_t quots[] = {5, 5, 5, 6, 100};
+		for (size_t i = 0; i < sizeof(quots) / sizeof(quots[0]); ++i)
+		{
+			assert(qf_insert(pop, qf, (quots[i] << r) | i));
+		}
+		qf_stats(qf, &st);
+		stats_consistent(qf, st);
+		assert(st.qs_fingerprints == 5 && st.qs_used == 5);
+		assert(st.qs_clusters == 2 && st.qs_runs == 3);
+		assert(st.qs_longest_cluster == 4 && st.qs_longest_run == 3);
+		assert(st.qs_shifted == 3 && st.qs_shifted_frac == 0.6);
+		assert(st.qs_mean_cluster == 2.5);
+		assert(st.qs_cluster_hist[0] == 1 && st.qs_cluster_hist[2] == 1);
+		assert(st.qs_run_hist[0] == 2 && st.qs_run_hist[1] == 1);
+		qf_destroy(pop, qf);
+	}
+
+	/* A classic cluster may wrap around the end of the table. */
+	assert(qf_init(pop, qf, q, r));
+	for (uint64_t i = 0; i < 3; ++i)
+	{
+		assert(qf_insert(pop, qf, (LOW_MASK(q) << r) | i));
+	}
+	assert(qf_insert(pop, qf, 1ULL << r));
+	qf_stats(qf, &st);
+	assert(st.qs_clusters == 1 && st.qs_runs == 2 && st.qs_longest_cluster == 4);
+
+	/* A counter is part of its run but not another fingerprint. */
+	assert(qf_init_counting(pop, qf, q, r));
+	assert(qf_insert_count(pop, qf, (7 << r) | 3, 2));
+	assert(qf_insert(pop, qf, (7 << r) | 9));
+	qf_stats(qf, &st);
+	assert(st.qs_fingerprints == 2 && st.qs_used == 3 && st.qs_longest_run == 3);
+
+	printf("Starting rounds for qf_test_stats::fpr\n");
+	const uint32_t fq = 14;
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, fq, r) : qf_init_blocked(pop, qf, fq, r));
+		set<uint64_t> keys;
+		while (keys.size() < (1ULL << fq) / 2)
+		{
+			ht_put(pop, qf, keys);
+		}
+		qf_stats(qf, &st);
+		stats_consistent(qf, st);
+		assert(st.qs_fingerprints == keys.size());
+		double uniform = st.qs_shifted_frac;
+
+		/* Random fingerprints hit at the expected rate, within 5 sigma. */
+		struct qf_fpr fpr;
+		const size_t n = 1 << 20;
+		qf_measure_fpr(qf, NULL, n, &fpr);
+		assert(fpr.qp_probes == n);
+		assert(fpr.qp_expected == (double)keys.size() / (1ULL << (fq + r)));
+		assert(fabs(fpr.qp_rate - fpr.qp_expected) < 5 * sqrt(fpr.qp_expected / n));
+
+		/*
+		 * So do 64-bit hashes kept apart from the keys, which collide
+		 * with them in the low q+r bits; the keys themselves all hit.
+		 */
+		vector<uint64_t> probes;
+		while (probes.size() < n)
+		{
+			uint64_t h = rand64();
+			if (!keys.count(h))
+			{
+				probes.push_back(h);
+			}
+		}
+		qf_measure_fpr(qf, probes.data(), probes.size(), &fpr);
+		assert(fabs(fpr.qp_rate - fpr.qp_expected) < 5 * sqrt(fpr.qp_expected / n));
+		vector<uint64_t> all(keys.begin(), keys.end());
+		qf_measure_fpr(qf, all.data(), all.size(), &fpr);
+		assert(fpr.qp_hits == all.size() && fpr.qp_rate == 1.0);
+
+		/* Keys crowded into one quotient in 64 show up as shifting. */
+		assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, fq, r) : qf_init_blocked(pop, qf, fq, r));
+		keys.clear();
+		while (keys.size() < (1ULL << fq) / 16)
+		{
+			uint64_t h = ((rand64() & LOW_MASK(fq - 6)) << (r + 6)) | (rand64() & LOW_MASK(r));
+			if (keys.insert(h).second)
+			{
+				assert(qf_insert(pop, qf, h));
+			}
+		}
+		qf_stats(qf, &st);
+		stats_consistent(qf, st);
+		assert(st.qs_shifted_frac > uniform);
+		qf_destroy(pop, qf);
+	}
+}
+
+static void qf_test_sync(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t q = 12;
+	const uint32_t r = 8;
+	const int readers = 4;
+
+	assert(qf_init(pop, qf, q, r));
+
+	struct qf_sync s;
+	assert(qf_sync_init(pop, qf, &s));
+
+	/* Disjoint key sets: stable, added, dropped, never inserted. */
+	set<uint64_t> keys;
+	vector<uint64_t> stable, added, dropped, absent;
+	vector<uint64_t> *sets[] = {&stable, &added, &dropped, &absent};
+	for (uint64_t i = 0; i < 3 * (1ULL << q) / 4; ++i)
+	{
+		uint64_t hash = genhash(qf, true, keys);
+		keys.insert(hash);
+		sets[i % 4]->push_back(hash);
+	}
+	for (size_t i = 0; i < stable.size(); ++i)
+	{
+		assert(qf_sync_insert(&s, stable[i]));
+	}
+	for (size_t i = 0; i < dropped.size(); ++i)
+	{
+		assert(qf_sync_insert(&s, dropped[i]));
+	}
+
+	printf("Starting rounds for qf_test_sync::readers=%d\n", readers);
+	atomic<bool> done(false);
+	atomic<uint64_t> lookups(0);
+	atomic<int> started(0);
+	vector<thread> threads;
+	for (int t = 0; t < readers; ++t)
+	{
+		threads.push_back(thread([&, t]() {
+			uint64_t n = 0;
+			size_t i = t;
+			++started;
+			while (!done.load() || n < 10000)
+			{
+				assert(qf_sync_may_contain(&s, stable[i % stable.size()]));
+				assert(!qf_sync_may_contain(&s, absent[i % absent.size()]));
+				qf_sync_may_contain(&s, added[i % added.size()]);
+				qf_sync_may_contain(&s, dropped[i % dropped.size()]);
+				++i;
+				++n;
+			}
+			lookups += n;
+		}));
+	}
+
+	while (started.load() < readers)
+	{
+	}
+
+	/* Swap added and dropped in and out; odd rounds leave added in. */
+	for (int round = 1; round <= 21; ++round)
+	{
+		vector<uint64_t> &in = (round % 2) ? added : dropped;
+		vector<uint64_t> &out = (round % 2) ? dropped : added;
+		for (size_t i = 0; i < in.size() || i < out.size(); ++i)
+		{
+			if (i < in.size())
+			{
+				assert(qf_sync_insert(&s, in[i]));
+			}
+			if (i < out.size())
+			{
+				assert(qf_sync_remove(&s, out[i]));
+			}
+		}
+	}
+	done = true;
+	for (int t = 0; t < readers; ++t)
+	{
+		threads[t].join();
+	}
+	assert(lookups.load() >= 10000ULL * readers);
+
+	for (size_t i = 0; i < added.size(); ++i)
+	{
+		assert(qf_sync_may_contain(&s, added[i]));
+	}
+	for (size_t i = 0; i < dropped.size(); ++i)
+	{
+		assert(!qf_sync_may_contain(&s, dropped[i]));
+	}
+	assert(D_RO(qf)->qf_entries == stable.size() + added.size());
+	qf_consistent(qf);
+
+	qf_sync_fini(&s);
+	qf_destroy(pop, qf);
+
+	/* Only classic QFs can be shared this way. */
+	assert(qf_init_blocked(pop, qf, q, r));
+	assert(!qf_sync_init(pop, qf, &s));
+	qf_destroy(pop, qf);
+}
+
+/*
+ * Insert and remove from several threads at once, with lookups running,
+ * then fill the QF to the brim from all of them.
+ */
+static void qf_test_sync_writers(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t q = 12;
+	const uint32_t r = 8;
+	const int writers = 4;
+
+	assert(qf_init(pop, qf, q, r));
+
+	struct qf_sync s;
+	assert(qf_sync_init(pop, qf, &s));
+
+	set<uint64_t> keys;
+	vector<uint64_t> stable;
+	vector<vector<uint64_t> > mine(writers);
+	for (uint64_t i = 0; i < 3 * (1ULL << q) / 4; ++i)
+	{
+		uint64_t hash = genhash(qf, true, keys);
+		keys.insert(hash);
+		if (i % (writers + 1) == 0)
+		{
+			stable.push_back(hash);
+			assert(qf_sync_insert(&s, hash));
+		}
+		else
+		{
+			mine[i % (writers + 1) - 1].push_back(hash);
+		}
+	}
+
+	printf("Starting rounds for qf_test_sync_writers::writers=%d\n", writers);
+	atomic<bool> done(false);
+	thread reader([&]() {
+		size_t i = 0;
+		while (!done.load())
+		{
+			assert(qf_sync_may_contain(&s, stable[i++ % stable.size()]));
+		}
+	});
+
+	/* Each writer adds its keys, takes every other one out, and checks. */
+	vector<thread> threads;
+	for (int t = 0; t < writers; ++t)
+	{
+		threads.push_back(thread([&, t]() {
+			vector<uint64_t> &ks = mine[t];
+			for (int round = 0; round < 5; ++round)
+			{
+				for (size_t i = 0; i < ks.size(); ++i)
+				{
+					assert(qf_sync_insert(&s, ks[i]));
+				}
+				for (size_t i = 0; i < ks.size(); ++i)
+				{
+					assert(qf_sync_may_contain(&s, ks[i]));
+				}
+				for (size_t i = round % 2; i < ks.size(); i += 2)
+				{
+					assert(qf_sync_remove(&s, ks[i]));
+				}
+			}
+		}));
+	}
+	for (int t = 0; t < writers; ++t)
+	{
+		threads[t].join();
+	}
+	done = true;
+	reader.join();
+
+	/* The last round removed the even keys of every writer. */
+	uint64_t want = stable.size();
+	for (int t = 0; t < writers; ++t)
+	{
+		for (size_t i = 0; i < mine[t].size(); ++i)
+		{
+			assert(qf_may_contain(qf, mine[t][i]) == (i % 2 == 1));
+			want += i % 2;
+		}
+	}
+	assert(D_RO(qf)->qf_entries == want);
+	qf_consistent(qf);
+
+	/* Race to fill the QF: it must end up exactly full. */
+	threads.clear();
+	for (int t = 0; t < writers; ++t)
+	{
+		threads.push_back(thread([&, t]() {
+			uint64_t x = t + 1;
+			for (uint64_t i = 0; i < (1ULL << q); ++i)
+			{
+				/* xorshift, so the threads need not share rand(). */
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				qf_sync_insert(&s, x & LOW_MASK(q + r));
+			}
+		}));
+	}
+	for (int t = 0; t < writers; ++t)
+	{
+		threads[t].join();
+	}
+	assert(D_RO(qf)->qf_entries == D_RO(qf)->qf_max_size);
+	assert(!qf_sync_insert(&s, rand64() & LOW_MASK(q + r)));
+	qf_consistent(qf);
+
+	qf_sync_fini(&s);
+	qf_destroy(pop, qf);
+}
+
+static void qf_test_counters(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t q = 10;
+	const uint32_t r = 8;
+	struct qf_counters c;
+	struct qf_counters total;
+
+	printf("Starting rounds for qf_test_counters\n");
+	qf_counters_reset();
+#ifndef QF_INSTRUMENT
+	/* Without the hooks nothing is counted. */
+	assert(qf_init(pop, qf, q, r));
+	assert(qf_insert(pop, qf, 1));
+	assert(qf_may_contain(qf, 1));
+	assert(!qf_counters_thread(&c) && !qf_counters_total(&total));
+	assert(c.qc_lookups == 0 && c.qc_tx == 0 && total.qc_inserts == 0);
+	qf_destroy(pop, qf);
+#else
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, q, r) : qf_init_blocked(pop, qf, q, r));
+		qf_counters_reset();
+		assert(qf_counters_thread(&c));
+		assert(c.qc_lookups == 0 && c.qc_inserts == 0 && c.qc_tx == 0);
+
+		/* Three fingerprints in one run: the third shifts the two after it. */
+		assert(qf_insert(pop, qf, (5 << r) | 9));
+		assert(qf_insert(pop, qf, (6 << r) | 1));
+		assert(qf_insert(pop, qf, (5 << r) | 2));
+		assert(qf_insert(pop, qf, (5 << r) | 9));
+		qf_counters_thread(&c);
+		assert(c.qc_inserts == 3 && c.qc_tx == 4 && c.qc_tx_aborts == 0);
+		assert(c.qc_shift_slots >= 2);
+		assert(c.qc_tx_bytes >= 4 * sizeof(uint64_t) && c.qc_lines > 0);
+
+		qf_counters_reset();
+		assert(qf_may_contain(qf, (5 << r) | 9));
+		assert(!qf_may_contain(qf, (5 << r) | 200));
+		assert(!qf_may_contain(qf, (50 << r) | 9));
+		qf_counters_thread(&c);
+		assert(c.qc_lookups == 3 && c.qc_scan_slots >= 3);
+		assert(c.qc_inserts == 0 && c.qc_tx == 0 && c.qc_tx_bytes == 0);
+		qf_destroy(pop, qf);
+	}
+
+	/* Another thread's counters show up in the total but not in ours. */
+	assert(qf_init(pop, qf, q, r));
+	qf_counters_reset();
+	qf_counters_total(&total);
+	thread([&]() {
+		qf_counters_reset();
+		for (uint64_t i = 0; i < 10; ++i)
+		{
+			assert(qf_insert(pop, qf, (i << r) | i));
+		}
+	}).join();
+	qf_counters_thread(&c);
+	assert(c.qc_inserts == 0);
+	struct qf_counters after;
+	assert(qf_counters_total(&after));
+	assert(after.qc_inserts == total.qc_inserts + 10);
+	qf_destroy(pop, qf);
+#endif
+}
+
+static int sum_range(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+	void *arg)
+{
+	atomic<uint64_t> *sums = (atomic<uint64_t> *)arg;
+	struct qf_iterator qfi;
+	uint64_t n = 0;
+	uint64_t sum = 0;
+
+	assert(qf_range_iter(qf, qlo, qhi, &qfi));
+	while (!qfi_done(qf, &qfi))
+	{
+		uint64_t hash = qfi_next(qf, &qfi);
+		uint64_t quot = hash >> D_RO(qf)->qf_rbits;
+		assert(quot >= qlo && quot < qhi);
+		sum += hash;
+		++n;
+	}
+	sums[0] += n;
+	sums[1] += sum;
+	return 0;
+}
+
+static int fail_range(TOID(struct quotient_filter) qf, uint64_t qlo, uint64_t qhi,
+	void *arg)
+{
+	return qlo == 0 ? 0 : 7;
+}
+
+/*
+ * Iterate over random quotient ranges and compare with the key set, then
+ * split the filter into partitions and walk them on several threads.
+ */
+static void qf_test_iter(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t q = 10;
+	const uint32_t r = 6;
+
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		printf("Starting rounds for qf_test_iter::format=%d\n", format);
+		assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, q, r) : qf_init_blocked(pop, qf, q, r));
+		uint64_t size = D_RO(qf)->qf_max_size;
+		struct qf_iterator qfi;
+
+		/* An empty QF has nothing in any range. */
+		assert(qf_range_iter(qf, 0, size, &qfi) && qfi_done(qf, &qfi));
+		assert(!qf_range_iter(qf, 5, 4, &qfi));
+		assert(!qf_range_iter(qf, 0, size + 1, &qfi));
+
+		/* The last quotient's run wraps around to slot 0 in a classic table. */
+		set<uint64_t> keys;
+		for (uint64_t rem = 1; rem <= 3; ++rem)
+		{
+			uint64_t hash = ((size - 1) << r) | rem;
+			assert(qf_insert(pop, qf, hash));
+			keys.insert(hash);
+		}
+		while (keys.size() < 9 * size / 10)
+		{
+			ht_put(pop, qf, keys);
+		}
+
+		for (uint32_t round = 0; round < ROUNDS_MAX * 10; ++round)
+		{
+			uint64_t qlo = rand64() % (size + 1);
+			uint64_t qhi = qlo + rand64() % (size + 1 - qlo);
+			if (round == 0)
+			{
+				qlo = 0;
+				qhi = size;
+			}
+			set<uint64_t>::iterator it = keys.lower_bound(qlo << r);
+			set<uint64_t>::iterator end = keys.lower_bound(qhi << r);
+
+			/* A range yields its fingerprints in sorted order. */
+			assert(qf_range_iter(qf, qlo, qhi, &qfi));
+			while (!qfi_done(qf, &qfi))
+			{
+				assert(it != end && qfi_next(qf, &qfi) == *it);
+				++it;
+			}
+			assert(it == end);
+
+			/* A seek runs to the end of the table. */
+			it = keys.lower_bound(qlo << r);
+			qfi_seek(qf, &qfi, qlo);
+			while (!qfi_done(qf, &qfi))
+			{
+				assert(it != keys.end() && qfi_next(qf, &qfi) == *it);
+				++it;
+			}
+			assert(it == keys.end());
+		}
+
+		uint64_t total = 0;
+		for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+		{
+			total += *it;
+		}
+		for (unsigned n = 1; n <= 16; n *= 2)
+		{
+			/* Partitions cover the quotients in ascending order. */
+			uint64_t bounds[17];
+			size_t parts = qf_partitions(qf, n, bounds);
+			assert(parts >= 1 && parts <= n);
+			assert(bounds[0] == 0 && bounds[parts] == size);
+			for (size_t k = 0; k < parts; ++k)
+			{
+				assert(bounds[k] < bounds[k + 1]);
+			}
+
+			atomic<uint64_t> sums[2];
+			sums[0] = 0;
+			sums[1] = 0;
+			assert(qf_parallel_for(qf, n, sum_range, sums) == 0);
+			assert(sums[0] == keys.size() && sums[1] == total);
+		}
+
+		/* The first failure in order of range is returned. */
+		uint64_t bounds[5];
+		int want = qf_partitions(qf, 4, bounds) > 1 ? 7 : 0;
+		assert(qf_parallel_for(qf, 4, fail_range, NULL) == want);
+
+		qf_destroy(pop, qf);
+	}
+}
+
+/* The table words of a DRAM copy are those of the pmem QF. */
+static void mem_same(const struct qf_mem &m, TOID(struct quotient_filter) qf)
+{
+	const struct quotient_filter *f = D_RO(qf);
+	assert(m.qm_entries == f->qf_entries);
+	assert(!memcmp(m.qm_view.qfv_table, D_RO(f->qf_table),
+		table_bytes(f->qf_format, f->qf_qbits, f->qf_rbits)));
+}
+
+/*
+ * Run the same updates on a pmem QF and on a DRAM QF, for every format,
+ * and compare results and tables; then update a pmem QF through a
+ * hybrid handle and check that both copies stay alike.
+ */
+static void qf_test_mem(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t q = 8;
+	const uint32_t r = 6;
+
+	for (int kind = 0; kind < 3; ++kind)
+	{
+		printf("Starting rounds for qf_test_mem::kind=%d\n", kind);
+		struct qf_mem m;
+		if (kind == 0)
+		{
+			assert(qf_init(pop, qf, q, r) && qf_mem_init(&m, q, r));
+		}
+		else if (kind == 1)
+		{
+			assert(qf_init_blocked(pop, qf, q, r) && qf_mem_init_blocked(&m, q, r));
+		}
+		else
+		{
+			assert(qf_init_counting(pop, qf, q, r) && qf_mem_init_counting(&m, q, r));
+		}
+		assert(m.qm_view.qfv_backend == QF_BACKEND_DRAM);
+
+		set<uint64_t> keys;
+		for (uint32_t i = 0; i < 8 * (1U << q); ++i)
+		{
+			uint64_t hash;
+			if (keys.size() && rand() % 3 == 0)
+			{
+				set<uint64_t>::iterator it = keys.begin();
+				advance(it, rand64() % keys.size());
+				hash = *it;
+				uint64_t c = (kind == 2) ? 1 + rand() % 3 : 1;
+				assert(qf_remove_count(pop, qf, hash, c) == qf_mem_remove_count(&m, hash, c));
+				if (!qf_mem_may_contain(&m, hash))
+				{
+					keys.erase(hash);
+				}
+			}
+			else
+			{
+				hash = genhash(qf, true, keys);
+				uint64_t c = (kind == 2) ? random_count() : 1;
+				bool ok = qf_insert_count(pop, qf, hash, c);
+				assert(ok == qf_mem_insert_count(&m, hash, c));
+				if (ok)
+				{
+					keys.insert(hash);
+				}
+			}
+			assert(qf_may_contain(qf, hash) == qf_mem_may_contain(&m, hash));
+			assert(qf_count(qf, hash) == qf_mem_count(&m, hash));
+		}
+		mem_same(m, qf);
+		assert(!qf_mem_remove(&m, 1ULL << (q + r)));
+		qf_mem_fini(&m);
+
+		/* Through a hybrid handle, updates reach both tables. */
+		assert(qf_mem_open(&m, pop, qf));
+		assert(m.qm_view.qfv_backend == QF_BACKEND_HYBRID);
+		mem_same(m, qf);
+		for (uint32_t i = 0; i < 4 * (1U << q); ++i)
+		{
+			uint64_t hash = rand64() & LOW_MASK(q + r);
+			if (rand() % 2)
+			{
+				qf_mem_insert(&m, hash);
+			}
+			else
+			{
+				assert(qf_mem_remove(&m, hash));
+			}
+			assert(qf_may_contain(qf, hash) == qf_mem_may_contain(&m, hash));
+		}
+		mem_same(m, qf);
+		qf_consistent(qf);
+		qf_mem_fini(&m);
+		assert(qf_open(pop, qf));
+		qf_destroy(pop, qf);
+	}
+
+	struct qf_mem m;
+	assert(!qf_mem_init(&m, 0, 8) && !qf_mem_init_counting(&m, 8, 1));
+	assert(!qf_mem_open(&m, pop, qf));
+}
+
+/*
+ * Update QFs through a metadata tier and check its lookups against
+ * qf_may_contain(), and its mirror against one rebuilt from the table.
+ */
+static void qf_test_tier(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	const uint32_t qs[] = {3, 7, 10};
+	const uint32_t rs[] = {1, 5, 13};
+
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		for (size_t qi = 0; qi < sizeof(qs) / sizeof(qs[0]); ++qi)
+		{
+			for (size_t ri = 0; ri < sizeof(rs) / sizeof(rs[0]); ++ri)
+			{
+				uint32_t q = qs[qi];
+				uint32_t r = rs[ri];
+				printf("Starting rounds for qf_test_tier::format=%d,q=%u,r=%u\n", format, q, r);
+				assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, q, r) : qf_init_blocked(pop, qf, q, r));
+
+				struct qf_tier t;
+				assert(qf_tier_open(pop, qf, &t));
+				set<uint64_t> keys;
+				uint64_t size = D_RO(qf)->qf_max_size;
+				for (uint64_t i = 0; i < 6 * size; ++i)
+				{
+					if (keys.size() && (keys.size() == size || rand() % 3 == 0))
+					{
+						set<uint64_t>::iterator it = keys.begin();
+						advance(it, rand64() % keys.size());
+						assert(qf_tier_remove(&t, *it));
+						keys.erase(it);
+					}
+					else
+					{
+						uint64_t hash = genhash(qf, true, keys);
+						if (qf_tier_insert(&t, hash))
+						{
+							keys.insert(hash);
+						}
+					}
+					uint64_t probe = rand64() & LOW_MASK(q + r);
+					assert(qf_tier_may_contain(&t, probe) == qf_may_contain(qf, probe));
+				}
+				ht_check(qf, keys);
+				for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+				{
+					assert(qf_tier_may_contain(&t, *it));
+				}
+				qf_consistent(qf);
+
+				/* The mirror kept up with every update. */
+				struct qf_tier fresh;
+				assert(qf_tier_open(pop, qf, &fresh));
+				size_t bytes = (format == QF_FORMAT_BLOCKED) ?
+					table_bytes(format, q, 0) : qf_table_size(q, 0);
+				assert(!memcmp(t.qt_meta.qfv_table, fresh.qt_meta.qfv_table, bytes));
+				qf_tier_fini(&fresh);
+				qf_tier_fini(&t);
+				qf_destroy(pop, qf);
+			}
+		}
+	}
+
+	struct qf_tier t;
+	assert(qf_init_counting(pop, qf, 8, 4));
+	assert(!qf_tier_open(pop, qf, &t));
+	qf_destroy(pop, qf);
+}
+
+/* ht_check() for a QF with staged inserts, which views do not see. */
+static void staged_check(TOID(struct quotient_filter) qf, set<uint64_t> &keys)
+{
+	qf_consistent(qf);
+	for (set<uint64_t>::iterator it = keys.begin(); it != keys.end(); ++it)
+	{
+		assert(qf_may_contain(qf, *it));
+	}
+}
+
+/*
+ * Inserts staged in the log: lookups see them before the drain, the drain
+ * leaves the same table as direct inserts would, and every path that
+ * rewrites the table deals with the log first.
+ */
+static void qf_test_log(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		for (uint32_t q = 4; q <= 10; q += 3)
+		{
+			uint32_t r = 6;
+			printf("Starting rounds for qf_test_log::format=%d,q=%u\n", format, q);
+			assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, q, r) : qf_init_blocked(pop, qf, q, r));
+			assert(qf_set_max_load(pop, qf, 90, QF_FULL_REJECT, TOID_NULL(struct quotient_filter)));
+			uint64_t cap = 1 + (1ULL << q) / 8;
+			assert(qf_set_log(pop, qf, cap));
+			assert(qf_open(pop, qf));
+
+			set<uint64_t> keys;
+			uint64_t limit = load_limit(q, 90);
+			for (;;)
+			{
+				uint64_t hash = genhash(qf, true, keys);
+				if (!qf_insert(pop, qf, hash))
+				{
+					break;
+				}
+				keys.insert(hash);
+				const struct quotient_filter *f = D_RO(qf);
+				assert(f->qf_log_len <= cap && f->qf_entries + f->qf_log_len <= limit);
+				assert(qf_may_contain(qf, hash) && qf_count(qf, hash) == 1);
+			}
+			assert(keys.size() == limit);
+			staged_check(qf, keys);
+
+			vector<uint64_t> probes(keys.begin(), keys.end());
+			for (int i = 0; i < 64; ++i)
+			{
+				probes.push_back(rand64() & LOW_MASK(q + r));
+			}
+			vector<uint8_t> out(probes.size());
+			qf_may_contain_batch(qf, probes.data(), probes.size(), out.data());
+			for (size_t i = 0; i < probes.size(); ++i)
+			{
+				assert(out[i] == qf_may_contain(qf, probes[i]));
+			}
+
+			/* An aborted drain leaves table and log as they were. */
+			uint64_t staged = D_RO(qf)->qf_log_len;
+			uint64_t entries = D_RO(qf)->qf_entries;
+			TX_BEGIN(pop)
+			{
+				assert(qf_log_drain(pop, qf));
+				pmemobj_tx_abort(-1);
+			}
+			TX_END;
+			assert(D_RO(qf)->qf_log_len == staged && D_RO(qf)->qf_entries == entries);
+			staged_check(qf, keys);
+
+			assert(qf_log_drain(pop, qf));
+			assert(D_RO(qf)->qf_log_len == 0 && D_RO(qf)->qf_entries == keys.size());
+			qf_consistent(qf);
+			ht_check(qf, keys);
+
+			/* Removes drain first, so nothing staged comes back afterwards. */
+			set<uint64_t>::iterator it = keys.begin();
+			for (int i = 0; i < 4 && it != keys.end(); ++i)
+			{
+				assert(qf_remove(pop, qf, *it));
+				keys.erase(it++);
+			}
+			uint64_t hash = genhash(qf, true, keys);
+			assert(qf_insert(pop, qf, hash) && D_RO(qf)->qf_log_len == 1);
+			assert(qf_remove(pop, qf, hash));
+			assert(D_RO(qf)->qf_log_len == 0 && !qf_may_contain(qf, hash));
+			ht_check(qf, keys);
+			qf_consistent(qf);
+
+			/* qf_resize() keeps the staged fingerprints. */
+			assert(qf_set_max_load(pop, qf, 100, QF_FULL_REJECT, TOID_NULL(struct quotient_filter)));
+			hash = genhash(qf, true, keys);
+			assert(qf_insert(pop, qf, hash));
+			keys.insert(hash);
+			assert(qf_resize(pop, qf, q + 1) && D_RO(qf)->qf_log_len == 1);
+			assert(qf_open(pop, qf));
+			staged_check(qf, keys);
+			assert(!qf_set_hash(pop, qf, QF_HASH_INVERTIBLE, 1));
+
+			/* qf_build() and qf_clear() discard the log with the table. */
+			assert(qf_build(pop, qf, probes.data(), 0) && D_RO(qf)->qf_log_len == 0);
+			assert(qf_insert(pop, qf, hash) && D_RO(qf)->qf_log_len == 1);
+			qf_clear(pop, qf);
+			assert(D_RO(qf)->qf_log_len == 0 && !qf_may_contain(qf, hash));
+
+			/* The other handles want the log drained. */
+			assert(qf_insert(pop, qf, hash));
+			struct qf_mem m;
+			assert(!qf_mem_open(&m, pop, qf));
+			assert(qf_set_log(pop, qf, 0));
+			assert(TOID_IS_NULL(D_RO(qf)->qf_log) && D_RO(qf)->qf_entries == 1);
+			assert(qf_open(pop, qf) && qf_may_contain(qf, hash));
+			assert(qf_mem_open(&m, pop, qf));
+			qf_mem_fini(&m);
+			qf_destroy(pop, qf);
+		}
+	}
+
+	assert(qf_init_counting(pop, qf, 8, 4));
+	assert(!qf_set_log(pop, qf, 16));
+	qf_destroy(pop, qf);
+}
+
+/*
+ * Damage the table of qf the way a bad media line would, at the first
+ * suitable slot from start. Returns false if there was none.
+ */
+static bool corrupt(TOID(struct quotient_filter) qf, int kind, uint64_t start)
+{
+	struct qf_view v;
+	qfv_init(qf, &v);
+
+	if (v.qfv_format == QF_FORMAT_BLOCKED)
+	{
+		uint64_t nblocks = v.qfv_nslots / QF_BLOCK_SLOTS;
+		for (uint64_t i = 0; i < v.qfv_nslots; ++i)
+		{
+			uint64_t s = (start + i) % v.qfv_nslots;
+			uint64_t *blk = blk_block(&v, s / QF_BLOCK_SLOTS);
+			uint64_t bit = 1ULL << (s % QF_BLOCK_SLOTS);
+			switch (kind)
+			{
+			case 0:	/* an offset off by a few */
+				if (s % QF_BLOCK_SLOTS == 0 && s / QF_BLOCK_SLOTS + 1 < nblocks)
+				{
+					blk[BLK_OFFSET] += 3;
+					return true;
+				}
+				break;
+			case 1:	/* a stray occupied bit */
+				if (!(blk[BLK_OCCUPIEDS] & bit) && s < v.qfv_max_size)
+				{
+					blk[BLK_OCCUPIEDS] |= bit;
+					return true;
+				}
+				break;
+			case 2:	/* a lost runend */
+				if (blk[BLK_RUNENDS] & bit)
+				{
+					blk[BLK_RUNENDS] &= ~bit;
+					return true;
+				}
+				break;
+			default:	/* a lost occupied bit */
+				if (blk[BLK_OCCUPIEDS] & bit)
+				{
+					blk[BLK_OCCUPIEDS] &= ~bit;
+					return true;
+				}
+				break;
+			}
+		}
+		return false;
+	}
+
+	for (uint64_t i = 0; i < v.qfv_max_size; ++i)
+	{
+		uint64_t s = (start + i) & v.qfv_index_mask;
+		uint64_t elt = get_elem(&v, s);
+		switch (kind)
+		{
+		case 0:	/* a lost shifted bit */
+			if (is_shifted(elt))
+			{
+				set_elem(&v, s, clr_shifted(elt));
+				return true;
+			}
+			break;
+		case 1:	/* a stray shifted bit */
+			if (!is_empty_element(elt) && !is_shifted(elt))
+			{
+				set_elem(&v, s, set_shifted(elt));
+				return true;
+			}
+			break;
+		case 2:	/* a stray occupied bit */
+			if (!is_occupied(elt))
+			{
+				set_elem(&v, s, set_occupied(elt));
+				return true;
+			}
+			break;
+		case 3:	/* a lost continuation bit */
+			if (is_continuation(elt))
+			{
+				set_elem(&v, s, clr_continuation(elt));
+				return true;
+			}
+			break;
+		default:	/* a lost occupied bit */
+			if (is_occupied(elt))
+			{
+				set_elem(&v, s, clr_occupied(elt));
+				return true;
+			}
+			break;
+		}
+	}
+	return false;
+}
+
+static void qf_test_check(PMEMobjpool *pop, TOID(struct quotient_filter) qf)
+{
+	struct qf_check_info info;
+
+	for (int format = QF_FORMAT_CLASSIC; format <= QF_FORMAT_BLOCKED; ++format)
+	{
+		/*
+		 * Kinds below nexact leave every run with its quotient; a single
+		 * hit of those below nkeep leaves every quotient its occupied bit.
+		 */
+		int nkinds = (format == QF_FORMAT_CLASSIC) ? 5 : 4;
+		int nexact = (format == QF_FORMAT_CLASSIC) ? 2 : 1;
+		int nkeep = nexact + 1;
+		for (uint32_t q = 6; q <= 12; q += 3)
+		{
+			for (int kind = 0; kind < nkinds; ++kind)
+			{
+				for (int hits = 1; hits <= 4; hits += 3)
+				{
+					uint32_t r = 8;
+					printf("Starting rounds for qf_test_check::format=%d,q=%u,kind=%d,hits=%d\n",
+						format, q, kind, hits);
+					assert(format == QF_FORMAT_CLASSIC ? qf_init(pop, qf, q, r) : qf_init_blocked(pop, qf, q, r));
+					assert(qf_open(pop, qf));
+					set<uint64_t> keys;
+					if (format == QF_FORMAT_CLASSIC)
+					{
+						/* A run that wraps around the end of the table. */
+						uint64_t top = (uint64_t)D_RO(qf)->qf_index_mask << r;
+						for (uint64_t rem = 1; rem <= 4; ++rem)
+						{
+							assert(qf_insert(pop, qf, top | rem));
+							keys.insert(top | rem);
+						}
+					}
+					while (keys.size() < D_RO(qf)->qf_max_size / 4)
+					{
+						uint64_t hash = genhash(qf, true, keys);
+						assert(qf_insert(pop, qf, hash));
+						keys.insert(hash);
+					}
+
+					assert(qf_check(qf, 0, &info) == 0 && info.qci_damaged == 0);
+					assert(info.qci_entries == keys.size());
+					assert(qf_check(qf, QF_CHECK_PARALLEL | QF_CHECK_FIRST, NULL) == 0);
+					assert(qf_repair(pop, qf, QF_CHECK_PARALLEL, &info) == 0);
+
+					/* Small tables may run out of targets after the first. */
+					assert(corrupt(qf, kind, 0));
+					for (int i = 1; i < hits; ++i)
+					{
+						corrupt(qf, kind, rand64());
+					}
+					struct qf_check_info par;
+					assert(qf_check(qf, 0, &info) == 1 && info.qci_damaged >= 1);
+					assert(qf_check(qf, QF_CHECK_PARALLEL, &par) == 1);
+					assert(par.qci_damaged == info.qci_damaged && par.qci_entries == info.qci_entries);
+					assert(par.qci_first == info.qci_first && par.qci_len == info.qci_len);
+					assert(qf_check(qf, QF_CHECK_PARALLEL | QF_CHECK_FIRST, NULL) == 1);
+
+					assert(qf_repair(pop, qf, QF_CHECK_PARALLEL, &info) == 1);
+					assert(qf_check(qf, QF_CHECK_PARALLEL, NULL) == 0);
+					qf_consistent(qf);
+					if (kind < nexact)
+					{
+						assert(info.qci_salvaged == 0 && D_RO(qf)->qf_entries == keys.size());
+					}
+					if (kind < nexact || (kind < nkeep && hits == 1))
+					{
+						ht_check(qf, keys);
+					}
+					qf_destroy(pop, qf);
+				}
+			}
+		}
+	}
+
+	/* A wrong entry count alone is fixed without touching the table. */
+	printf("Starting rounds for qf_test_check::entries\n");
+	assert(qf_init(pop, qf, 10, 8));
+	set<uint64_t> keys;
+	while (keys.size() < D_RO(qf)->qf_max_size / 2)
+	{
+		uint64_t hash = genhash(qf, true, keys);
+		assert(qf_insert(pop, qf, hash));
+		keys.insert(hash);
+	}
+	TX_BEGIN(pop)
+	{
+		TX_ADD_FIELD(qf, qf_entries);
+		D_RW(qf)->qf_entries += 5;
+	}
+	TX_END;
+	uint64_t entries = D_RO(qf)->qf_entries - 5;
+	assert(qf_check(qf, 0, &info) == 1 && info.qci_damaged == 0 && info.qci_entries == entries);
+	assert(qf_repair(pop, qf, 0, NULL) == 1 && D_RO(qf)->qf_entries == entries);
+	assert(qf_check(qf, 0, NULL) == 0);
+	qf_destroy(pop, qf);
+	assert(qf_check(qf, 0, NULL) == -1);
+
+	/* Counters cannot be read back from a broken run. */
+	printf("Starting rounds for qf_test_check::counting\n");
+	assert(qf_init_counting(pop, qf, 8, 4));
+	keys.clear();
+	for (int i = 0; i < 64; ++i)
+	{
+		uint64_t hash = genhash(qf, true, keys);
+		assert(qf_insert_count(pop, qf, hash, 1 + i % 7));
+		keys.insert(hash);
+	}
+	assert(qf_check(qf, 0, NULL) == 0);
+	assert(corrupt(qf, 4, 0));
+	entries = D_RO(qf)->qf_entries;
+	assert(qf_check(qf, 0, NULL) == 1);
+	assert(qf_repair(pop, qf, 0, NULL) == -1 && D_RO(qf)->qf_entries == entries);
+	assert(qf_check(qf, 0, NULL) == 1);
+	qf_destroy(pop, qf);
+}
+
+static void qf_test(PMEMobjpool *pop,TOID(struct quotient_filter) qf1_test,
+	TOID(struct quotient_filter) qf2_test,TOID(struct quotient_filter) qf21_test,TOID(struct quotient_filter) qf22_test)
+{
+	qf_test_wide(pop, qf1_test);
+	qf_test_dir(pop);
+	qf_test_blocked(pop, qf1_test, qf2_test);
+	qf_test_kernels(pop, qf1_test);
+	qf_test_build(pop, qf1_test, qf2_test);
+	qf_test_merge_many(pop, qf1_test, qf2_test);
+	qf_test_resize(pop, qf1_test, qf2_test);
+	qf_test_load(pop, qf1_test, qf2_test);
+	qf_test_counting(pop, qf1_test, qf2_test);
+	qf_test_keys(pop, qf1_test, qf2_test, qf21_test);
+	qf_test_stats(pop, qf1_test);
+	qf_test_counters(pop, qf1_test);
+	qf_test_sync(pop, qf1_test);
+	qf_test_sync_writers(pop, qf1_test);
+	qf_test_iter(pop, qf1_test);
+	qf_test_mem(pop, qf1_test);
+	qf_test_tier(pop, qf1_test);
+	qf_test_log(pop, qf1_test);
+	qf_test_check(pop, qf1_test);
+
 	
 	for (uint32_t q = 1; q <= Q_MAX; ++q)
 	{
 		printf("Starting rounds for qf_test::q=%u\n", q);
-#pragma omp parallel for
 		for (uint32_t r = 1; r <= R_MAX; ++r)
 		{
 			// 使用不同的q和r初始化QF，然后test
@@ -406,8 +2754,12 @@ static void qf_test(PMEMobjpool *pop,TOID(struct quotient_filter) qf1_test,
 			{
 				fail(qf1_test, "init-1");
 			}
+			assert(qf_open(pop,qf1_test));
 			qf_test_basic(pop,qf1_test);
+			qf_test_batch(pop,qf1_test);
+			qf_test_abort(pop,qf1_test);
 			qf_destroy(pop,qf1_test);
+			assert(!qf_open(pop,qf1_test));
 		}
 	}
 
@@ -419,7 +2771,6 @@ static void qf_test(PMEMobjpool *pop,TOID(struct quotient_filter) qf1_test,
 			{
 				printf("Starting rounds for qf_merge::q1=%u,q2=%u\n", q1, q2);
 
-#pragma omp parallel for
 				for (uint32_t r2 = 1; r2 <= R_MAX; ++r2)
 				{
 					//struct quotient_filter qf;